@@ -9,6 +9,24 @@
 #   ./run_tests.sh --build-only     # Build only, don't run
 #   ./run_tests.sh --qemu           # Run on QEMU instead of hexagon-sim
 #   ./run_tests.sh test_sys_regs    # Run a single test
+#   ./run_tests.sh -j 4 --timeout test_threads=120 --label qemu-9.2 --qemu
+#   ./run_tests.sh --bench 20 -j 1 --qemu  # Repeat each subtest 20 times
+#   ./run_tests.sh --qemu bench_hvx_context  # bench_* only run when named
+#
+# The binaries are run by the host-side runner in runner/, built here with
+# the stable toolchain for the host: concurrently (-j, default CPU count),
+# each with a timeout (--timeout, default 30s on QEMU, 300s on hexagon-sim).
+# It writes a JUnit report of every run_test() subtest with its duration to
+# ${BUILD_DIR}/test-results.xml and appends the timings to
+# test-history.jsonl, reporting what got slower than in its last run.
+# The other options (--budget, --junit, --history, --label, --slower) are
+# passed through, see runner/src/main.rs.
+#
+# Every run_test() verdict carries the guest pcycles and host time the
+# subtest took, recorded in the history as well. --bench N builds with the
+# "bench" feature, which repeats each subtest N times and reports the
+# minimum and median; the count is fixed at build time. Run it with -j 1
+# and a longer --timeout so the subtests don't compete for host CPU.
 #
 # hexagon-sim requires --timing --bypass_idle for L2VIC and QTimer cosim
 # operation (see SDK cosim examples). The cosim config (cosim/q6ss.cfg)
@@ -27,25 +45,27 @@ QEMU="${QEMU:-qemu-system-hexagon}"
 QEMU_MACHINE="${QEMU_MACHINE:-V81QA_1}"
 BUILD_DIR="target/${TARGET}/release"
 BUILD_ONLY=0
-USE_QEMU=0
-SINGLE_TEST=""
+RUNNER_TOOLCHAIN="${RUNNER_TOOLCHAIN:-+stable}"
+RUNNER_ARGS=()
+CARGO_FEATURES=()
 
 # Parse arguments
 while [[ $# -gt 0 ]]; do
     case "$1" in
         --build-only) BUILD_ONLY=1; shift ;;
-        --qemu)       USE_QEMU=1; shift ;;
-        *)            SINGLE_TEST="$1"; shift ;;
+        --qemu)       RUNNER_ARGS+=("$1"); shift ;;
+        --bench)      [[ $# -ge 2 ]] || { echo "ERROR: --bench needs a run count"; exit 1; }
+                      export ARCH_TESTS_BENCH_RUNS="$2"
+                      CARGO_FEATURES=(--features bench); shift 2 ;;
+        -j|--jobs|--timeout|--budget|--junit|--history|--label|--slower)
+                      RUNNER_ARGS+=("$1" "$2"); shift 2 ;;
+        -*)           echo "ERROR: unknown option $1"; exit 1 ;;
+        *)            RUNNER_ARGS+=("$1"); shift ;;
     esac
 done
 
-# Filter to single test if specified, otherwise discover from build dir
-if [[ -n "$SINGLE_TEST" ]]; then
-    TESTS=("$SINGLE_TEST")
-fi
-
 echo "=== Building Rust Hexagon Tests ==="
-cargo $TOOLCHAIN build --release 2>&1
+cargo $TOOLCHAIN build --release "${CARGO_FEATURES[@]}" 2>&1
 echo "Build complete."
 echo ""
 
@@ -54,59 +74,16 @@ if [[ "$BUILD_ONLY" -eq 1 ]]; then
     exit 0
 fi
 
-# Discover test binaries from the build directory
-if [[ -z "$SINGLE_TEST" ]]; then
-    TESTS=()
-    for f in "${BUILD_DIR}"/test_*; do
-        [[ -f "$f" && -x "$f" && ! "$f" =~ \. ]] || continue
-        TESTS+=("$(basename "$f")")
-    done
-    IFS=$'\n' TESTS=($(sort <<<"${TESTS[*]}")); unset IFS
-fi
-
-if [[ ${#TESTS[@]} -eq 0 ]]; then
-    echo "ERROR: No test binaries found in ${BUILD_DIR}"
-    exit 1
-fi
-
-# Run tests
-PASS=0
-FAIL=0
-ERRORS=()
-
-for test in "${TESTS[@]}"; do
-    binary="${BUILD_DIR}/${test}"
-    if [[ ! -f "$binary" ]]; then
-        echo "SKIP: $test (binary not found)"
-        continue
-    fi
-
-    echo "--- Running: $test ---"
-    rc=0
-    if [[ "$USE_QEMU" -eq 1 ]]; then
-        output=$(timeout 30 $QEMU -M "$QEMU_MACHINE" -kernel "$binary" -nographic 2>&1) || rc=$?
-    else
-        output=$($SIM --mv81 --timing --bypass_idle --cosim_file "$SCRIPT_DIR/cosim/q6ss.cfg" -- "$binary" 2>&1) || rc=$?
-    fi
-    echo "$output"
-
-    if [[ $rc -eq 0 ]]; then
-        PASS=$((PASS + 1))
-    else
-        FAIL=$((FAIL + 1))
-        ERRORS+=("$test")
-    fi
-    echo ""
-done
+# The runner is a host program: it can't use the hexagon target and
+# build-std settings of .cargo/config.toml, which nightly would apply.
+HOST="$(rustc $RUNNER_TOOLCHAIN -vV | sed -n 's/^host: //p')"
+echo "=== Building the test runner ==="
+cargo $RUNNER_TOOLCHAIN build --release --manifest-path runner/Cargo.toml \
+    --target "$HOST" 2>&1
+echo ""
 
-echo "=============================="
-echo "Results: $PASS passed, $FAIL failed out of ${#TESTS[@]} tests"
-if [[ ${#ERRORS[@]} -gt 0 ]]; then
-    echo "Failed tests:"
-    for e in "${ERRORS[@]}"; do
-        echo "  - $e"
-    done
-    exit 1
-fi
-echo "All tests PASSED"
-exit 0
+export QEMU QEMU_MACHINE
+export HEXAGON_SIM="$SIM"
+exec "runner/target/${HOST}/release/arch-test-runner" \
+    --build-dir "$BUILD_DIR" --cosim "$SCRIPT_DIR/cosim/q6ss.cfg" \
+    "${RUNNER_ARGS[@]}"
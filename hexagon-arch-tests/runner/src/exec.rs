@@ -0,0 +1,188 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! Runs one test binary under the emulator, with a timeout, and splits its
+//! output into subtests as it arrives.
+
+use std::io::Read;
+use std::path::Path;
+use std::process::{Command, Stdio};
+use std::sync::mpsc;
+use std::thread;
+use std::time::{Duration, Instant};
+
+use crate::parse::{OutputParser, Status, Subtest};
+
+/// How a test binary is run.
+#[derive(Clone, Debug)]
+pub enum Emulator {
+    Qemu { bin: String, machine: String },
+    Sim { bin: String, cosim: String },
+}
+
+impl Emulator {
+    pub fn name(&self) -> &'static str {
+        match self {
+            Emulator::Qemu { .. } => "qemu",
+            Emulator::Sim { .. } => "hexagon-sim",
+        }
+    }
+
+    fn command(&self, binary: &Path) -> Command {
+        match self {
+            Emulator::Qemu { bin, machine } => {
+                let mut cmd = Command::new(bin);
+                cmd.arg("-M")
+                    .arg(machine)
+                    .arg("-kernel")
+                    .arg(binary)
+                    .arg("-nographic");
+                cmd
+            }
+            // --timing --bypass_idle are needed by the L2VIC and QTimer cosims
+            Emulator::Sim { bin, cosim } => {
+                let mut cmd = Command::new(bin);
+                cmd.args(["--mv81", "--timing", "--bypass_idle", "--cosim_file"])
+                    .arg(cosim)
+                    .arg("--")
+                    .arg(binary);
+                cmd
+            }
+        }
+    }
+}
+
+#[derive(Clone, Debug)]
+pub struct TestResult {
+    pub name: String,
+    pub status: Status,
+    pub duration: Duration,
+    pub exit_code: Option<i32>,
+    pub output: String,
+    pub subtests: Vec<Subtest>,
+}
+
+enum Event {
+    Stdout(Vec<u8>, Instant),
+    Stderr(Vec<u8>),
+    Closed,
+}
+
+fn forward<R: Read + Send + 'static>(mut pipe: R, tx: mpsc::Sender<Event>, is_stdout: bool) {
+    thread::spawn(move || {
+        let mut buf = [0u8; 4096];
+        loop {
+            match pipe.read(&mut buf) {
+                Ok(0) | Err(_) => break,
+                Ok(n) => {
+                    let data = buf[..n].to_vec();
+                    let event = if is_stdout {
+                        Event::Stdout(data, Instant::now())
+                    } else {
+                        Event::Stderr(data)
+                    };
+                    if tx.send(event).is_err() {
+                        return;
+                    }
+                }
+            }
+        }
+        let _ = tx.send(Event::Closed);
+    });
+}
+
+/// Runs `binary`, killing it after `timeout`.
+pub fn run(emulator: &Emulator, name: &str, binary: &Path, timeout: Duration) -> TestResult {
+    let start = Instant::now();
+    let mut child = match emulator
+        .command(binary)
+        .stdin(Stdio::null())
+        .stdout(Stdio::piped())
+        .stderr(Stdio::piped())
+        .spawn()
+    {
+        Ok(child) => child,
+        Err(e) => {
+            return TestResult {
+                name: name.to_string(),
+                status: Status::Error,
+                duration: Duration::ZERO,
+                exit_code: None,
+                output: format!("cannot run {}: {}\n", emulator.name(), e),
+                subtests: Vec::new(),
+            }
+        }
+    };
+
+    let (tx, rx) = mpsc::channel();
+    forward(child.stdout.take().unwrap(), tx.clone(), true);
+    forward(child.stderr.take().unwrap(), tx, false);
+
+    let deadline = start + timeout;
+    let mut parser = OutputParser::new();
+    let mut output = Vec::new();
+    let mut open = 2;
+    let mut timed_out = false;
+    while open > 0 {
+        let now = Instant::now();
+        if now >= deadline {
+            timed_out = true;
+            let _ = child.kill();
+            break;
+        }
+        match rx.recv_timeout(deadline - now) {
+            Ok(Event::Stdout(data, at)) => {
+                parser.feed(&data, at);
+                output.extend_from_slice(&data);
+            }
+            Ok(Event::Stderr(data)) => output.extend_from_slice(&data),
+            Ok(Event::Closed) => open -= 1,
+            Err(mpsc::RecvTimeoutError::Timeout) => continue,
+            Err(mpsc::RecvTimeoutError::Disconnected) => break,
+        }
+    }
+    let exit_code = child.wait().ok().and_then(|status| status.code());
+    let end = Instant::now();
+    // Whatever the killed process had left in the pipes
+    while let Ok(event) = rx.try_recv() {
+        match event {
+            Event::Stdout(data, at) => {
+                parser.feed(&data, at);
+                output.extend_from_slice(&data);
+            }
+            Event::Stderr(data) => output.extend_from_slice(&data),
+            Event::Closed => {}
+        }
+    }
+
+    let unfinished = if timed_out {
+        Status::Timeout
+    } else {
+        Status::Error
+    };
+    let subtests = parser.finish(end, unfinished);
+    let status = if timed_out {
+        Status::Timeout
+    } else if subtests.iter().any(|s| s.status != Status::Passed) {
+        Status::Failed
+    } else if exit_code != Some(0) {
+        // Nonzero exit without a failed subtest: it crashed, or a check
+        // failed outside of run_test()
+        if subtests.is_empty() {
+            Status::Error
+        } else {
+            Status::Failed
+        }
+    } else {
+        Status::Passed
+    };
+
+    TestResult {
+        name: name.to_string(),
+        status,
+        duration: end - start,
+        exit_code,
+        output: String::from_utf8_lossy(&output).into_owned(),
+        subtests,
+    }
+}
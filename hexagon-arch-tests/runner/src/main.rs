@@ -0,0 +1,424 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! Host-side runner for the hexagon-arch-tests binaries.
+//!
+//! Runs the `test_*` binaries concurrently under hexagon-sim or QEMU, each
+//! with a timeout, splits their output into the subtests reported by
+//! `run_test()`, and writes a JUnit report and a JSON Lines timing history.
+//! Tests and subtests whose host time grew past `--slower` times the last
+//! run of the history that had them are listed at the end, and apart from
+//! them those whose guest pcycles changed as much either way.
+//!
+//! ```text
+//! arch-test-runner [options] [test_name...]
+//!   --qemu                  run on QEMU ($QEMU, $QEMU_MACHINE) instead of
+//!                           hexagon-sim ($HEXAGON_SIM)
+//!   -j, --jobs N            binaries run at once (default: CPU count)
+//!   --timeout [TEST=]SECS   kill after SECS (default: 30 on QEMU, 300 on
+//!                           hexagon-sim); repeat with TEST= per binary
+//!   --budget [TEST=]SECS    report binaries taking longer than SECS
+//!   --build-dir DIR         where the test binaries are
+//!   --cosim FILE            hexagon-sim cosim config
+//!   --junit FILE            JUnit report (default: test-results.xml in
+//!                           the build dir)
+//!   --history FILE          timing history, appended to (default:
+//!                           test-history.jsonl)
+//!   --label TEXT            recorded with the run, e.g. the QEMU build
+//!   --slower RATIO          report what got slower than RATIO times its
+//!                           last run, or changed pcycles as much
+//!                           (default: 1.2)
+//! ```
+//!
+//! The exit code is 0 when every binary passed.
+
+mod exec;
+mod parse;
+mod report;
+
+use std::collections::{HashMap, VecDeque};
+use std::env;
+use std::fs;
+use std::os::unix::fs::PermissionsExt;
+use std::path::{Path, PathBuf};
+use std::process;
+use std::sync::{mpsc, Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+use exec::{Emulator, TestResult};
+use parse::Status;
+
+const TARGET: &str = "hexagon-unknown-none-elf";
+const QEMU_TIMEOUT: u64 = 30;
+const SIM_TIMEOUT: u64 = 300;
+/// Below this, a subtest's time is mostly console latency.
+const MIN_COMPARED_SECS: f64 = 0.01;
+
+/// A default with per-test overrides, from `[TEST=]SECS` arguments.
+#[derive(Default)]
+struct PerTest {
+    default: Option<Duration>,
+    tests: HashMap<String, Duration>,
+}
+
+impl PerTest {
+    fn parse(&mut self, arg: &str) -> Result<(), String> {
+        let (test, secs) = match arg.split_once('=') {
+            Some((test, secs)) => (Some(test), secs),
+            None => (None, arg),
+        };
+        let secs: f64 = secs
+            .parse()
+            .map_err(|_| format!("invalid seconds: {}", arg))?;
+        let d = Duration::from_secs_f64(secs);
+        match test {
+            Some(test) => {
+                self.tests.insert(test.to_string(), d);
+            }
+            None => self.default = Some(d),
+        }
+        Ok(())
+    }
+
+    fn get(&self, test: &str) -> Option<Duration> {
+        self.tests.get(test).copied().or(self.default)
+    }
+}
+
+struct Config {
+    emulator: Emulator,
+    jobs: usize,
+    timeouts: PerTest,
+    budgets: PerTest,
+    build_dir: PathBuf,
+    junit: PathBuf,
+    history: PathBuf,
+    label: String,
+    slower: f64,
+    tests: Vec<String>,
+}
+
+fn usage() -> ! {
+    eprintln!(
+        "usage: arch-test-runner [--qemu] [-j N] [--timeout [TEST=]SECS] \
+         [--budget [TEST=]SECS] [--build-dir DIR] [--cosim FILE] [--junit FILE] \
+         [--history FILE] [--label TEXT] [--slower RATIO] [test_name...]"
+    );
+    process::exit(2);
+}
+
+fn parse_args() -> Config {
+    let env_or = |var: &str, default: &str| env::var(var).unwrap_or_else(|_| default.to_string());
+    let build_dir = PathBuf::from(format!("target/{}/release", TARGET));
+    let mut use_qemu = false;
+    let mut jobs = thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1);
+    let mut timeouts = PerTest::default();
+    let mut budgets = PerTest::default();
+    let mut cosim = "cosim/q6ss.cfg".to_string();
+    let mut junit = None;
+    let mut history = None;
+    let mut build_dir_arg = None;
+    let mut label = String::new();
+    let mut slower = 1.2;
+    let mut tests = Vec::new();
+
+    let mut args = env::args().skip(1);
+    while let Some(arg) = args.next() {
+        let mut value = || args.next().unwrap_or_else(|| usage());
+        let ok = match arg.as_str() {
+            "--qemu" => {
+                use_qemu = true;
+                Ok(())
+            }
+            "-j" | "--jobs" => value()
+                .parse()
+                .map(|n: usize| jobs = n.max(1))
+                .map_err(|_| arg.clone()),
+            "--timeout" => timeouts.parse(&value()),
+            "--budget" => budgets.parse(&value()),
+            "--build-dir" => {
+                build_dir_arg = Some(PathBuf::from(value()));
+                Ok(())
+            }
+            "--cosim" => {
+                cosim = value();
+                Ok(())
+            }
+            "--junit" => {
+                junit = Some(PathBuf::from(value()));
+                Ok(())
+            }
+            "--history" => {
+                history = Some(PathBuf::from(value()));
+                Ok(())
+            }
+            "--label" => {
+                label = value();
+                Ok(())
+            }
+            "--slower" => value().parse().map(|r| slower = r).map_err(|_| arg.clone()),
+            "-h" | "--help" => usage(),
+            _ if arg.starts_with('-') => usage(),
+            _ => {
+                tests.push(arg.clone());
+                Ok(())
+            }
+        };
+        if let Err(e) = ok {
+            eprintln!("invalid argument: {}", e);
+            usage();
+        }
+    }
+
+    let emulator = if use_qemu {
+        Emulator::Qemu {
+            bin: env_or("QEMU", "qemu-system-hexagon"),
+            machine: env_or("QEMU_MACHINE", "V81QA_1"),
+        }
+    } else {
+        Emulator::Sim {
+            bin: env_or("HEXAGON_SIM", "hexagon-sim"),
+            cosim,
+        }
+    };
+    if timeouts.default.is_none() {
+        let secs = if use_qemu { QEMU_TIMEOUT } else { SIM_TIMEOUT };
+        timeouts.default = Some(Duration::from_secs(secs));
+    }
+
+    let build_dir = build_dir_arg.unwrap_or(build_dir);
+    Config {
+        emulator,
+        jobs,
+        timeouts,
+        budgets,
+        junit: junit.unwrap_or_else(|| build_dir.join("test-results.xml")),
+        // Not in the build dir, the history outlives cargo clean
+        history: history.unwrap_or_else(|| PathBuf::from("test-history.jsonl")),
+        build_dir,
+        label,
+        slower,
+        tests,
+    }
+}
+
+/// The test_* executables of the build dir, as run_tests.sh finds them.
+fn discover(build_dir: &Path) -> Vec<String> {
+    let mut tests: Vec<String> = fs::read_dir(build_dir)
+        .map(|entries| {
+            entries
+                .filter_map(|e| e.ok())
+                .filter(|e| {
+                    e.metadata()
+                        .map(|m| m.is_file() && m.permissions().mode() & 0o111 != 0)
+                        .unwrap_or(false)
+                })
+                .filter_map(|e| e.file_name().into_string().ok())
+                .filter(|name| name.starts_with("test_") && !name.contains('.'))
+                .collect()
+        })
+        .unwrap_or_default();
+    tests.sort();
+    tests
+}
+
+fn print_result(r: &TestResult) {
+    let verdict = match r.status {
+        Status::Passed => "PASS",
+        Status::Failed => "FAIL",
+        Status::Timeout => "TIMEOUT",
+        Status::Error => "ERROR",
+    };
+    println!(
+        "{:<7} {} ({:.2}s, {} subtests)",
+        verdict,
+        r.name,
+        r.duration.as_secs_f64(),
+        r.subtests.len()
+    );
+    if r.status != Status::Passed {
+        println!("--- Output: {} ---\n{}", r.name, r.output.trim_end());
+    }
+}
+
+fn run_all(cfg: &Config, tests: Vec<String>) -> Vec<TestResult> {
+    let count = tests.len();
+    let queue = Arc::new(Mutex::new(VecDeque::from(tests)));
+    let (tx, rx) = mpsc::channel();
+    thread::scope(|s| {
+        for _ in 0..cfg.jobs.min(count) {
+            let queue = Arc::clone(&queue);
+            let tx = tx.clone();
+            s.spawn(move || loop {
+                let Some(name) = queue.lock().unwrap().pop_front() else {
+                    break;
+                };
+                let binary = cfg.build_dir.join(&name);
+                let timeout = cfg.timeouts.get(&name).unwrap();
+                let result = exec::run(&cfg.emulator, &name, &binary, timeout);
+                if tx.send(result).is_err() {
+                    break;
+                }
+            });
+        }
+        drop(tx);
+        let mut results = Vec::with_capacity(count);
+        for result in rx {
+            print_result(&result);
+            results.push(result);
+        }
+        results.sort_by(|a, b| a.name.cmp(&b.name));
+        results
+    })
+}
+
+fn print_changes(title: &str, changes: &[report::Change]) {
+    if changes.is_empty() {
+        return;
+    }
+    println!("{}", title);
+    for c in changes {
+        let name = if c.subtest.is_empty() {
+            c.test.clone()
+        } else {
+            format!("{}/{}", c.test, c.subtest)
+        };
+        let label = if c.label.is_empty() {
+            String::new()
+        } else {
+            format!(" [{}]", c.label)
+        };
+        let change = match c.metric {
+            report::Metric::Duration => format!("{:.3}s -> {:.3}s", c.before, c.after),
+            report::Metric::Pcycles => format!("{} -> {} pcycles", c.before as u64, c.after as u64),
+        };
+        println!(
+            "  {}: {} ({:.2}x){}",
+            name,
+            change,
+            c.after / c.before,
+            label
+        );
+    }
+}
+
+fn main() {
+    let cfg = parse_args();
+    let tests = if cfg.tests.is_empty() {
+        discover(&cfg.build_dir)
+    } else {
+        cfg.tests.clone()
+    };
+    if tests.is_empty() {
+        eprintln!(
+            "ERROR: No test binaries found in {}",
+            cfg.build_dir.display()
+        );
+        process::exit(1);
+    }
+    let missing: Vec<&String> = tests
+        .iter()
+        .filter(|t| !cfg.build_dir.join(t).is_file())
+        .collect();
+    for t in &missing {
+        println!("SKIP: {} (binary not found)", t);
+    }
+    let tests: Vec<String> = tests
+        .iter()
+        .filter(|t| !missing.contains(t))
+        .cloned()
+        .collect();
+
+    println!(
+        "=== Running {} tests on {}, {} at a time ===",
+        tests.len(),
+        cfg.emulator.name(),
+        cfg.jobs.min(tests.len().max(1))
+    );
+    let start = Instant::now();
+    let results = run_all(&cfg, tests);
+    let wall = start.elapsed();
+
+    let timeouts = |name: &str| cfg.timeouts.get(name).unwrap();
+    if let Err(e) = report::write_junit(&cfg.junit, &results, &timeouts) {
+        eprintln!("cannot write {}: {}", cfg.junit.display(), e);
+    }
+    let run = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map(|d| d.as_secs())
+        .unwrap_or(0);
+    let records = report::records(run, &cfg.label, cfg.emulator.name(), &results);
+    let history = report::read_history(&cfg.history);
+    let slower = report::slowdowns(&history, &records, cfg.slower, MIN_COMPARED_SECS);
+    let pcycles_changed = report::pcycle_changes(&history, &records, cfg.slower);
+    if let Err(e) = report::append_history(&cfg.history, &records) {
+        eprintln!("cannot write {}: {}", cfg.history.display(), e);
+    }
+
+    let failed: Vec<&TestResult> = results
+        .iter()
+        .filter(|r| r.status != Status::Passed)
+        .collect();
+    let cpu: Duration = results.iter().map(|r| r.duration).sum();
+    println!("==============================");
+    println!(
+        "Results: {} passed, {} failed out of {} tests in {:.1}s ({:.1}s of test time)",
+        results.len() - failed.len(),
+        failed.len(),
+        results.len(),
+        wall.as_secs_f64(),
+        cpu.as_secs_f64()
+    );
+    if !failed.is_empty() {
+        println!("Failed tests:");
+        for r in &failed {
+            let subtests: Vec<&str> = r
+                .subtests
+                .iter()
+                .filter(|s| s.status != Status::Passed)
+                .map(|s| s.name.as_str())
+                .collect();
+            println!(
+                "  - {} ({}) {}",
+                r.name,
+                r.status.as_str(),
+                subtests.join(" ")
+            );
+        }
+    }
+    for r in &results {
+        if let Some(budget) = cfg.budgets.get(&r.name) {
+            if r.duration > budget {
+                println!(
+                    "Over budget: {} took {:.2}s, budget {:.2}s",
+                    r.name,
+                    r.duration.as_secs_f64(),
+                    budget.as_secs_f64()
+                );
+            }
+        }
+    }
+    print_changes(
+        &format!("Slower than their last {} run:", cfg.emulator.name()),
+        &slower,
+    );
+    print_changes(
+        &format!(
+            "Guest pcycles changed since their last {} run:",
+            cfg.emulator.name()
+        ),
+        &pcycles_changed,
+    );
+    println!(
+        "JUnit report: {}, history: {}",
+        cfg.junit.display(),
+        cfg.history.display()
+    );
+    if !failed.is_empty() {
+        process::exit(1);
+    }
+    println!("All tests PASSED");
+}
@@ -0,0 +1,258 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! Splits the console output of a test binary into the subtests reported
+//! by `run_test()`:
+//!
+//! ```text
+//!   name ... ok [pcycles=123456 host_ms=20 pcycles_per_host_s=6172800]
+//!   name ... FAIL at src/bin/test_x.rs:12: got 0x1, expected 0x2
+//! FAILED (1 errors) [pcycles=4567 host_ms=0 pcycles_per_host_s=0]
+//! ```
+//!
+//! The output is fed as it arrives, so a subtest lasts from the moment its
+//! `name ... ` prefix shows up to the moment its verdict does. The times
+//! are as seen from the host and include the emulator's console latency.
+//! The `[key=value ...]` measurements run_test() appends to the verdict are
+//! kept as they are.
+
+use std::time::{Duration, Instant};
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Status {
+    Passed,
+    Failed,
+    /// Killed after its timeout.
+    Timeout,
+    /// Did not run to the end: crashed, or never reported a verdict.
+    Error,
+}
+
+impl Status {
+    pub fn as_str(self) -> &'static str {
+        match self {
+            Status::Passed => "passed",
+            Status::Failed => "failed",
+            Status::Timeout => "timeout",
+            Status::Error => "error",
+        }
+    }
+}
+
+#[derive(Clone, Debug)]
+pub struct Subtest {
+    pub name: String,
+    pub status: Status,
+    pub duration: Duration,
+    /// Lines printed between the name and the verdict, e.g. check failures.
+    pub output: String,
+    /// The measurements after the verdict, in order.
+    pub metrics: Vec<(String, u64)>,
+}
+
+impl Subtest {
+    pub fn metric(&self, key: &str) -> Option<u64> {
+        self.metrics.iter().find(|(k, _)| k == key).map(|&(_, v)| v)
+    }
+
+    /// Guest cycles of a run, the median one in bench mode.
+    pub fn pcycles(&self) -> Option<u64> {
+        self.metric("pcycles")
+            .or_else(|| self.metric("pcycles_median"))
+    }
+}
+
+/// Splits `FAILED (1 errors) [pcycles=1 host_ms=0]` into the verdict and
+/// the measurements.
+fn split_metrics(text: &str) -> (&str, Vec<(String, u64)>) {
+    let Some(open) = text.rfind(" [") else {
+        return (text, Vec::new());
+    };
+    let Some(inner) = text[open + 2..].strip_suffix(']') else {
+        return (text, Vec::new());
+    };
+    let metrics = inner
+        .split_whitespace()
+        .filter_map(|kv| {
+            let (k, v) = kv.split_once('=')?;
+            Some((k.to_string(), v.parse().ok()?))
+        })
+        .collect();
+    (&text[..open], metrics)
+}
+
+struct Pending {
+    name: String,
+    start: Instant,
+    output: String,
+}
+
+pub struct OutputParser {
+    line: Vec<u8>,
+    /// When the `name ... ` prefix of the current line was seen.
+    prefix_seen: Option<Instant>,
+    pending: Option<Pending>,
+    subtests: Vec<Subtest>,
+}
+
+const SEPARATOR: &str = " ... ";
+
+impl OutputParser {
+    pub fn new() -> Self {
+        OutputParser {
+            line: Vec::new(),
+            prefix_seen: None,
+            pending: None,
+            subtests: Vec::new(),
+        }
+    }
+
+    /// Feed a chunk of output that arrived at `now`.
+    pub fn feed(&mut self, data: &[u8], now: Instant) {
+        for &b in data {
+            if b == b'\n' {
+                let line = String::from_utf8_lossy(&self.line).into_owned();
+                self.line.clear();
+                self.end_line(line.trim_end_matches('\r'), now);
+                self.prefix_seen = None;
+                continue;
+            }
+            self.line.push(b);
+            if self.pending.is_none()
+                && self.prefix_seen.is_none()
+                && self.line.starts_with(b"  ")
+                && self.line.ends_with(SEPARATOR.as_bytes())
+            {
+                self.prefix_seen = Some(now);
+            }
+        }
+    }
+
+    fn end_line(&mut self, line: &str, now: Instant) {
+        if self.pending.is_none() {
+            let Some(rest) = line.strip_prefix("  ") else {
+                return;
+            };
+            let Some((name, verdict)) = rest.split_once(SEPARATOR.trim_end()) else {
+                return;
+            };
+            self.pending = Some(Pending {
+                name: name.trim().to_string(),
+                start: self.prefix_seen.unwrap_or(now),
+                output: String::new(),
+            });
+            self.verdict(verdict.trim_start(), now);
+        } else {
+            self.verdict(line, now);
+        }
+    }
+
+    fn verdict(&mut self, text: &str, now: Instant) {
+        let (verdict, metrics) = split_metrics(text);
+        let status = if verdict == "ok" {
+            Status::Passed
+        } else if verdict.starts_with("FAILED") {
+            Status::Failed
+        } else {
+            if !text.is_empty() {
+                let pending = self.pending.as_mut().unwrap();
+                pending.output.push_str(text);
+                pending.output.push('\n');
+            }
+            return;
+        };
+        let pending = self.pending.take().unwrap();
+        self.subtests.push(Subtest {
+            name: pending.name,
+            status,
+            duration: now - pending.start,
+            output: pending.output,
+            metrics,
+        });
+    }
+
+    /// The subtests seen so far; one still waiting for its verdict is
+    /// reported with `unfinished`.
+    pub fn finish(mut self, now: Instant, unfinished: Status) -> Vec<Subtest> {
+        if !self.line.is_empty() {
+            let line = String::from_utf8_lossy(&self.line).into_owned();
+            self.line.clear();
+            self.end_line(&line, now);
+        }
+        if let Some(pending) = self.pending.take() {
+            self.subtests.push(Subtest {
+                name: pending.name,
+                status: unfinished,
+                duration: now - pending.start,
+                output: pending.output,
+                metrics: Vec::new(),
+            });
+        }
+        self.subtests
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn parse(chunks: &[&str], unfinished: Status) -> Vec<Subtest> {
+        let t0 = Instant::now();
+        let mut parser = OutputParser::new();
+        for (i, chunk) in chunks.iter().enumerate() {
+            parser.feed(chunk.as_bytes(), t0 + Duration::from_millis(10 * i as u64));
+        }
+        parser.finish(
+            t0 + Duration::from_millis(10 * chunks.len() as u64),
+            unfinished,
+        )
+    }
+
+    #[test]
+    fn verdicts_and_durations() {
+        let subtests = parse(
+            &[
+                "=== Test Suite: PMU ===\n  pcycle_hilo ... ",
+                "ok [pcycles=1200 host_ms=10 pcycles_per_host_s=120000]\n  upcycle ... \
+                 FAIL at src/bin/test_pmu.rs:60: got 0x0",
+                "\nFAILED (1 errors) [pcycles=300 host_ms=0 pcycles_per_host_s=0]\n\
+                 FAIL (1 errors)\n",
+            ],
+            Status::Error,
+        );
+        assert_eq!(subtests.len(), 2);
+        assert_eq!(subtests[0].name, "pcycle_hilo");
+        assert_eq!(subtests[0].status, Status::Passed);
+        assert_eq!(subtests[0].duration, Duration::from_millis(10));
+        assert_eq!(subtests[0].pcycles(), Some(1200));
+        assert_eq!(subtests[0].metric("host_ms"), Some(10));
+        assert_eq!(subtests[1].name, "upcycle");
+        assert_eq!(subtests[1].status, Status::Failed);
+        assert_eq!(subtests[1].duration, Duration::from_millis(10));
+        assert_eq!(subtests[1].pcycles(), Some(300));
+        assert!(subtests[1]
+            .output
+            .starts_with("FAIL at src/bin/test_pmu.rs:60"));
+    }
+
+    #[test]
+    fn bench_metrics() {
+        let subtests = parse(
+            &[
+                "  isr ... ok [runs=10 pcycles_min=90 pcycles_median=100 host_ms_min=0 \
+               host_ms_median=10 pcycles_per_host_s=10000]\n",
+            ],
+            Status::Error,
+        );
+        assert_eq!(subtests[0].status, Status::Passed);
+        assert_eq!(subtests[0].pcycles(), Some(100));
+        assert_eq!(subtests[0].metric("runs"), Some(10));
+    }
+
+    #[test]
+    fn unfinished_subtest() {
+        let subtests = parse(&["  hangs ... "], Status::Timeout);
+        assert_eq!(subtests.len(), 1);
+        assert_eq!(subtests[0].status, Status::Timeout);
+    }
+}
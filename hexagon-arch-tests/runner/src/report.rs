@@ -0,0 +1,486 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! JUnit XML report and JSON timing history.
+//!
+//! The history is JSON Lines, one flat record per subtest and run, appended
+//! to after every run:
+//!
+//! ```text
+//! {"run": 1791234567, "label": "qemu-9.2", "emulator": "qemu", "test": "test_pmu",
+//!  "subtest": "upcycle", "status": "passed", "duration": 0.0123, "pcycles": 48211}
+//! ```
+//!
+//! The record with an empty `subtest` is the whole binary. `label` is free
+//! text given with `--label`, e.g. the QEMU build being tested. `pcycles` is
+//! what run_test() measured in the guest, 0 when it reported nothing (and
+//! for the whole-binary record).
+
+use std::collections::HashMap;
+use std::fmt::Write as _;
+use std::fs::{self, OpenOptions};
+use std::io::{self, Write};
+use std::path::Path;
+use std::time::Duration;
+
+use crate::exec::TestResult;
+use crate::parse::Status;
+
+// ---------------------------------------------------------------------------
+// JUnit XML
+// ---------------------------------------------------------------------------
+
+fn xml_escape(s: &str) -> String {
+    let mut out = String::with_capacity(s.len());
+    for c in s.chars() {
+        match c {
+            '&' => out.push_str("&amp;"),
+            '<' => out.push_str("&lt;"),
+            '>' => out.push_str("&gt;"),
+            '"' => out.push_str("&quot;"),
+            '\'' => out.push_str("&apos;"),
+            '\n' | '\t' => out.push(c),
+            c if (c as u32) < 0x20 => {}
+            c => out.push(c),
+        }
+    }
+    out
+}
+
+fn secs(d: Duration) -> String {
+    format!("{:.3}", d.as_secs_f64())
+}
+
+fn testcase(out: &mut String, class: &str, name: &str, status: Status, d: Duration, text: &str) {
+    let _ = write!(
+        out,
+        "    <testcase classname=\"{}\" name=\"{}\" time=\"{}\"",
+        xml_escape(class),
+        xml_escape(name),
+        secs(d)
+    );
+    let tag = match status {
+        Status::Passed => {
+            out.push_str("/>\n");
+            return;
+        }
+        Status::Failed => "failure",
+        Status::Timeout | Status::Error => "error",
+    };
+    let _ = write!(
+        out,
+        ">\n      <{} message=\"{}\">{}</{}>\n    </testcase>\n",
+        tag,
+        status.as_str(),
+        xml_escape(text),
+        tag
+    );
+}
+
+fn exit_message(r: &TestResult, timeout: Duration) -> String {
+    match (r.status, r.exit_code) {
+        (Status::Timeout, _) => format!("timed out after {}s", timeout.as_secs()),
+        (_, Some(code)) => format!("exit code {}", code),
+        (_, None) => "killed by a signal".to_string(),
+    }
+}
+
+/// Writes the JUnit report: a testsuite per binary, a testcase per subtest.
+/// A binary that fails without a failed subtest to show for it gets a
+/// testcase of its own name.
+pub fn write_junit(
+    path: &Path,
+    results: &[TestResult],
+    timeouts: &dyn Fn(&str) -> Duration,
+) -> io::Result<()> {
+    let mut out = String::from("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    let count =
+        |r: &TestResult, s: &[Status]| r.subtests.iter().filter(|t| s.contains(&t.status)).count();
+    let total: Duration = results.iter().map(|r| r.duration).sum();
+    let _ = writeln!(
+        out,
+        "<testsuites name=\"hexagon-arch-tests\" time=\"{}\">",
+        secs(total)
+    );
+    for r in results {
+        let unexplained =
+            r.status != Status::Passed && r.subtests.iter().all(|s| s.status == Status::Passed);
+        let tests = r.subtests.len() + unexplained as usize;
+        let failures = count(r, &[Status::Failed]);
+        let errors = count(r, &[Status::Timeout, Status::Error]) + unexplained as usize;
+        let _ = writeln!(
+            out,
+            "  <testsuite name=\"{}\" tests=\"{}\" failures=\"{}\" errors=\"{}\" time=\"{}\">",
+            xml_escape(&r.name),
+            tests,
+            failures,
+            errors,
+            secs(r.duration)
+        );
+        for s in &r.subtests {
+            testcase(&mut out, &r.name, &s.name, s.status, s.duration, &s.output);
+        }
+        if unexplained {
+            let text = format!("{}\n{}", exit_message(r, timeouts(&r.name)), r.output);
+            testcase(&mut out, &r.name, &r.name, Status::Error, r.duration, &text);
+        }
+        let _ = writeln!(
+            out,
+            "    <system-out>{}</system-out>",
+            xml_escape(&r.output)
+        );
+        out.push_str("  </testsuite>\n");
+    }
+    out.push_str("</testsuites>\n");
+    fs::write(path, out)
+}
+
+// ---------------------------------------------------------------------------
+// Timing history
+// ---------------------------------------------------------------------------
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct Record {
+    pub run: u64,
+    pub label: String,
+    pub emulator: String,
+    pub test: String,
+    pub subtest: String,
+    pub status: String,
+    pub duration: f64,
+    pub pcycles: u64,
+}
+
+fn json_string(s: &str) -> String {
+    let mut out = String::from("\"");
+    for c in s.chars() {
+        match c {
+            '"' => out.push_str("\\\""),
+            '\\' => out.push_str("\\\\"),
+            '\n' => out.push_str("\\n"),
+            c if (c as u32) < 0x20 => {
+                let _ = write!(out, "\\u{:04x}", c as u32);
+            }
+            c => out.push(c),
+        }
+    }
+    out.push('"');
+    out
+}
+
+impl Record {
+    fn to_json(&self) -> String {
+        format!(
+            "{{\"run\": {}, \"label\": {}, \"emulator\": {}, \"test\": {}, \
+             \"subtest\": {}, \"status\": {}, \"duration\": {:.4}, \"pcycles\": {}}}",
+            self.run,
+            json_string(&self.label),
+            json_string(&self.emulator),
+            json_string(&self.test),
+            json_string(&self.subtest),
+            json_string(&self.status),
+            self.duration,
+            self.pcycles
+        )
+    }
+
+    /// Parses one history line. Only the flat objects written by to_json()
+    /// are understood; anything else is None.
+    fn from_json(line: &str) -> Option<Record> {
+        let body = line.trim().strip_prefix('{')?.strip_suffix('}')?;
+        let mut fields = HashMap::new();
+        let mut rest = body.trim_start();
+        while !rest.is_empty() {
+            let (key, after) = parse_string(rest)?;
+            rest = after.trim_start().strip_prefix(':')?.trim_start();
+            let value;
+            if rest.starts_with('"') {
+                let (s, after) = parse_string(rest)?;
+                value = s;
+                rest = after;
+            } else {
+                let end = rest
+                    .find(|c: char| c == ',' || c.is_whitespace())
+                    .unwrap_or(rest.len());
+                value = rest[..end].to_string();
+                rest = &rest[end..];
+            }
+            fields.insert(key, value);
+            rest = rest.trim_start();
+            rest = rest.strip_prefix(',').unwrap_or(rest).trim_start();
+        }
+        Some(Record {
+            run: fields.get("run")?.parse().ok()?,
+            label: fields.remove("label")?,
+            emulator: fields.remove("emulator")?,
+            test: fields.remove("test")?,
+            subtest: fields.remove("subtest")?,
+            status: fields.remove("status")?,
+            duration: fields.get("duration")?.parse().ok()?,
+            // Not in histories written before run_test() measured cycles
+            pcycles: match fields.get("pcycles") {
+                Some(v) => v.parse().ok()?,
+                None => 0,
+            },
+        })
+    }
+}
+
+/// A JSON string at the start of `s`, and what follows it.
+fn parse_string(s: &str) -> Option<(String, &str)> {
+    let mut chars = s.strip_prefix('"')?.char_indices();
+    let mut out = String::new();
+    while let Some((i, c)) = chars.next() {
+        match c {
+            '"' => return Some((out, &s[i + 2..])),
+            '\\' => match chars.next()?.1 {
+                'n' => out.push('\n'),
+                'u' => {
+                    let hex: String = (0..4)
+                        .filter_map(|_| chars.next().map(|(_, c)| c))
+                        .collect();
+                    out.push(char::from_u32(u32::from_str_radix(&hex, 16).ok()?)?);
+                }
+                c => out.push(c),
+            },
+            c => out.push(c),
+        }
+    }
+    None
+}
+
+/// The history records of a run.
+pub fn records(run: u64, label: &str, emulator: &str, results: &[TestResult]) -> Vec<Record> {
+    let mut out = Vec::new();
+    for r in results {
+        let record = |subtest: &str, status: Status, d: Duration, pcycles: u64| Record {
+            run,
+            label: label.to_string(),
+            emulator: emulator.to_string(),
+            test: r.name.clone(),
+            subtest: subtest.to_string(),
+            status: status.as_str().to_string(),
+            duration: d.as_secs_f64(),
+            pcycles,
+        };
+        out.push(record("", r.status, r.duration, 0));
+        for s in &r.subtests {
+            let pcycles = s.pcycles().unwrap_or(0);
+            out.push(record(&s.name, s.status, s.duration, pcycles));
+        }
+    }
+    out
+}
+
+pub fn read_history(path: &Path) -> Vec<Record> {
+    match fs::read_to_string(path) {
+        Ok(text) => text.lines().filter_map(Record::from_json).collect(),
+        Err(_) => Vec::new(),
+    }
+}
+
+pub fn append_history(path: &Path, records: &[Record]) -> io::Result<()> {
+    let mut f = OpenOptions::new().create(true).append(true).open(path)?;
+    let mut text = String::new();
+    for r in records {
+        text.push_str(&r.to_json());
+        text.push('\n');
+    }
+    f.write_all(text.as_bytes())
+}
+
+/// What a change was measured in.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Metric {
+    /// Host time of the test, in seconds.
+    Duration,
+    /// Guest pcycles, as run_test() reported them.
+    Pcycles,
+}
+
+/// A test or subtest that measured differently than in the last run that
+/// had it.
+pub struct Change {
+    pub test: String,
+    pub subtest: String,
+    pub metric: Metric,
+    pub before: f64,
+    pub after: f64,
+    pub label: String,
+}
+
+/// The latest passing record of each test and subtest on `emulator`,
+/// which need not be from the same run for all of them.
+fn last_passed<'a>(
+    history: &'a [Record],
+    emulator: &str,
+) -> HashMap<(&'a str, &'a str), &'a Record> {
+    let mut last: HashMap<(&str, &str), &Record> = HashMap::new();
+    for r in history
+        .iter()
+        .filter(|r| r.emulator == emulator && r.status == "passed")
+    {
+        let entry = last
+            .entry((r.test.as_str(), r.subtest.as_str()))
+            .or_insert(r);
+        if r.run >= entry.run {
+            *entry = r;
+        }
+    }
+    last
+}
+
+/// Pairs the passing records of `current` with their last_passed() record
+/// and keeps the changes `change` finds.
+fn changes(
+    history: &[Record],
+    current: &[Record],
+    change: impl Fn(&Record, &Record) -> Option<(Metric, f64, f64)>,
+) -> Vec<Change> {
+    let Some(emulator) = current.first().map(|r| r.emulator.as_str()) else {
+        return Vec::new();
+    };
+    let before = last_passed(history, emulator);
+    let mut out: Vec<Change> = current
+        .iter()
+        .filter(|r| r.status == "passed")
+        .filter_map(|r| {
+            let b = before.get(&(r.test.as_str(), r.subtest.as_str()))?;
+            let (metric, before, after) = change(b, r)?;
+            Some(Change {
+                test: r.test.clone(),
+                subtest: r.subtest.clone(),
+                metric,
+                before,
+                after,
+                label: b.label.clone(),
+            })
+        })
+        .collect();
+    out.sort_by(|a, b| (b.after / b.before).total_cmp(&(a.after / a.before)));
+    out
+}
+
+/// The passing tests and subtests of `current` whose host time grew past
+/// `ratio` times their last_passed() record: the emulator got slower at
+/// them. Anything faster than `min_secs` in both is ignored, that's below
+/// what the console timing can resolve.
+pub fn slowdowns(history: &[Record], current: &[Record], ratio: f64, min_secs: f64) -> Vec<Change> {
+    changes(history, current, |b, r| {
+        (r.duration.max(b.duration) >= min_secs && r.duration > b.duration * ratio).then_some((
+            Metric::Duration,
+            b.duration,
+            r.duration,
+        ))
+    })
+}
+
+/// The passing tests and subtests of `current` whose guest pcycles moved
+/// past `ratio` times, either way, from their last_passed() record. That
+/// is a change in what the guest sees, not in the emulator's speed: a
+/// slower build runs the same pcycles in more host time.
+pub fn pcycle_changes(history: &[Record], current: &[Record], ratio: f64) -> Vec<Change> {
+    changes(history, current, |b, r| {
+        let (before, after) = (b.pcycles as f64, r.pcycles as f64);
+        (before != 0.0 && after != 0.0 && (after > before * ratio || before > after * ratio))
+            .then_some((Metric::Pcycles, before, after))
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn history_round_trip() {
+        let record = Record {
+            run: 1791234567,
+            label: "qemu \"9.2\"\\rc1".to_string(),
+            emulator: "qemu".to_string(),
+            test: "test_pmu".to_string(),
+            subtest: "upcycle".to_string(),
+            status: "passed".to_string(),
+            duration: 0.0123,
+            pcycles: 48211,
+        };
+        assert_eq!(Record::from_json(&record.to_json()), Some(record.clone()));
+        let old = "{\"run\": 1791234567, \"label\": \"qemu \\\"9.2\\\"\\\\rc1\", \
+                   \"emulator\": \"qemu\", \"test\": \"test_pmu\", \"subtest\": \"upcycle\", \
+                   \"status\": \"passed\", \"duration\": 0.0123}";
+        assert_eq!(
+            Record::from_json(old),
+            Some(Record {
+                pcycles: 0,
+                ..record
+            })
+        );
+        assert_eq!(Record::from_json("not json"), None);
+    }
+
+    fn record(run: u64, test: &str, duration: f64, pcycles: u64) -> Record {
+        Record {
+            run,
+            label: format!("run {}", run),
+            emulator: "qemu".to_string(),
+            test: test.to_string(),
+            subtest: String::new(),
+            status: "passed".to_string(),
+            duration,
+            pcycles,
+        }
+    }
+
+    #[test]
+    fn slowdowns_against_last_run_with_the_test() {
+        let history = vec![
+            record(1, "a", 1.0, 0),
+            record(1, "b", 1.0, 0),
+            record(2, "a", 2.0, 0),
+            // Only "a" ran last time, "b" is compared with run 1
+            record(3, "a", 4.0, 0),
+            Record {
+                status: "failed".to_string(),
+                ..record(3, "b", 9.0, 0)
+            },
+        ];
+        let current = vec![record(4, "a", 4.0, 0), record(4, "b", 1.5, 0)];
+        let slower = slowdowns(&history, &current, 1.2, 0.01);
+        assert_eq!(slower.len(), 1);
+        assert_eq!(slower[0].test, "b");
+        assert_eq!(slower[0].metric, Metric::Duration);
+        assert_eq!((slower[0].before, slower[0].after), (1.0, 1.5));
+        assert_eq!(slower[0].label, "run 1");
+    }
+
+    #[test]
+    fn slowdowns_by_host_time_pcycle_changes_apart() {
+        let history = vec![
+            record(1, "a", 1.0, 1000),
+            record(1, "b", 1.0, 1000),
+            record(1, "c", 1.0, 1000),
+        ];
+        let current = vec![
+            // A slower build: same guest cycles, twice the host time
+            record(2, "a", 2.0, 1000),
+            // The guest runs differently, in the same host time
+            record(2, "b", 1.0, 1500),
+            record(2, "c", 1.0, 500),
+        ];
+        let slower = slowdowns(&history, &current, 1.2, 0.01);
+        assert_eq!(slower.len(), 1);
+        assert_eq!(slower[0].test, "a");
+        assert_eq!(slower[0].metric, Metric::Duration);
+        assert_eq!((slower[0].before, slower[0].after), (1.0, 2.0));
+
+        let changed = pcycle_changes(&history, &current, 1.2);
+        let changed: Vec<(&str, f64, f64)> = changed
+            .iter()
+            .map(|c| (c.test.as_str(), c.before, c.after))
+            .collect();
+        assert_eq!(changed, [("b", 1000.0, 1500.0), ("c", 1000.0, 500.0)]);
+
+        // Nothing to compare without pcycles on both sides
+        assert!(pcycle_changes(&history, &[record(2, "b", 1.0, 0)], 1.2).is_empty());
+        assert!(slowdowns(&history, &[record(2, "a", 0.005, 0)], 1.2, 0.01).is_empty());
+    }
+}
@@ -0,0 +1,371 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! Cache maintenance throughput benchmark for Hexagon v81.
+//!
+//! An emulator has no caches to maintain, so every one of these ops should
+//! cost about the same whatever the guest has been doing.  The benchmark
+//! measures ops/s and flags the ones that don't:
+//!
+//! - dczeroa, dccleana, dcinva, dccleaninva: a pass over a buffer at a
+//!   stride, for each buffer size and stride.  The host time per op should
+//!   not grow with the buffer size.
+//! - dckill, ickill (with its isync), l2kill: back to back.
+//! - every op followed by touching a data or a code footprint, against the
+//!   footprint alone.  What the op adds should not grow with the footprint:
+//!   if it does, the op throws away emulator state (softmmu TLB, translated
+//!   code) for all of guest memory, and the guest pays to rebuild it.
+//!
+//! Results are lines of key=value pairs, and flagged ops a `SCALES:` line.
+//! Flags are reported, not counted as errors: the ops still work.
+//!
+//! This is not a test_* binary, so the runner only runs it when named, and
+//! it needs more than the default QEMU timeout:
+//! `./run_tests.sh --qemu --timeout bench_cache=300 bench_cache`.
+
+#![no_std]
+#![no_main]
+#![feature(asm_experimental_arch)]
+
+use core::arch::global_asm;
+use hexagon_arch_tests::*;
+
+/// L1 dcache line, as in test_cache.rs.
+const LINE: u32 = 32;
+const PAGE: u32 = 4096;
+const BUF_SIZE: usize = 1 << 20;
+
+/// Minimum host time of a reported run, in centiseconds.
+const MIN_HOST_CS: u32 = 25;
+
+/// A flagged op's cost per op is this many times larger at the largest
+/// size or footprint than at the smallest.
+const SCALE_RATIO: u64 = 2;
+
+const BUF_SIZES: [u32; 3] = [4 << 10, 64 << 10, 1 << 20];
+const STRIDES: [u32; 3] = [LINE, 256, PAGE];
+
+#[repr(C, align(4096))]
+struct Buf([u8; BUF_SIZE]);
+
+static mut BUF: Buf = Buf([0; BUF_SIZE]);
+
+fn buf_addr() -> u32 {
+    (&raw mut BUF) as u32
+}
+
+// -----------------------------------------------------------------------
+// Ops
+// -----------------------------------------------------------------------
+
+#[derive(Clone, Copy)]
+enum Op {
+    Dczeroa,
+    Dccleana,
+    Dcinva,
+    Dccleaninva,
+    Dckill,
+    Ickill,
+    L2kill,
+}
+
+const LINE_OPS: [Op; 4] = [Op::Dczeroa, Op::Dccleana, Op::Dcinva, Op::Dccleaninva];
+const GLOBAL_OPS: [Op; 3] = [Op::Dckill, Op::Ickill, Op::L2kill];
+
+impl Op {
+    fn name(self) -> &'static str {
+        match self {
+            Op::Dczeroa => "dczeroa",
+            Op::Dccleana => "dccleana",
+            Op::Dcinva => "dcinva",
+            Op::Dccleaninva => "dccleaninva",
+            Op::Dckill => "dckill",
+            Op::Ickill => "ickill",
+            Op::L2kill => "l2kill",
+        }
+    }
+
+    /// One op; a line op on the line at `addr`.
+    #[inline(always)]
+    fn issue(self, addr: u32) {
+        match self {
+            Op::Dczeroa => dczeroa(addr),
+            Op::Dccleana => dccleana(addr),
+            Op::Dcinva => dcinva(addr),
+            Op::Dccleaninva => dccleaninva(addr),
+            Op::Dckill => dckill(),
+            Op::Ickill => {
+                ickill();
+                isync();
+            }
+            Op::L2kill => l2kill(),
+        }
+    }
+}
+
+/// `passes` passes of a line op over `size` bytes of BUF at `stride`.
+/// Monomorphized per op so the loop is just the op.
+#[inline(always)]
+fn sweep(op: impl Fn(u32), passes: u32, size: u32, stride: u32) {
+    let base = buf_addr();
+    for _ in 0..passes {
+        let mut addr = base;
+        while addr < base + size {
+            op(addr);
+            addr += stride;
+        }
+    }
+    syncht();
+}
+
+fn sweep_op(op: Op, passes: u32, size: u32, stride: u32) {
+    match op {
+        Op::Dczeroa => sweep(dczeroa, passes, size, stride),
+        Op::Dccleana => sweep(dccleana, passes, size, stride),
+        Op::Dcinva => sweep(dcinva, passes, size, stride),
+        Op::Dccleaninva => sweep(dccleaninva, passes, size, stride),
+        _ => unreachable!(),
+    }
+}
+
+// -----------------------------------------------------------------------
+// Footprints
+// -----------------------------------------------------------------------
+
+// Straight-line code to execute a tail of: SLED_INSNS packets of one nop,
+// then a return.
+const SLED_INSNS: u32 = 16384;
+
+global_asm!(
+    ".section .text.bench_cache_sled, \"ax\", @progbits",
+    ".p2align 5",
+    ".globl bench_cache_sled",
+    "bench_cache_sled:",
+    ".rept {insns}",
+    "nop",
+    ".endr",
+    "jumpr r31",
+    ".previous",
+    insns = const SLED_INSNS,
+);
+
+extern "C" {
+    static bench_cache_sled: u8;
+}
+
+#[derive(Clone, Copy)]
+enum Footprint {
+    /// Read a word of each page of `bytes` of BUF.
+    Data,
+    /// Run the last `bytes` of the sled.
+    Code,
+}
+
+const DATA_FOOTPRINTS: [u32; 2] = [4 * PAGE, BUF_SIZE as u32];
+const CODE_FOOTPRINTS: [u32; 2] = [4 << 10, SLED_INSNS * 4];
+
+impl Footprint {
+    fn name(self) -> &'static str {
+        match self {
+            Footprint::Data => "data",
+            Footprint::Code => "code",
+        }
+    }
+
+    fn sizes(self) -> [u32; 2] {
+        match self {
+            Footprint::Data => DATA_FOOTPRINTS,
+            Footprint::Code => CODE_FOOTPRINTS,
+        }
+    }
+
+    fn touch(self, bytes: u32) {
+        match self {
+            Footprint::Data => {
+                let base = buf_addr();
+                for page in (0..bytes).step_by(PAGE as usize) {
+                    unsafe { read_volatile_u32((base + page) as *const u32) };
+                }
+            }
+            Footprint::Code => unsafe {
+                let end = (&raw const bench_cache_sled) as u32 + SLED_INSNS * 4;
+                let entry: extern "C" fn() = core::mem::transmute((end - bytes) as usize);
+                entry();
+            },
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Reporting
+// -----------------------------------------------------------------------
+
+/// The rest of a result line, after what was measured.
+fn report(run: &BenchRun, ops: u64) {
+    println!(
+        "ops={} pcycles={} host_ms={} ops_per_s={} host_ns_per_op={} pcycles_per_op={}",
+        ops,
+        run.pcycles,
+        run.host_ms(),
+        run.per_s(ops),
+        run.ns_per(ops),
+        if ops == 0 { 0 } else { run.pcycles / ops }
+    );
+}
+
+/// Two ticks of the host clock spread over `count` ops: differences below
+/// that are noise.
+fn noise_ns(count: u64) -> u64 {
+    2 * 10_000_000 / count.max(1)
+}
+
+fn scales(small_ns: u64, large_ns: u64, noise: u64) -> bool {
+    large_ns > small_ns * SCALE_RATIO && large_ns - small_ns > noise
+}
+
+// -----------------------------------------------------------------------
+// Benchmarks
+// -----------------------------------------------------------------------
+
+/// Every buffer size at every stride; flags a stride at which the time per
+/// op grows with the buffer size.
+fn bench_line_op(op: Op) {
+    for &stride in STRIDES.iter() {
+        let mut ns = [0u64; BUF_SIZES.len()];
+        let mut noise = 0;
+        for (i, &size) in BUF_SIZES.iter().enumerate() {
+            let run = bench_calibrate(&|passes| sweep_op(op, passes, size, stride), MIN_HOST_CS);
+            let ops = run.iters as u64 * (size / stride) as u64;
+            ns[i] = run.ns_per(ops);
+            noise = noise_ns(ops);
+            print!("op={} size={} stride={} ", op.name(), size, stride);
+            report(&run, ops);
+        }
+        let (small, large) = (ns[0], ns[BUF_SIZES.len() - 1]);
+        if scales(small, large, noise) {
+            println!(
+                "SCALES: {} stride={}: {} ns/op over {} bytes, {} ns/op over {} bytes",
+                op.name(),
+                stride,
+                small,
+                BUF_SIZES[0],
+                large,
+                BUF_SIZES[BUF_SIZES.len() - 1]
+            );
+        }
+    }
+}
+
+fn bench_dczeroa() {
+    bench_line_op(Op::Dczeroa);
+}
+
+fn bench_dccleana() {
+    bench_line_op(Op::Dccleana);
+}
+
+fn bench_dcinva() {
+    bench_line_op(Op::Dcinva);
+}
+
+fn bench_dccleaninva() {
+    bench_line_op(Op::Dccleaninva);
+}
+
+fn bench_global_ops() {
+    for &op in GLOBAL_OPS.iter() {
+        let run = bench_calibrate(
+            &|iters| {
+                for _ in 0..iters {
+                    op.issue(0);
+                }
+            },
+            MIN_HOST_CS,
+        );
+        print!("op={} ", op.name());
+        report(&run, run.iters as u64);
+    }
+}
+
+/// What each op adds to touching `footprint` right after it, at the small
+/// and the large footprint size; flags the ops whose cost grows with it.
+/// Line ops work on the first line of BUF, inside the data footprint.
+fn bench_after(footprint: Footprint) {
+    let sizes = footprint.sizes();
+    for &op in LINE_OPS.iter().chain(GLOBAL_OPS.iter()) {
+        let mut added = [0u64; 2];
+        let mut noise = 0;
+        for (i, &bytes) in sizes.iter().enumerate() {
+            let with_op = bench_calibrate(
+                &|iters| {
+                    for _ in 0..iters {
+                        op.issue(buf_addr());
+                        footprint.touch(bytes);
+                    }
+                },
+                MIN_HOST_CS,
+            );
+            let alone = bench_measure(
+                &|iters| {
+                    for _ in 0..iters {
+                        footprint.touch(bytes);
+                    }
+                },
+                with_op.iters,
+            );
+            let iters = with_op.iters as u64;
+            added[i] = with_op.ns_per(iters).saturating_sub(alone.ns_per(iters));
+            noise = noise_ns(iters);
+            println!(
+                "op={} after={} footprint={} iters={} host_ms={} alone_host_ms={} \
+                 added_host_ns_per_op={} added_pcycles_per_op={}",
+                op.name(),
+                footprint.name(),
+                bytes,
+                iters,
+                with_op.host_ms(),
+                alone.host_ms(),
+                added[i],
+                with_op.pcycles.saturating_sub(alone.pcycles) / iters
+            );
+        }
+        if scales(added[0], added[1], noise) {
+            println!(
+                "SCALES: {} after {}: adds {} ns over {} bytes, {} ns over {} bytes",
+                op.name(),
+                footprint.name(),
+                added[0],
+                sizes[0],
+                added[1],
+                sizes[1]
+            );
+        }
+    }
+}
+
+fn bench_after_data() {
+    bench_after(Footprint::Data);
+}
+
+fn bench_after_code() {
+    bench_after(Footprint::Code);
+}
+
+// -----------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------
+
+#[no_mangle]
+pub extern "C" fn rust_main() -> i32 {
+    test_suite_begin("Cache Maintenance Benchmark");
+
+    run_test("dczeroa", bench_dczeroa);
+    run_test("dccleana", bench_dccleana);
+    run_test("dcinva", bench_dcinva);
+    run_test("dccleaninva", bench_dccleaninva);
+    run_test("global_ops", bench_global_ops);
+    run_test("after_data", bench_after_data);
+    run_test("after_code", bench_after_code);
+
+    test_suite_end() as i32
+}
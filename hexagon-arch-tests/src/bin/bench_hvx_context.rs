@@ -0,0 +1,619 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! HVX context switch cost benchmark for Hexagon v81.
+//!
+//! Measures what a guest OS pays for switching HVX threads by SSR.XA with
+//! live vector state: all 32 V registers and the 4 Q registers of every
+//! software thread are distinct, and are checked at the end of each run.
+//!
+//!   xa_select          select each context in turn and touch its register
+//!                      file; no state is moved
+//!   save_restore_1ctx  save the outgoing thread's V0-V31 and Q0-Q3 with
+//!                      vmem and restore the incoming one's, all on context
+//!                      0, as when there are more HVX threads than contexts
+//!   save_restore_xa    the same with each thread on a context of its own,
+//!                      switching SSR.XA between the save and the restore
+//!   threads_contend    every hardware thread runs an HVX thread on fewer
+//!                      contexts than threads: take a free context, restore,
+//!                      increment V0, save, release
+//!
+//! Each kernel is run with a growing switch count until one run takes
+//! MIN_HOST_CS of host time, and that run is reported as
+//!
+//! ```text
+//!   switches=N bytes=N pcycles=N host_ms=N switches_per_s=N bytes_per_s=N
+//! ```
+//!
+//! `bytes` is the vector state moved by vmem, both directions, a Q register
+//! going through memory as a whole vector.
+//!
+//! This is not a test_* binary, so the runner only runs it when named:
+//! `./run_tests.sh --qemu bench_hvx_context`.
+
+#![no_std]
+#![no_main]
+#![feature(asm_experimental_arch)]
+
+use core::arch::asm;
+use core::sync::atomic::{AtomicU32, Ordering};
+use hexagon_arch_tests::*;
+
+const MAX_THREADS: u32 = 8;
+/// SSR.XA is three bits.
+const MAX_CONTEXTS: u32 = 8;
+const VREGS: usize = 32;
+const QREGS: usize = 4;
+const VEC_WORDS: usize = 32;
+const STATE_WORDS: usize = (VREGS + QREGS) * VEC_WORDS;
+/// Saving one state and restoring another.
+const SWITCH_BYTES: u64 = 2 * (STATE_WORDS as u64) * 4;
+/// vand() mask moving a Q register to and from a vector: a byte of 1 for
+/// each predicate bit that is set.
+const Q_BYTES: u32 = 0x0101_0101;
+
+/// Minimum host time of a reported run, in centiseconds.
+const MIN_HOST_CS: u32 = 100;
+
+/// Saved V0-V31, then Q0-Q3 as vectors.
+#[repr(C, align(128))]
+#[derive(Clone, Copy)]
+struct HvxState([u32; STATE_WORDS]);
+
+/// One per software thread.  A state is only touched by the hardware
+/// thread running that software thread.
+static mut STATES: [HvxState; MAX_THREADS as usize] =
+    [HvxState([0; STATE_WORDS]); MAX_THREADS as usize];
+
+fn state_ptr(s: u32) -> *mut u32 {
+    unsafe { ((&raw mut STATES) as *mut HvxState).add(s as usize) as *mut u32 }
+}
+
+/// Where Q0-Q3 are saved.
+fn q_ptr(s: u32) -> *mut u32 {
+    unsafe { state_ptr(s).add(VREGS * VEC_WORDS) }
+}
+
+// -----------------------------------------------------------------------
+// Register file access through inline asm
+// -----------------------------------------------------------------------
+//
+// As in test_hvx_context.rs, context selection, vector register access and
+// disabling HVX again are one asm block, so the compiler never holds a
+// vector of its own in the register files being switched.
+
+/// Store V0-V31 at {sp}, then Q0-Q3 at {sq} through V0.
+macro_rules! save_state {
+    () => {
+        concat!(
+            "vmem({sp}++#1) = v0\n",
+            "vmem({sp}++#1) = v1\n",
+            "vmem({sp}++#1) = v2\n",
+            "vmem({sp}++#1) = v3\n",
+            "vmem({sp}++#1) = v4\n",
+            "vmem({sp}++#1) = v5\n",
+            "vmem({sp}++#1) = v6\n",
+            "vmem({sp}++#1) = v7\n",
+            "vmem({sp}++#1) = v8\n",
+            "vmem({sp}++#1) = v9\n",
+            "vmem({sp}++#1) = v10\n",
+            "vmem({sp}++#1) = v11\n",
+            "vmem({sp}++#1) = v12\n",
+            "vmem({sp}++#1) = v13\n",
+            "vmem({sp}++#1) = v14\n",
+            "vmem({sp}++#1) = v15\n",
+            "vmem({sp}++#1) = v16\n",
+            "vmem({sp}++#1) = v17\n",
+            "vmem({sp}++#1) = v18\n",
+            "vmem({sp}++#1) = v19\n",
+            "vmem({sp}++#1) = v20\n",
+            "vmem({sp}++#1) = v21\n",
+            "vmem({sp}++#1) = v22\n",
+            "vmem({sp}++#1) = v23\n",
+            "vmem({sp}++#1) = v24\n",
+            "vmem({sp}++#1) = v25\n",
+            "vmem({sp}++#1) = v26\n",
+            "vmem({sp}++#1) = v27\n",
+            "vmem({sp}++#1) = v28\n",
+            "vmem({sp}++#1) = v29\n",
+            "vmem({sp}++#1) = v30\n",
+            "vmem({sp}++#1) = v31\n",
+            "v0 = vand(q0, {qbytes})\n",
+            "vmem({sq}+#0) = v0\n",
+            "v0 = vand(q1, {qbytes})\n",
+            "vmem({sq}+#1) = v0\n",
+            "v0 = vand(q2, {qbytes})\n",
+            "vmem({sq}+#2) = v0\n",
+            "v0 = vand(q3, {qbytes})\n",
+            "vmem({sq}+#3) = v0\n",
+        )
+    };
+}
+
+/// Load Q0-Q3 from {rq} through V0, then V0-V31 from {rp}.
+macro_rules! restore_state {
+    () => {
+        concat!(
+            "v0 = vmem({rq}+#0)\n",
+            "q0 = vand(v0, {qbytes})\n",
+            "v0 = vmem({rq}+#1)\n",
+            "q1 = vand(v0, {qbytes})\n",
+            "v0 = vmem({rq}+#2)\n",
+            "q2 = vand(v0, {qbytes})\n",
+            "v0 = vmem({rq}+#3)\n",
+            "q3 = vand(v0, {qbytes})\n",
+            "v0 = vmem({rp}++#1)\n",
+            "v1 = vmem({rp}++#1)\n",
+            "v2 = vmem({rp}++#1)\n",
+            "v3 = vmem({rp}++#1)\n",
+            "v4 = vmem({rp}++#1)\n",
+            "v5 = vmem({rp}++#1)\n",
+            "v6 = vmem({rp}++#1)\n",
+            "v7 = vmem({rp}++#1)\n",
+            "v8 = vmem({rp}++#1)\n",
+            "v9 = vmem({rp}++#1)\n",
+            "v10 = vmem({rp}++#1)\n",
+            "v11 = vmem({rp}++#1)\n",
+            "v12 = vmem({rp}++#1)\n",
+            "v13 = vmem({rp}++#1)\n",
+            "v14 = vmem({rp}++#1)\n",
+            "v15 = vmem({rp}++#1)\n",
+            "v16 = vmem({rp}++#1)\n",
+            "v17 = vmem({rp}++#1)\n",
+            "v18 = vmem({rp}++#1)\n",
+            "v19 = vmem({rp}++#1)\n",
+            "v20 = vmem({rp}++#1)\n",
+            "v21 = vmem({rp}++#1)\n",
+            "v22 = vmem({rp}++#1)\n",
+            "v23 = vmem({rp}++#1)\n",
+            "v24 = vmem({rp}++#1)\n",
+            "v25 = vmem({rp}++#1)\n",
+            "v26 = vmem({rp}++#1)\n",
+            "v27 = vmem({rp}++#1)\n",
+            "v28 = vmem({rp}++#1)\n",
+            "v29 = vmem({rp}++#1)\n",
+            "v30 = vmem({rp}++#1)\n",
+            "v31 = vmem({rp}++#1)\n",
+        )
+    };
+}
+
+/// The work a thread does once switched in: V1 holds 1 in every lane, so
+/// V0 counts the switches.
+macro_rules! touch_state {
+    () => {
+        "v0.w = vadd(v0.w, v1.w)\n"
+    };
+}
+
+/// asm! with every V and Q register clobbered.
+macro_rules! hvx_asm {
+    ({ $($tmpl:tt)* } $($operands:tt)*) => {
+        asm!(
+            concat!($($tmpl)*),
+            $($operands)*
+            lateout("v0") _, lateout("v1") _, lateout("v2") _, lateout("v3") _,
+            lateout("v4") _, lateout("v5") _, lateout("v6") _, lateout("v7") _,
+            lateout("v8") _, lateout("v9") _, lateout("v10") _, lateout("v11") _,
+            lateout("v12") _, lateout("v13") _, lateout("v14") _, lateout("v15") _,
+            lateout("v16") _, lateout("v17") _, lateout("v18") _, lateout("v19") _,
+            lateout("v20") _, lateout("v21") _, lateout("v22") _, lateout("v23") _,
+            lateout("v24") _, lateout("v25") _, lateout("v26") _, lateout("v27") _,
+            lateout("v28") _, lateout("v29") _, lateout("v30") _, lateout("v31") _,
+            lateout("q0") _, lateout("q1") _, lateout("q2") _, lateout("q3") _,
+            options(nostack),
+        )
+    };
+}
+
+fn xa_ssr(ssr: u32, xa: u32) -> u32 {
+    (ssr & !SSR_XA_MASK) | SSR_XE | ((xa << SSR_XA_SHIFT) & SSR_XA_MASK)
+}
+
+/// Make software thread `s` the live state of context `xa`.
+fn load_state(xa: u32, s: u32) {
+    let ssr = read_ssr();
+    unsafe {
+        hvx_asm!(
+            {
+                "ssr = {sel}\n", "isync\n",
+                restore_state!(),
+                "ssr = {off}\n", "isync\n",
+            }
+            sel = in(reg) xa_ssr(ssr, xa),
+            off = in(reg) ssr & !SSR_XE,
+            rp = inout(reg) state_ptr(s) => _,
+            rq = in(reg) q_ptr(s),
+            qbytes = in(reg) Q_BYTES,
+        );
+    }
+}
+
+/// Save the live state of context `xa` as software thread `s`.
+fn store_state(xa: u32, s: u32) {
+    let ssr = read_ssr();
+    unsafe {
+        hvx_asm!(
+            {
+                "ssr = {sel}\n", "isync\n",
+                save_state!(),
+                "ssr = {off}\n", "isync\n",
+            }
+            sel = in(reg) xa_ssr(ssr, xa),
+            off = in(reg) ssr & !SSR_XE,
+            sp = inout(reg) state_ptr(s) => _,
+            sq = in(reg) q_ptr(s),
+            qbytes = in(reg) Q_BYTES,
+        );
+    }
+}
+
+/// Select context `xa` and do the work of the thread living there.
+fn select_touch(xa: u32) {
+    let ssr = read_ssr();
+    unsafe {
+        hvx_asm!(
+            {
+                "ssr = {sel}\n", "isync\n",
+                touch_state!(),
+                "ssr = {off}\n", "isync\n",
+            }
+            sel = in(reg) xa_ssr(ssr, xa),
+            off = in(reg) ssr & !SSR_XE,
+        );
+    }
+}
+
+/// Switch from software thread `from` on context `from_xa` to thread `to`
+/// on context `to_xa`, and do its work.
+fn switch_state(from_xa: u32, from: u32, to_xa: u32, to: u32) {
+    let ssr = read_ssr();
+    unsafe {
+        hvx_asm!(
+            {
+                "ssr = {sel_from}\n", "isync\n",
+                save_state!(),
+                "ssr = {sel_to}\n", "isync\n",
+                restore_state!(),
+                touch_state!(),
+                "ssr = {off}\n", "isync\n",
+            }
+            sel_from = in(reg) xa_ssr(ssr, from_xa),
+            sel_to = in(reg) xa_ssr(ssr, to_xa),
+            off = in(reg) ssr & !SSR_XE,
+            sp = inout(reg) state_ptr(from) => _,
+            sq = in(reg) q_ptr(from),
+            rp = inout(reg) state_ptr(to) => _,
+            rq = in(reg) q_ptr(to),
+            qbytes = in(reg) Q_BYTES,
+        );
+    }
+}
+
+/// Run software thread `s` for a time slice on context `xa`: restore, do
+/// its work, save.
+fn run_slice(xa: u32, s: u32) {
+    let ssr = read_ssr();
+    unsafe {
+        hvx_asm!(
+            {
+                "ssr = {sel}\n", "isync\n",
+                restore_state!(),
+                touch_state!(),
+                save_state!(),
+                "ssr = {off}\n", "isync\n",
+            }
+            sel = in(reg) xa_ssr(ssr, xa),
+            off = in(reg) ssr & !SSR_XE,
+            rp = inout(reg) state_ptr(s) => _,
+            rq = in(reg) q_ptr(s),
+            sp = inout(reg) state_ptr(s) => _,
+            sq = in(reg) q_ptr(s),
+            qbytes = in(reg) Q_BYTES,
+        );
+    }
+}
+
+// -----------------------------------------------------------------------
+// Software thread states
+// -----------------------------------------------------------------------
+
+fn v_word(s: u32, v: usize) -> u32 {
+    match v {
+        0 => 0, // switch count
+        1 => 1,
+        _ => 0xA500_0000 | (s << 16) | ((v as u32) << 8) | s,
+    }
+}
+
+/// Byte `b` of the vector Q`q` is saved through: 0 or 1.
+fn q_byte(s: u32, q: usize, b: usize) -> u32 {
+    ((b + q + s as usize) % 3 == 0) as u32
+}
+
+fn q_word(s: u32, q: usize, w: usize) -> u32 {
+    (0..4).fold(0, |acc, i| acc | q_byte(s, q, w * 4 + i) << (8 * i))
+}
+
+fn init_state(s: u32) {
+    let p = state_ptr(s);
+    for v in 0..VREGS {
+        for w in 0..VEC_WORDS {
+            unsafe { core::ptr::write_volatile(p.add(v * VEC_WORDS + w), v_word(s, v)) };
+        }
+    }
+    let q = q_ptr(s);
+    for r in 0..QREGS {
+        for w in 0..VEC_WORDS {
+            unsafe { core::ptr::write_volatile(q.add(r * VEC_WORDS + w), q_word(s, r, w)) };
+        }
+    }
+}
+
+/// Check the saved state of software thread `s`, switched in `switches`
+/// times.
+fn check_state(s: u32, switches: u32) {
+    let p = state_ptr(s);
+    for v in 0..VREGS {
+        let expected = if v == 0 { switches } else { v_word(s, v) };
+        for w in 0..VEC_WORDS {
+            let got = unsafe { core::ptr::read_volatile(p.add(v * VEC_WORDS + w)) };
+            if got != expected {
+                println!(
+                    "FAIL: thread {} v{} word {} = 0x{:08x}, expected 0x{:08x}",
+                    s, v, w, got, expected
+                );
+                record_error();
+                return;
+            }
+        }
+    }
+    let q = q_ptr(s);
+    for r in 0..QREGS {
+        for w in 0..VEC_WORDS {
+            let got = unsafe { core::ptr::read_volatile(q.add(r * VEC_WORDS + w)) };
+            if got != q_word(s, r, w) {
+                println!(
+                    "FAIL: thread {} q{} word {} = 0x{:08x}, expected 0x{:08x}",
+                    s,
+                    r,
+                    w,
+                    got,
+                    q_word(s, r, w)
+                );
+                record_error();
+                return;
+            }
+        }
+    }
+}
+
+/// Times thread `s` of `n` is switched to in `iters` round-robin switches
+/// starting with thread 0.
+fn round_robin_share(s: u32, n: u32, iters: u32) -> u32 {
+    iters / n + (s < iters % n) as u32
+}
+
+// -----------------------------------------------------------------------
+// Measurement
+// -----------------------------------------------------------------------
+
+static CONTEXTS: AtomicU32 = AtomicU32::new(1);
+static THREADS: AtomicU32 = AtomicU32::new(1);
+
+/// A kernel sets up and checks its thread states itself; that is a few
+/// switches' worth against a run of at least a second.
+fn calibrate(kernel: fn(u32)) -> BenchRun {
+    bench_calibrate(&kernel, MIN_HOST_CS)
+}
+
+fn report(run: &BenchRun, switches: u64, bytes: u64) {
+    println!(
+        "switches={} bytes={} pcycles={} host_ms={} switches_per_s={} bytes_per_s={}",
+        switches,
+        bytes,
+        run.pcycles,
+        run.host_ms(),
+        run.per_s(switches),
+        run.per_s(bytes)
+    );
+}
+
+// -----------------------------------------------------------------------
+// Kernels
+// -----------------------------------------------------------------------
+
+/// Thread s lives on context s; `iters` selections round-robin.
+fn kernel_xa_select(iters: u32) {
+    let n = CONTEXTS.load(Ordering::Relaxed);
+    for s in 0..n {
+        init_state(s);
+        load_state(s, s);
+    }
+    for i in 0..iters {
+        select_touch(i % n);
+    }
+    for s in 0..n {
+        store_state(s, s);
+    }
+}
+
+/// `iters` switches round-robin over n software threads, starting from
+/// thread n - 1 and going to thread 0 first.
+fn save_restore(iters: u32, n: u32, ctx: fn(u32) -> u32) {
+    for s in 0..n {
+        init_state(s);
+    }
+    load_state(ctx(n - 1), n - 1);
+    let mut from = n - 1;
+    for i in 0..iters {
+        let to = i % n;
+        switch_state(ctx(from), from, ctx(to), to);
+        from = to;
+    }
+    store_state(ctx(from), from);
+}
+
+fn kernel_save_restore_1ctx(iters: u32) {
+    save_restore(iters, CONTEXTS.load(Ordering::Relaxed), |_| 0);
+}
+
+fn kernel_save_restore_xa(iters: u32) {
+    save_restore(iters, CONTEXTS.load(Ordering::Relaxed), |s| s);
+}
+
+/// Bit per context not taken by a thread.
+static FREE_CONTEXTS: AtomicU32 = AtomicU32::new(0);
+static SLICES: AtomicU32 = AtomicU32::new(0);
+static FINISHED: AtomicU32 = AtomicU32::new(0);
+
+fn acquire_context() -> u32 {
+    loop {
+        let free = FREE_CONTEXTS.load(Ordering::SeqCst);
+        if free == 0 {
+            busy_loop(10);
+            continue;
+        }
+        let xa = free.trailing_zeros();
+        if FREE_CONTEXTS
+            .compare_exchange(free, free & !(1 << xa), Ordering::SeqCst, Ordering::SeqCst)
+            .is_ok()
+        {
+            return xa;
+        }
+    }
+}
+
+fn release_context(xa: u32) {
+    FREE_CONTEXTS.fetch_or(1 << xa, Ordering::SeqCst);
+}
+
+/// Software thread htid: run SLICES time slices on whatever context is
+/// free.
+fn contend() {
+    let s = read_htid();
+    for _ in 0..SLICES.load(Ordering::SeqCst) {
+        let xa = acquire_context();
+        run_slice(xa, s);
+        release_context(xa);
+    }
+    FINISHED.fetch_add(1, Ordering::SeqCst);
+}
+
+extern "C" fn contend_entry() {
+    contend();
+}
+
+fn wait_for_thread_stopped(tid: u32, max_iters: u32) -> bool {
+    let mask = 1u32 << tid;
+    for _ in 0..max_iters {
+        if read_modectl() & mask == 0 {
+            return true;
+        }
+        busy_loop(10);
+    }
+    false
+}
+
+/// Every hardware thread runs `iters` slices.
+fn kernel_threads_contend(iters: u32) {
+    let threads = THREADS.load(Ordering::Relaxed);
+    let contexts = CONTEXTS.load(Ordering::Relaxed).min(threads - 1);
+    for s in 0..threads {
+        init_state(s);
+    }
+    FREE_CONTEXTS.store((1 << contexts) - 1, Ordering::SeqCst);
+    SLICES.store(iters, Ordering::SeqCst);
+    FINISHED.store(0, Ordering::SeqCst);
+
+    for t in 1..threads {
+        set_thread_entry(t, Some(contend_entry));
+    }
+    start_threads(((1 << threads) - 1) & !1);
+    contend();
+
+    // A lost context would hang here; the runner's timeout reports it.
+    while FINISHED.load(Ordering::SeqCst) != threads {
+        busy_loop(10);
+    }
+    for t in 1..threads {
+        check!(wait_for_thread_stopped(t, 50000));
+    }
+}
+
+// -----------------------------------------------------------------------
+// Benchmarks
+// -----------------------------------------------------------------------
+
+fn bench_xa_select() {
+    let run = calibrate(kernel_xa_select);
+    let n = CONTEXTS.load(Ordering::Relaxed);
+    for s in 0..n {
+        check_state(s, round_robin_share(s, n, run.iters));
+    }
+    report(&run, run.iters as u64, 0);
+}
+
+fn bench_save_restore(kernel: fn(u32)) {
+    let run = calibrate(kernel);
+    let n = CONTEXTS.load(Ordering::Relaxed);
+    for s in 0..n {
+        check_state(s, round_robin_share(s, n, run.iters));
+    }
+    report(&run, run.iters as u64, run.iters as u64 * SWITCH_BYTES);
+}
+
+fn bench_save_restore_1ctx() {
+    bench_save_restore(kernel_save_restore_1ctx);
+}
+
+fn bench_save_restore_xa() {
+    bench_save_restore(kernel_save_restore_xa);
+}
+
+fn bench_threads_contend() {
+    let run = calibrate(kernel_threads_contend);
+    let threads = THREADS.load(Ordering::Relaxed);
+    for s in 0..threads {
+        check_state(s, run.iters);
+    }
+    let switches = run.iters as u64 * threads as u64;
+    report(&run, switches, switches * SWITCH_BYTES);
+}
+
+// -----------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------
+
+#[no_mangle]
+pub extern "C" fn rust_main() -> i32 {
+    test_suite_begin("HVX Context Switch Benchmark");
+
+    if !require_threads(0x3) {
+        return test_suite_end() as i32;
+    }
+    if !require_hvx_contexts(2) {
+        return test_suite_end() as i32;
+    }
+
+    let threads = read_cfgtable_field(CFGTABLE_THREAD_ENABLE_MASK)
+        .trailing_ones()
+        .min(MAX_THREADS);
+    let contexts = read_cfgtable_field(CFGTABLE_EXT_CONTEXTS).min(MAX_CONTEXTS);
+    THREADS.store(threads, Ordering::Relaxed);
+    CONTEXTS.store(contexts, Ordering::Relaxed);
+    println!(
+        "threads={} contexts={} contended_contexts={} state_bytes={}",
+        threads,
+        contexts,
+        contexts.min(threads - 1),
+        STATE_WORDS * 4
+    );
+
+    run_test("xa_select", bench_xa_select);
+    run_test("save_restore_1ctx", bench_save_restore_1ctx);
+    run_test("save_restore_xa", bench_save_restore_xa);
+    run_test("threads_contend", bench_threads_contend);
+
+    test_suite_end() as i32
+}
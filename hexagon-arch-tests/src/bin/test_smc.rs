@@ -0,0 +1,310 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+//! Self-modifying code tests for Hexagon v81.
+//!
+//! The pattern of a code loader or JIT: write instructions to a page, clean
+//! the dcache lines, invalidate the icache (icinva per line, or ickill),
+//! isync, and call the new code.  An emulator has to notice the write and
+//! throw away what it translated from the old code.
+//!
+//! The code page is a function of single-instruction packets ending in
+//! `jumpr r31`.  It starts as nops, and a patch rewrites its first words
+//! to all `r0 = add(r0, #1)` or all `r0 = add(r0, #-1)`, alternately, so
+//! every patch changes the code and the return value tells which version
+//! ran.  The instruction words are copied from assembled templates.
+//!
+//! Each case patches one word, 64 words, or the whole 4K page, invalidates
+//! with icinva or ickill, with or without isync, and reports
+//!
+//! ```text
+//! words=N patches_per_s=N patch_ns=N latency_ns=N latency_pcycles=N
+//! exec_ns=N retranslate_ns=N stale=N
+//! ```
+//!
+//! (on one line): the sustained patch rate, the time of a patch alone, of
+//! a patch followed by the call (patch-to-execute latency), and of the call
+//! alone; retranslate_ns is what the latency has on top of the other two.
+//! `stale` counts calls that ran the old code.  Without isync the
+//! architecture does not promise the new code runs, so only the cases
+//! with isync fail on stale code.
+
+#![no_std]
+#![no_main]
+#![feature(asm_experimental_arch)]
+
+use core::arch::global_asm;
+use core::cell::Cell;
+use core::sync::atomic::{AtomicUsize, Ordering};
+use hexagon_arch_tests::*;
+
+/// icache and dcache line, as in test_cache.rs.
+const LINE: u32 = 32;
+const PAGE_WORDS: usize = 1024;
+/// All but the return.
+const BODY_WORDS: usize = PAGE_WORDS - 1;
+
+/// Minimum host time of a measured run, in centiseconds.  Short: these
+/// run with the other tests, and run_test() times the whole case anyway.
+const MIN_HOST_CS: u32 = 10;
+
+global_asm!(
+    ".section .text.smc_templates, \"ax\", @progbits",
+    ".p2align 2",
+    ".globl smc_nop",
+    "smc_nop:",
+    "{{ nop }}",
+    ".globl smc_inc",
+    "smc_inc:",
+    "{{ r0 = add(r0, #1) }}",
+    ".globl smc_dec",
+    "smc_dec:",
+    "{{ r0 = add(r0, #-1) }}",
+    ".globl smc_ret",
+    "smc_ret:",
+    "{{ jumpr r31 }}",
+    ".previous",
+);
+
+extern "C" {
+    static smc_nop: u32;
+    static smc_inc: u32;
+    static smc_dec: u32;
+    static smc_ret: u32;
+}
+
+fn template(insn: &u32) -> u32 {
+    unsafe { core::ptr::read_volatile(insn) }
+}
+
+#[repr(C, align(4096))]
+struct CodePage([u32; PAGE_WORDS]);
+
+static mut CODE: CodePage = CodePage([0; PAGE_WORDS]);
+
+fn code_ptr() -> *mut u32 {
+    (&raw mut CODE) as *mut u32
+}
+
+fn call_code() -> i32 {
+    let f: extern "C" fn(i32) -> i32 = unsafe { core::mem::transmute(code_ptr()) };
+    f(0)
+}
+
+// -----------------------------------------------------------------------
+// Patching
+// -----------------------------------------------------------------------
+
+#[derive(Clone, Copy)]
+enum Invalidate {
+    Icinva,
+    Ickill,
+}
+
+/// Make the first `bytes` of the page visible to instruction fetch.
+fn sync_code(bytes: u32, inval: Invalidate, with_isync: bool) {
+    let base = code_ptr() as u32;
+    for off in (0..bytes).step_by(LINE as usize) {
+        dccleana(base + off);
+    }
+    syncht();
+    match inval {
+        Invalidate::Icinva => {
+            for off in (0..bytes).step_by(LINE as usize) {
+                icinva(base + off);
+            }
+        }
+        Invalidate::Ickill => ickill(),
+    }
+    if with_isync {
+        isync();
+    }
+}
+
+/// Words of the body a patch of `words` rewrites.
+fn body_words(words: usize) -> usize {
+    words.min(BODY_WORDS)
+}
+
+/// Rewrite the first `words` of the page: the body with `insn`, and the
+/// return if the whole page is patched.
+fn patch(words: usize, insn: u32) {
+    let p = code_ptr();
+    for i in 0..body_words(words) {
+        unsafe { core::ptr::write_volatile(p.add(i), insn) };
+    }
+    if words == PAGE_WORDS {
+        unsafe { core::ptr::write_volatile(p.add(BODY_WORDS), template(&smc_ret)) };
+    }
+}
+
+/// The nth patch's instruction and the code's return value after it.
+fn version(n: u32, words: usize) -> (u32, i32) {
+    let body = body_words(words) as i32;
+    if n % 2 == 0 {
+        (unsafe { template(&smc_inc) }, body)
+    } else {
+        (unsafe { template(&smc_dec) }, -body)
+    }
+}
+
+/// An all-nop body.
+fn reset_code() {
+    let p = code_ptr();
+    let nop = unsafe { template(&smc_nop) };
+    for i in 0..BODY_WORDS {
+        unsafe { core::ptr::write_volatile(p.add(i), nop) };
+    }
+    unsafe { core::ptr::write_volatile(p.add(BODY_WORDS), template(&smc_ret)) };
+    sync_code((PAGE_WORDS * 4) as u32, Invalidate::Icinva, true);
+}
+
+// -----------------------------------------------------------------------
+// Test 1: patched code executes
+// -----------------------------------------------------------------------
+
+/// The plain sequence, once per patch size: nops return the argument, and
+/// each patch's return value must be the new code's.
+fn test_patch_executes() {
+    for &words in [1, 64, PAGE_WORDS].iter() {
+        reset_code();
+        check32!(call_code() as u32, 0);
+        for n in 0..4 {
+            let (insn, expected) = version(n, words);
+            patch(words, insn);
+            sync_code((words * 4) as u32, Invalidate::Icinva, true);
+            check32!(call_code() as u32, expected as u32);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Patch cases
+// -----------------------------------------------------------------------
+
+struct Case {
+    name: &'static str,
+    words: usize,
+    inval: Invalidate,
+    isync: bool,
+}
+
+const fn case(name: &'static str, words: usize, inval: Invalidate, isync: bool) -> Case {
+    Case {
+        name,
+        words,
+        inval,
+        isync,
+    }
+}
+
+const CASES: [Case; 12] = [
+    case("word_icinva_isync", 1, Invalidate::Icinva, true),
+    case("word_icinva", 1, Invalidate::Icinva, false),
+    case("word_ickill_isync", 1, Invalidate::Ickill, true),
+    case("word_ickill", 1, Invalidate::Ickill, false),
+    case("words64_icinva_isync", 64, Invalidate::Icinva, true),
+    case("words64_icinva", 64, Invalidate::Icinva, false),
+    case("words64_ickill_isync", 64, Invalidate::Ickill, true),
+    case("words64_ickill", 64, Invalidate::Ickill, false),
+    case("page_icinva_isync", PAGE_WORDS, Invalidate::Icinva, true),
+    case("page_icinva", PAGE_WORDS, Invalidate::Icinva, false),
+    case("page_ickill_isync", PAGE_WORDS, Invalidate::Ickill, true),
+    case("page_ickill", PAGE_WORDS, Invalidate::Ickill, false),
+];
+
+/// run_test() takes a fn(), so the case to run goes through here.
+static CURRENT_CASE: AtomicUsize = AtomicUsize::new(0);
+
+fn run_case() {
+    let c = &CASES[CURRENT_CASE.load(Ordering::Relaxed)];
+    let bytes = (c.words * 4) as u32;
+    let stale = Cell::new(0u32);
+    let calls = Cell::new(0u32);
+
+    // Sustained patch rate: no calls in between, the last patch is checked
+    reset_code();
+    let patches = Cell::new(0u32);
+    let rate = bench_calibrate(
+        &|iters| {
+            for _ in 0..iters {
+                patch(c.words, version(patches.get(), c.words).0);
+                sync_code(bytes, c.inval, c.isync);
+                patches.set(patches.get() + 1);
+            }
+        },
+        MIN_HOST_CS,
+    );
+    calls.set(calls.get() + 1);
+    if call_code() != version(patches.get() - 1, c.words).1 {
+        stale.set(stale.get() + 1);
+    }
+
+    // Patch-to-execute latency: every patch is called. The count runs on
+    // across rounds so that each patch changes the code in the page.
+    reset_code();
+    let latency_patches = Cell::new(0u32);
+    let latency = bench_calibrate(
+        &|iters| {
+            for _ in 0..iters {
+                let (insn, expected) = version(latency_patches.get(), c.words);
+                patch(c.words, insn);
+                sync_code(bytes, c.inval, c.isync);
+                latency_patches.set(latency_patches.get() + 1);
+                calls.set(calls.get() + 1);
+                if call_code() != expected {
+                    stale.set(stale.get() + 1);
+                }
+            }
+        },
+        MIN_HOST_CS,
+    );
+
+    // The call alone, on code translated once
+    let exec = bench_calibrate(
+        &|iters| {
+            for _ in 0..iters {
+                call_code();
+            }
+        },
+        MIN_HOST_CS,
+    );
+
+    let iters = |r: &BenchRun| r.iters as u64;
+    let patch_ns = rate.ns_per(iters(&rate));
+    let latency_ns = latency.ns_per(iters(&latency));
+    let exec_ns = exec.ns_per(iters(&exec));
+    println!(
+        "words={} patches_per_s={} patch_ns={} latency_ns={} latency_pcycles={} \
+         exec_ns={} retranslate_ns={} stale={}/{}",
+        c.words,
+        rate.per_s(iters(&rate)),
+        patch_ns,
+        latency_ns,
+        latency.pcycles / iters(&latency),
+        exec_ns,
+        latency_ns.saturating_sub(patch_ns + exec_ns),
+        stale.get(),
+        calls.get()
+    );
+    if c.isync {
+        check32!(stale.get(), 0);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------
+
+#[no_mangle]
+pub extern "C" fn rust_main() -> i32 {
+    test_suite_begin("Self-Modifying Code");
+
+    run_test("patch_executes", test_patch_executes);
+    for (i, c) in CASES.iter().enumerate() {
+        CURRENT_CASE.store(i, Ordering::Relaxed);
+        run_test(c.name, run_case);
+    }
+
+    test_suite_end() as i32
+}
@@ -224,6 +224,21 @@ pub fn putc(c: u8) {
     }
 }
 
+/// Centiseconds since the simulator started, from the host (SYS_CLOCK).
+#[inline(never)]
+pub fn host_clock_cs() -> u32 {
+    let val: u32;
+    unsafe {
+        asm!(
+            "r0 = #0x10",     // SYS_CLOCK
+            "trap0(#0)",
+            out("r0") val,
+            out("r1") _,
+        );
+    }
+    val
+}
+
 /// Write a string to the simulator console character by character.
 #[inline(never)]
 pub fn puts(s: &str) {
@@ -370,17 +385,148 @@ macro_rules! check {
 // Test runner
 // ---------------------------------------------------------------------------
 
+/// Runs of each test in bench mode, set at build time with
+/// `ARCH_TESTS_BENCH_RUNS` (at most `BENCH_MAX_RUNS`).
+#[cfg(feature = "bench")]
+pub const BENCH_RUNS: usize = match option_env!("ARCH_TESTS_BENCH_RUNS") {
+    Some(s) => parse_runs(s.as_bytes()),
+    None => 10,
+};
+#[cfg(not(feature = "bench"))]
+pub const BENCH_RUNS: usize = 1;
+pub const BENCH_MAX_RUNS: usize = 64;
+
+#[cfg(feature = "bench")]
+const fn parse_runs(s: &[u8]) -> usize {
+    let mut n = 0;
+    let mut i = 0;
+    while i < s.len() {
+        assert!(
+            s[i].is_ascii_digit(),
+            "ARCH_TESTS_BENCH_RUNS is not a number"
+        );
+        n = n * 10 + (s[i] - b'0') as usize;
+        i += 1;
+    }
+    assert!(
+        n >= 1 && n <= BENCH_MAX_RUNS,
+        "ARCH_TESTS_BENCH_RUNS out of range"
+    );
+    n
+}
+
+/// Guest cycles and host time of one run of a test.
+#[derive(Clone, Copy)]
+struct RunTime {
+    pcycles: u64,
+    host_ms: u64,
+}
+
+/// pcycle, or None when SYSCFG.PCYCLE_EN is off.  The harness never sets
+/// the bit itself: whether it is on is what some tests check.
+fn pcycle_if_enabled() -> Option<u64> {
+    (read_syscfg() & SYSCFG_PCYCLE_EN != 0).then(read_pcycle)
+}
+
+/// Cycles between two pcycle_if_enabled() reads, 0 unless both counted.
+fn pcycles_between(pc0: Option<u64>, pc1: Option<u64>) -> u64 {
+    match (pc0, pc1) {
+        (Some(pc0), Some(pc1)) => pc1.wrapping_sub(pc0),
+        _ => 0,
+    }
+}
+
+fn time_run(f: fn()) -> RunTime {
+    let host0 = host_clock_cs();
+    let pc0 = pcycle_if_enabled();
+    f();
+    let pc1 = pcycle_if_enabled();
+    let host1 = host_clock_cs();
+    RunTime {
+        pcycles: pcycles_between(pc0, pc1),
+        host_ms: host1.wrapping_sub(host0) as u64 * 10,
+    }
+}
+
+/// Emulated cycles per host second, 0 when the host time is below the
+/// clock resolution.
+fn pcycles_per_host_s(pcycles: u64, host_ms: u64) -> u64 {
+    if host_ms == 0 {
+        0
+    } else {
+        pcycles * 1000 / host_ms
+    }
+}
+
+/// Minimum and median.
+fn min_median(vals: &mut [u64]) -> (u64, u64) {
+    vals.sort_unstable();
+    (vals[0], vals[vals.len() / 2])
+}
+
 /// Run a named test function and report results.
+///
+/// The verdict is followed by the guest cycles and host time the test
+/// took, measured with pcycle and the semihosting clock (10ms resolution).
+/// pcycles is 0 when SYSCFG.PCYCLE_EN was off at the start or the end of
+/// the test:
+///
+/// ```text
+///   name ... ok [pcycles=123456 host_ms=20 pcycles_per_host_s=6172800]
+/// ```
+///
+/// With the `bench` feature each test runs `BENCH_RUNS` times and the
+/// minimum and median of both are reported instead, the rate being over
+/// all runs:
+///
+/// ```text
+///   name ... ok [runs=10 pcycles_min=.. pcycles_median=.. host_ms_min=..
+///   host_ms_median=.. pcycles_per_host_s=..]
+/// ```
+///
+/// (on a single line). Errors are counted over all runs, so only tests
+/// that can run repeatedly make useful benchmarks.
 pub fn run_test(name: &str, f: fn()) {
     print!("  {} ... ", name);
     let before = error_count();
-    f();
+    let mut runs = [RunTime {
+        pcycles: 0,
+        host_ms: 0,
+    }; BENCH_MAX_RUNS];
+    for run in runs.iter_mut().take(BENCH_RUNS) {
+        *run = time_run(f);
+    }
     let after = error_count();
     if after == before {
-        println!("ok");
+        print!("ok");
     } else {
-        println!("FAILED ({} errors)", after - before);
+        print!("FAILED ({} errors)", after - before);
     }
+
+    let runs = &runs[..BENCH_RUNS];
+    let total_pcycles: u64 = runs.iter().map(|r| r.pcycles).sum();
+    let total_ms: u64 = runs.iter().map(|r| r.host_ms).sum();
+    let rate = pcycles_per_host_s(total_pcycles, total_ms);
+    if BENCH_RUNS == 1 {
+        println!(
+            " [pcycles={} host_ms={} pcycles_per_host_s={}]",
+            total_pcycles, total_ms, rate
+        );
+        return;
+    }
+    let mut pcycles = [0u64; BENCH_MAX_RUNS];
+    let mut host_ms = [0u64; BENCH_MAX_RUNS];
+    for (i, r) in runs.iter().enumerate() {
+        pcycles[i] = r.pcycles;
+        host_ms[i] = r.host_ms;
+    }
+    let (pcycles_min, pcycles_median) = min_median(&mut pcycles[..BENCH_RUNS]);
+    let (host_ms_min, host_ms_median) = min_median(&mut host_ms[..BENCH_RUNS]);
+    println!(
+        " [runs={} pcycles_min={} pcycles_median={} host_ms_min={} host_ms_median={} \
+         pcycles_per_host_s={}]",
+        BENCH_RUNS, pcycles_min, pcycles_median, host_ms_min, host_ms_median, rate
+    );
 }
 
 /// Print test suite header.
@@ -399,6 +545,78 @@ pub fn test_suite_end() -> u32 {
     errs
 }
 
+// ---------------------------------------------------------------------------
+// Benchmark calibration (the bench_* binaries)
+// ---------------------------------------------------------------------------
+
+const BENCH_START_ITERS: u32 = 64;
+const BENCH_MAX_ITERS: u32 = 1 << 24;
+
+/// One timed run of a benchmark kernel.
+pub struct BenchRun {
+    pub iters: u32,
+    pub pcycles: u64,
+    pub host_cs: u32,
+}
+
+impl BenchRun {
+    pub fn host_ms(&self) -> u64 {
+        self.host_cs as u64 * 10
+    }
+
+    /// `count` per host second, 0 below the clock resolution.
+    pub fn per_s(&self, count: u64) -> u64 {
+        if self.host_cs == 0 {
+            0
+        } else {
+            count * 100 / self.host_cs as u64
+        }
+    }
+
+    /// Host nanoseconds per each of `count` things done in the run.
+    pub fn ns_per(&self, count: u64) -> u64 {
+        if count == 0 {
+            0
+        } else {
+            self.host_cs as u64 * 10_000_000 / count
+        }
+    }
+}
+
+/// Time `kernel(iters)` with pcycle and the host clock.  pcycles is 0
+/// when SYSCFG.PCYCLE_EN is off, as in run_test().
+pub fn bench_measure(kernel: &dyn Fn(u32), iters: u32) -> BenchRun {
+    let host0 = host_clock_cs();
+    let pc0 = pcycle_if_enabled();
+    kernel(iters);
+    let pc1 = pcycle_if_enabled();
+    let host1 = host_clock_cs();
+    BenchRun {
+        iters,
+        pcycles: pcycles_between(pc0, pc1),
+        host_cs: host1.wrapping_sub(host0),
+    }
+}
+
+/// Runs `kernel` with a growing iteration count until one run takes
+/// `min_cs` centiseconds of host time, and returns that run.
+pub fn bench_calibrate(kernel: &dyn Fn(u32), min_cs: u32) -> BenchRun {
+    let mut iters = BENCH_START_ITERS;
+    loop {
+        let run = bench_measure(kernel, iters);
+        if run.host_cs >= min_cs || iters >= BENCH_MAX_ITERS {
+            return run;
+        }
+        // Aim a bit past the minimum so the next run is likely the last
+        let next = if run.host_cs < 2 {
+            iters as u64 * 16
+        } else {
+            iters as u64 * min_cs as u64 * 5 / 4 / run.host_cs as u64 + 1
+        };
+        iters = next.min(BENCH_MAX_ITERS as u64) as u32;
+    }
+}
+
 // ---------------------------------------------------------------------------
 // System register accessors (inline asm)
 // ---------------------------------------------------------------------------
@@ -1153,6 +1371,13 @@ pub fn dccleaninva(addr: u32) {
     }
 }
 
+#[inline(always)]
+pub fn icinva(addr: u32) {
+    unsafe {
+        asm!("icinva({0})", in(reg) addr, options(nostack));
+    }
+}
+
 #[inline(always)]
 pub fn dckill() {
     unsafe {
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <hexagon_standalone.h>
+#include "cfgtable.h"
+#include "thread_common.h"
+#include "bench.h"
+
+#define SYSCFG_PCYCLEEN_BIT     6
+
+#define HEX_SYS_CLOCK           0x10
+#define HEX_SYS_TIME            0x11
+
+#define BENCH_START_ITERS       64
+#define BENCH_MAX_ITERS         (1u << 30)
+
+#define BENCH_STACK_SIZE        4096
+
+static const char *suite_name;
+static FILE *csv;
+static FILE *latency_csv;
+static uint32_t min_cs = BENCH_MIN_CS;
+static const char *filter;
+static int errors;
+
+struct bench_thread {
+    bench_fn fn;
+    uint32_t iters;
+    void *arg;
+};
+
+static struct bench_thread threads[BENCH_MAX_THREADS];
+static char stacks[BENCH_MAX_THREADS][BENCH_STACK_SIZE]
+    __attribute__((aligned(8)));
+
+static uint32_t semihost0(uint32_t code)
+{
+    uint32_t ret;
+    asm volatile("r0 = %1\n\t"
+                 "trap0(#0)\n\t"
+                 "%0 = r0\n\t"
+                 : "=r"(ret)
+                 : "r"(code)
+                 : "r0", "r1", "memory");
+    return ret;
+}
+
+uint32_t bench_host_clock(void)
+{
+    return semihost0(HEX_SYS_CLOCK);
+}
+
+uint32_t bench_host_time(void)
+{
+    return semihost0(HEX_SYS_TIME);
+}
+
+uint64_t bench_pcycle(void)
+{
+    uint64_t pcycle;
+    asm volatile("%0 = pcycle\n\t" : "=r"(pcycle));
+    return pcycle;
+}
+
+uint32_t bench_min_cs(void)
+{
+    return min_cs;
+}
+
+static void enable_pcycle(void)
+{
+    asm volatile("r2 = syscfg\n\t"
+                 "r2 = setbit(r2, #%0)\n\t"
+                 "syscfg = r2\n\t"
+                 "isync\n\t"
+                 :
+                 : "i"(SYSCFG_PCYCLEEN_BIT)
+                 : "r2");
+}
+
+void bench_init(const char *suite, int argc, char **argv)
+{
+    char fname[64];
+
+    suite_name = suite;
+    if (argc > 1) {
+        min_cs = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        filter = argv[2];
+    }
+    enable_pcycle();
+
+    snprintf(fname, sizeof(fname), "%s.csv", suite);
+    csv = fopen(fname, "w");
+    if (!csv) {
+        printf("warning: cannot open %s, results go to stdout only\n", fname);
+    }
+    printf("# %s: host time %" PRIu32 ", at least %" PRIu32 " cs per kernel\n",
+           suite, bench_host_time(), min_cs);
+    printf("%s\n", BENCH_CSV_HEADER);
+    if (csv) {
+        fprintf(csv, "%s\n", BENCH_CSV_HEADER);
+    }
+}
+
+int bench_selected(const char *name)
+{
+    return !filter || strstr(name, filter);
+}
+
+bench_result bench_measure(const bench_kernel *k, uint32_t iters)
+{
+    bench_result r;
+
+    /* Start on a clock tick, the clock only has a 10ms resolution */
+    uint32_t t = bench_host_clock();
+    while (bench_host_clock() == t) {
+    }
+    t = bench_host_clock();
+    uint64_t pcycle = bench_pcycle();
+    k->fn(iters, k->arg);
+    r.pcycles = bench_pcycle() - pcycle;
+    r.host_cs = bench_host_clock() - t;
+    r.iters = iters;
+    return r;
+}
+
+bench_result bench_run(const bench_kernel *k)
+{
+    uint32_t iters = BENCH_START_ITERS;
+
+    for (;;) {
+        bench_result r = bench_measure(k, iters);
+        if (r.host_cs >= min_cs || iters >= BENCH_MAX_ITERS) {
+            return r;
+        }
+        /* Aim a bit past the minimum so the next run is likely the last */
+        uint64_t next = r.host_cs < 2 ? (uint64_t)iters * 16 :
+            (uint64_t)iters * min_cs * 5 / 4 / r.host_cs + 1;
+        iters = next > BENCH_MAX_ITERS ? BENCH_MAX_ITERS : (uint32_t)next;
+    }
+}
+
+static void print_row(FILE *f, const bench_kernel *k, const bench_result *r)
+{
+    uint64_t packets = (uint64_t)r->iters * k->packets_per_iter;
+    uint64_t insts = (uint64_t)r->iters * k->insts_per_iter;
+    uint64_t vectors = (uint64_t)r->iters * k->vectors_per_iter;
+    uint64_t bytes = (uint64_t)r->iters * k->bytes_per_iter;
+    double secs = r->host_cs ? r->host_cs / 100. : 0.01;
+
+    fprintf(f, "%s,%s,%s,%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%" PRIu64 ",%" PRIu64 ",%" PRIu32 ",%.3f,%.3f,%.3f,%.3f\n",
+            suite_name, k->name, k->param ? k->param : "",
+            r->iters, packets, insts, vectors, bytes, r->pcycles,
+            r->host_cs * 10,
+            insts / secs / 1e6,
+            packets ? secs * 1e9 / packets : 0.,
+            vectors / secs / 1e6,
+            bytes / secs / 1e6);
+}
+
+void bench_report(const bench_kernel *k, const bench_result *r)
+{
+    print_row(stdout, k, r);
+    if (csv) {
+        print_row(csv, k, r);
+        fflush(csv);
+    }
+}
+
+void bench_run_all(const bench_kernel *kernels, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (bench_selected(kernels[i].name)) {
+            bench_result r = bench_run(&kernels[i]);
+            bench_report(&kernels[i], &r);
+        }
+    }
+}
+
+uint32_t bench_max_threads(void)
+{
+    uint32_t n = __builtin_popcount(
+        read_cfgtable_field(CFGTABLE_THREAD_ENABLE_MASK));
+    return n > BENCH_MAX_THREADS ? BENCH_MAX_THREADS : n ? n : 1;
+}
+
+static void bench_thread_main(void *p)
+{
+    struct bench_thread *t = p;
+    t->fn(t->iters, t->arg);
+}
+
+void bench_parallel(bench_fn fn, uint32_t iters, void *const *args,
+                    uint32_t nthreads)
+{
+    uint32_t mask = 0;
+
+    for (uint32_t tid = 1; tid < nthreads; tid++) {
+        threads[tid].fn = fn;
+        threads[tid].iters = iters;
+        threads[tid].arg = args[tid];
+        create_waiting_thread(bench_thread_main,
+                              &stacks[tid][BENCH_STACK_SIZE - 16], tid,
+                              &threads[tid]);
+        mask |= 1 << tid;
+    }
+    if (mask) {
+        start_waiting_threads(mask);
+    }
+    fn(iters, args[0]);
+    if (mask) {
+        thread_join(mask);
+    }
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void bench_report_latency(const char *kernel, const char *param,
+                          uint32_t *samples, uint32_t n)
+{
+    if (!n) {
+        return;
+    }
+    qsort(samples, n, sizeof(*samples), cmp_u32);
+    uint32_t min = samples[0];
+    uint32_t p50 = samples[n / 2];
+    uint32_t p99 = samples[n * 99 / 100];
+    uint32_t max = samples[n - 1];
+
+    printf("# %s %s: %" PRIu32 " samples, pcycles min %" PRIu32
+           " p50 %" PRIu32 " p99 %" PRIu32 " max %" PRIu32 "\n",
+           kernel, param ? param : "", n, min, p50, p99, max);
+
+    if (!latency_csv) {
+        char fname[64];
+        snprintf(fname, sizeof(fname), "%s_latency.csv", suite_name);
+        latency_csv = fopen(fname, "w");
+        if (!latency_csv) {
+            printf("warning: cannot open %s\n", fname);
+            return;
+        }
+        fprintf(latency_csv, "%s\n", BENCH_LATENCY_CSV_HEADER);
+    }
+    fprintf(latency_csv, "%s,%s,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32
+            ",%" PRIu32 ",%" PRIu32 "\n",
+            suite_name, kernel, param ? param : "", n, min, p50, p99, max);
+    fflush(latency_csv);
+}
+
+void bench_error(const char *kernel, const char *msg)
+{
+    printf("ERROR: %s: %s\n", kernel, msg);
+    errors++;
+}
+
+int bench_finish(void)
+{
+    if (csv) {
+        fclose(csv);
+    }
+    if (latency_csv) {
+        fclose(latency_csv);
+    }
+    printf("%s\n", errors ? "FAIL" : "PASS");
+    return errors;
+}
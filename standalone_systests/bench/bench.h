@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Emulator throughput benchmarks.
+ *
+ * A benchmark program is a list of kernels. Each kernel runs a loop whose
+ * body has a known number of packets/instructions/bytes per iteration; the
+ * harness calibrates the iteration count until one run takes at least the
+ * minimum host time, then reports that run. Host time comes from the
+ * semihosting clock (HEX_SYS_CLOCK, centiseconds), guest time from pcycle.
+ *
+ * Every result is one CSV line, BENCH_CSV_HEADER, printed to stdout and
+ * appended to <suite>.csv in the working directory (semihosting file I/O).
+ * Latency distributions (bench_report_latency()) go to <suite>_latency.csv,
+ * BENCH_LATENCY_CSV_HEADER, with a summary line on stdout.
+ *
+ * Usage: <program> [min host centiseconds per kernel] [kernel filter]
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#define BENCH_CSV_HEADER \
+    "suite,kernel,param,iters,packets,insts,vectors,bytes,pcycles,host_ms," \
+    "mips,ns_per_packet,mvec_per_sec,mb_per_sec"
+
+#define BENCH_LATENCY_CSV_HEADER \
+    "suite,kernel,param,samples,min,p50,p99,max"
+
+/* Default minimum host time of a reported run, in centiseconds */
+#define BENCH_MIN_CS 100
+
+/* Upper bound of bench_max_threads() */
+#define BENCH_MAX_THREADS 8
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#define STR_(X) #X
+#define STR(X) STR_(X)
+
+/*
+ * Inline asm hardware loop of 8 packets alternating A and B, the last B
+ * closes it. The iteration count is the %[iters] operand.
+ */
+#define LOOP8(A, B) \
+    "loop0(1f, %[iters])\n\t" \
+    ".falign\n" \
+    "1:\n\t" \
+    A "\n\t" B "\n\t" A "\n\t" B "\n\t" \
+    A "\n\t" B "\n\t" A "\n\t" B ":endloop0\n\t"
+
+typedef void (*bench_fn)(uint32_t iters, void *arg);
+
+typedef struct {
+    const char *name;
+    const char *param;          /* sweep point, or NULL */
+    bench_fn fn;
+    void *arg;
+    uint32_t packets_per_iter;
+    uint32_t insts_per_iter;
+    uint32_t vectors_per_iter;  /* HVX vectors produced/stored */
+    uint32_t bytes_per_iter;
+} bench_kernel;
+
+typedef struct {
+    uint32_t iters;
+    uint64_t pcycles;
+    uint32_t host_cs;
+} bench_result;
+
+void bench_init(const char *suite, int argc, char **argv);
+int bench_selected(const char *name);
+bench_result bench_measure(const bench_kernel *k, uint32_t iters);
+bench_result bench_run(const bench_kernel *k);
+void bench_report(const bench_kernel *k, const bench_result *r);
+/* bench_run() + bench_report() of every selected kernel */
+void bench_run_all(const bench_kernel *kernels, int n);
+/* Distribution of n samples, in pcycles; sorts the samples in place */
+void bench_report_latency(const char *kernel, const char *param,
+                          uint32_t *samples, uint32_t n);
+void bench_error(const char *kernel, const char *msg);
+int bench_finish(void);
+
+/* Hardware threads enabled in the cfgtable, at most BENCH_MAX_THREADS */
+uint32_t bench_max_threads(void);
+/*
+ * fn(iters, args[t]) on hardware threads 0..nthreads-1 at once, the calling
+ * thread (0) included; returns when all of them are done.
+ */
+void bench_parallel(bench_fn fn, uint32_t iters, void *const *args,
+                    uint32_t nthreads);
+
+uint64_t bench_pcycle(void);
+uint32_t bench_host_clock(void);
+uint32_t bench_host_time(void);
+uint32_t bench_min_cs(void);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * HVX throughput: the op families covered functionally by hvx_misc,
+ * hvx_ext, qfloat_test, ieee_fp and standalone_vec, each in a hardware
+ * loop of 8 packets. The mvec_per_sec and ns_per_packet columns give the
+ * emulation cost of each family.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "vtcm_common.h"
+#include "bench.h"
+
+#ifndef LOG2VLEN
+#define LOG2VLEN 7
+#endif
+#define VLEN (1 << LOG2VLEN)
+
+/* Scatter/gather region at the start of VTCM, gathers land after it */
+#define REGION_BYTES 0x8000
+#define REGION_MASK  0x7fff
+
+struct hvx_bufs {
+    void *src;          /* DDR, 2 vectors */
+    void *dst;          /* DDR, 3 vectors */
+    void *vtcm;         /* scatter/gather region */
+    void *vtcm_dst;     /* gather destination */
+    void *hoffsets;     /* halfword offsets, one vector */
+    void *woffsets;     /* word offsets, one vector */
+};
+
+static uint8_t src_buf[2 * VLEN] __attribute__((aligned(VLEN)));
+static uint8_t dst_buf[3 * VLEN] __attribute__((aligned(VLEN)));
+static uint16_t hoffsets[VLEN / 2] __attribute__((aligned(VLEN)));
+static uint32_t woffsets[VLEN / 4] __attribute__((aligned(VLEN)));
+static struct hvx_bufs bufs;
+
+/*
+ * r10: src, r11: src + 1 (unaligned), r12: dst, r13: splat value,
+ * v2-v5: splats of r13
+ */
+#define SETUP(SPLAT) \
+    "r10 = memw(%[arg] + #0)\n\t" \
+    "r11 = add(r10, #1)\n\t" \
+    "r12 = memw(%[arg] + #4)\n\t" \
+    "r13 = ##" STR(SPLAT) "\n\t" \
+    "v2 = vsplat(r13)\n\t" \
+    "v3 = vsplat(r13)\n\t" \
+    "v4 = vsplat(r13)\n\t" \
+    "v5 = vsplat(r13)\n\t"
+
+/* r14: region, m0: region size - 1, r12: gather dst, v2/v6: offsets */
+#define SG_SETUP \
+    SETUP(0x01010101) \
+    "r14 = memw(%[arg] + #8)\n\t" \
+    "r12 = memw(%[arg] + #12)\n\t" \
+    "r13 = memw(%[arg] + #16)\n\t" \
+    "v2 = vmem(r13 + #0)\n\t" \
+    "r13 = memw(%[arg] + #20)\n\t" \
+    "v6 = vmem(r13 + #0)\n\t" \
+    "r13 = ##" STR(REGION_MASK) "\n\t" \
+    "m0 = r13\n\t"
+
+/* Scatters complete before the kernel returns */
+#define SCATTER_SYNC \
+    "vmem(r14 + #0):scatter_release\n\t" \
+    "v0 = vmem(r14 + #0)\n\t"
+
+#define DECLARE_KERNEL(NAME, SETUP, BODY) \
+    static void NAME(uint32_t iters, void *arg) \
+    { \
+        asm volatile(SETUP BODY \
+                     : \
+                     : [iters] "r"(iters), [arg] "r"(arg) \
+                     : "r7", "r10", "r11", "r12", "r13", "r14", "m0", \
+                       "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", \
+                       "v12", "lc0", "sa0", "memory"); \
+    }
+
+/* Integer */
+DECLARE_KERNEL(k_vadd, SETUP(0x01020304),
+    LOOP8("{ v0.w = vadd(v2.w, v3.w); v1.w = vadd(v4.w, v5.w) }",
+          "{ v6.h = vsub(v2.h, v3.h); v7.b = vadd(v4.b, v5.b) }"))
+DECLARE_KERNEL(k_vmpy, SETUP(0x01020304),
+    LOOP8("{ v1:0.h = vmpy(v2.ub, v3.b) }",
+          "{ v7:6.h += vmpy(v4.ub, v5.b) }"))
+DECLARE_KERNEL(k_vrmpy, SETUP(0x01020304),
+    LOOP8("{ v0.uw = vrmpy(v2.ub, v3.ub) }",
+          "{ v1.uw += vrmpy(v4.ub, v5.ub) }"))
+
+/* Permutes */
+DECLARE_KERNEL(k_vdeal, SETUP(0x01020304) "r7 = #-2\n\t",
+    LOOP8("{ v1:0 = vdeal(v3, v2, r7) }",
+          "{ v7:6 = vdeal(v5, v4, r7) }"))
+DECLARE_KERNEL(k_vshuff, SETUP(0x01020304) "r7 = #-2\n\t",
+    LOOP8("{ v1:0 = vshuff(v3, v2, r7) }",
+          "{ v7:6 = vshuff(v5, v4, r7) }"))
+DECLARE_KERNEL(k_vdelta, SETUP(0x01020304),
+    LOOP8("{ v0 = vdelta(v2, v3) }",
+          "{ v1 = vrdelta(v4, v5) }"))
+
+/* Qfloat, starting from 1.0 */
+DECLARE_KERNEL(k_qf32, SETUP(0x3f800000),
+    LOOP8("{ v0.qf32 = vadd(v2.qf32, v3.qf32) }",
+          "{ v1.qf32 = vmpy(v4.qf32, v5.qf32) }"))
+DECLARE_KERNEL(k_qf16, SETUP(0x3c003c00),
+    LOOP8("{ v0.qf16 = vadd(v2.qf16, v3.qf16) }",
+          "{ v1.qf16 = vmpy(v4.qf16, v5.qf16) }"))
+
+/* IEEE */
+DECLARE_KERNEL(k_ieee_sf, SETUP(0x3f800000),
+    LOOP8("{ v0.sf = vadd(v2.sf, v3.sf) }",
+          "{ v1.sf = vmpy(v4.sf, v5.sf) }"))
+DECLARE_KERNEL(k_ieee_hf, SETUP(0x3c003c00),
+    LOOP8("{ v0.hf = vadd(v2.hf, v3.hf) }",
+          "{ v1.hf = vmpy(v4.hf, v5.hf) }"))
+
+/* Vector memory */
+DECLARE_KERNEL(k_vmem_ld, SETUP(0),
+    LOOP8("{ v0 = vmem(r10 + #0) }",
+          "{ v1 = vmem(r10 + #1) }"))
+DECLARE_KERNEL(k_vmem_st, SETUP(0),
+    LOOP8("{ vmem(r12 + #0) = v2 }",
+          "{ vmem(r12 + #1) = v3 }"))
+DECLARE_KERNEL(k_vmemu_ld, SETUP(0),
+    LOOP8("{ v0 = vmemu(r11 + #0) }",
+          "{ v1 = vmemu(r11 + #0) }"))
+DECLARE_KERNEL(k_vmemu_st, SETUP(0) "r11 = add(r12, #1)\n\t",
+    LOOP8("{ vmemu(r11 + #0) = v2 }",
+          "{ vmemu(r11 + #0) = v3 }"))
+DECLARE_KERNEL(k_vmem_tmp, SETUP(1),
+    LOOP8("{ v12.tmp = vmem(r10 + #0); v0.w = vadd(v12.w, v3.w) }",
+          "{ v12.tmp = vmem(r10 + #1); v1.w = vadd(v12.w, v5.w) }"))
+DECLARE_KERNEL(k_vmem_cur, SETUP(0),
+    LOOP8("{ v0.cur = vmem(r10 + #0); vmem(r12 + #0) = v0 }",
+          "{ v1.cur = vmem(r10 + #1); vmem(r12 + #1) = v1 }"))
+
+/* Scatter/gather, into VTCM */
+DECLARE_KERNEL(k_vscatter_h, SG_SETUP,
+    LOOP8("{ vscatter(r14, m0, v2.h).h = v3 }",
+          "{ vscatter(r14, m0, v2.h).h = v4 }")
+    SCATTER_SYNC)
+DECLARE_KERNEL(k_vscatteracc_h, SG_SETUP,
+    LOOP8("{ vscatter(r14, m0, v2.h).h += v3 }",
+          "{ vscatter(r14, m0, v2.h).h += v4 }")
+    SCATTER_SYNC)
+DECLARE_KERNEL(k_vscatter_w, SG_SETUP,
+    LOOP8("{ vscatter(r14, m0, v6.w).w = v3 }",
+          "{ vscatter(r14, m0, v6.w).w = v4 }")
+    SCATTER_SYNC)
+DECLARE_KERNEL(k_vgather_h, SG_SETUP,
+    LOOP8("{ vtmp.h = vgather(r14, m0, v2.h).h; vmem(r12 + #0) = vtmp.new }",
+          "{ vtmp.h = vgather(r14, m0, v2.h).h; vmem(r12 + #1) = vtmp.new }"))
+DECLARE_KERNEL(k_vgather_w, SG_SETUP,
+    LOOP8("{ vtmp.w = vgather(r14, m0, v6.w).w; vmem(r12 + #0) = vtmp.new }",
+          "{ vtmp.w = vgather(r14, m0, v6.w).w; vmem(r12 + #1) = vtmp.new }"))
+
+#define BUFS (&bufs)
+
+static const bench_kernel kernels[] = {
+    /* name, param, fn, arg, packets, insts, vectors, bytes per iteration */
+    { "vadd",          NULL, k_vadd,          BUFS, 8, 16, 16, 0 },
+    { "vmpy",          NULL, k_vmpy,          BUFS, 8,  8, 16, 0 },
+    { "vrmpy",         NULL, k_vrmpy,         BUFS, 8,  8,  8, 0 },
+    { "vdeal",         NULL, k_vdeal,         BUFS, 8,  8, 16, 0 },
+    { "vshuff",        NULL, k_vshuff,        BUFS, 8,  8, 16, 0 },
+    { "vdelta",        NULL, k_vdelta,        BUFS, 8,  8,  8, 0 },
+    { "qf32",          NULL, k_qf32,          BUFS, 8,  8,  8, 0 },
+    { "qf16",          NULL, k_qf16,          BUFS, 8,  8,  8, 0 },
+    { "ieee_sf",       NULL, k_ieee_sf,       BUFS, 8,  8,  8, 0 },
+    { "ieee_hf",       NULL, k_ieee_hf,       BUFS, 8,  8,  8, 0 },
+    { "vmem_ld",       NULL, k_vmem_ld,       BUFS, 8,  8,  8, 8 * VLEN },
+    { "vmem_st",       NULL, k_vmem_st,       BUFS, 8,  8,  8, 8 * VLEN },
+    { "vmemu_ld",      NULL, k_vmemu_ld,      BUFS, 8,  8,  8, 8 * VLEN },
+    { "vmemu_st",      NULL, k_vmemu_st,      BUFS, 8,  8,  8, 8 * VLEN },
+    { "vmem_tmp",      NULL, k_vmem_tmp,      BUFS, 8, 16,  8, 8 * VLEN },
+    { "vmem_cur",      NULL, k_vmem_cur,      BUFS, 8, 16,  8, 16 * VLEN },
+    { "vscatter_h",    NULL, k_vscatter_h,    BUFS, 8,  8,  8, 8 * VLEN },
+    { "vscatteracc_h", NULL, k_vscatteracc_h, BUFS, 8,  8,  8, 8 * VLEN },
+    { "vscatter_w",    NULL, k_vscatter_w,    BUFS, 8,  8,  8, 8 * VLEN },
+    { "vgather_h",     NULL, k_vgather_h,     BUFS, 8, 16,  8, 16 * VLEN },
+    { "vgather_w",     NULL, k_vgather_w,     BUFS, 8, 16,  8, 16 * VLEN },
+};
+
+int main(int argc, char **argv)
+{
+    uint8_t *vtcm = setup_default_vtcm();
+
+    /* Distinct, in-region offsets for every lane */
+    for (int i = 0; i < VLEN / 2; i++) {
+        hoffsets[i] = i * 2 * 4;
+    }
+    for (int i = 0; i < VLEN / 4; i++) {
+        woffsets[i] = i * 4 * 4;
+    }
+    memset(src_buf, 0x5a, sizeof(src_buf));
+    bufs.src = src_buf;
+    bufs.dst = dst_buf;
+    bufs.vtcm = vtcm;
+    bufs.vtcm_dst = vtcm + REGION_BYTES;
+    bufs.hoffsets = hoffsets;
+    bufs.woffsets = woffsets;
+
+    bench_init("hvx", argc, argv);
+    bench_run_all(kernels, ARRAY_SIZE(kernels));
+    return bench_finish();
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Interrupt delivery latency and rate, for each way of raising one:
+ *
+ *   swi         swi instruction, core interrupt SWI_IRQ
+ *   l2vic_soft  L2VIC SOFT_INT_SET of SOFT_VID
+ *   fastl2vic   SOFT_VID made pending while disabled, then enabled through
+ *               the fast L2VIC window (mapped as in fastl2vic.c)
+ *   qtimer      QTimer frame 1 armed with a 1 tick TVAL, so the latency
+ *               includes that tick
+ *
+ * and two configurations: "single", thread 0 raises and takes the
+ * interrupt, and "wait", thread 0 masks it and one of the other threads
+ * takes it out of wait mode.
+ *
+ * Latency is pcycle at the start of the handler minus pcycle right before
+ * the raising write; the distribution of SAMPLES interrupts goes to
+ * interrupts_latency.csv. Then interrupts are raised back to back, each
+ * once the previous one was handled, for the calibrated host time: in those
+ * rows every iteration is one interrupt, so iters / host_ms is the
+ * sustainable rate in interrupts per millisecond.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <hexagon_standalone.h>
+#include "cfgtable.h"
+#include "interrupts.h"
+#include "bench.h"
+
+#define SWI_IRQ         1
+#define L2VIC_IRQ       2
+
+#define SOFT_VID        66
+#ifdef IRQ1
+#define QTIMER_VID      IRQ1
+#else
+#define QTIMER_VID      3
+#endif
+
+#define SAMPLES         1000
+#define SPIN_LIMIT      10000000
+#define MAX_WAITERS     3
+#define STACK_SIZE      4096
+
+#define FASTL2VIC_VA    0x888e0000
+
+#define L2VIC_REG(off, n) \
+    ((volatile uint32_t *)(l2vic_base + (off) + 4 * ((n) / 32)))
+#define L2VIC_INT_ENABLE_CLEAR(n)   L2VIC_REG(0x180, n)
+#define L2VIC_INT_ENABLE_SET(n)     L2VIC_REG(0x200, n)
+#define L2VIC_INT_TYPE(n)           L2VIC_REG(0x280, n)
+#define L2VIC_SOFT_INT_SET(n)       L2VIC_REG(0x480, n)
+#define IRQ_BIT(n)                  (1u << ((n) % 32))
+
+#define QTMR_AC_CNTACR  ((volatile uint32_t *)(qtmr_base + 0x40))
+#define QTMR_CNTP_TVAL  ((volatile uint32_t *)(qtmr_base + 0x1028))
+#define QTMR_CNTP_CTL   ((volatile uint32_t *)(qtmr_base + 0x102c))
+
+struct irq_path {
+    const char *name;
+    void (*setup)(void);
+    void (*raise)(void);
+    void (*teardown)(void);
+    /* The handler re-enables the L2VIC vid that was delivered */
+    int reenable;
+};
+
+static uint32_t l2vic_base;
+static uint32_t qtmr_base;
+static volatile uint32_t *const fastl2vic = (uint32_t *)FASTL2VIC_VA;
+
+static const struct irq_path *path;
+static volatile uint32_t handled;
+static volatile uint64_t raise_pcycle;
+static volatile uint64_t handler_pcycle;
+static volatile int delivery_failed;
+
+static uint32_t waiter_mask;
+static volatile int waiting;
+static char stacks[MAX_WAITERS][STACK_SIZE] __attribute__((aligned(8)));
+static uint32_t samples[SAMPLES];
+
+static void swi_handler(int intno)
+{
+    handler_pcycle = bench_pcycle();
+    handled++;
+}
+
+static void l2vic_handler(int intno)
+{
+    uint32_t vid;
+
+    handler_pcycle = bench_pcycle();
+    asm volatile("%0 = VID\n\t" : "=r"(vid));
+    if (vid == QTIMER_VID) {
+        *QTMR_CNTP_CTL = 0;
+    }
+    if (path->reenable) {
+        *L2VIC_INT_ENABLE_SET(vid) = IRQ_BIT(vid);
+    }
+    handled++;
+}
+
+static void swi_raise(void)
+{
+    raise_pcycle = bench_pcycle();
+    swi(1 << SWI_IRQ);
+}
+
+static void soft_setup(void)
+{
+    *L2VIC_INT_TYPE(SOFT_VID) |= IRQ_BIT(SOFT_VID); /* Edge */
+    *L2VIC_INT_ENABLE_SET(SOFT_VID) = IRQ_BIT(SOFT_VID);
+}
+
+static void soft_raise(void)
+{
+    raise_pcycle = bench_pcycle();
+    *L2VIC_SOFT_INT_SET(SOFT_VID) = IRQ_BIT(SOFT_VID);
+}
+
+static void soft_teardown(void)
+{
+    *L2VIC_INT_ENABLE_CLEAR(SOFT_VID) = IRQ_BIT(SOFT_VID);
+}
+
+static void fast_setup(void)
+{
+    *L2VIC_INT_TYPE(SOFT_VID) |= IRQ_BIT(SOFT_VID); /* Edge */
+    *L2VIC_INT_ENABLE_CLEAR(SOFT_VID) = IRQ_BIT(SOFT_VID);
+}
+
+static void fast_raise(void)
+{
+    *L2VIC_SOFT_INT_SET(SOFT_VID) = IRQ_BIT(SOFT_VID);
+    raise_pcycle = bench_pcycle();
+    *fastl2vic = SOFT_VID;
+}
+
+static void qtimer_setup(void)
+{
+    *QTMR_AC_CNTACR = 0x3f;
+    *QTMR_CNTP_CTL = 0;
+    *L2VIC_INT_ENABLE_CLEAR(QTIMER_VID) = IRQ_BIT(QTIMER_VID);
+    *L2VIC_INT_TYPE(QTIMER_VID) &= ~IRQ_BIT(QTIMER_VID);
+    *L2VIC_INT_ENABLE_SET(QTIMER_VID) = IRQ_BIT(QTIMER_VID);
+}
+
+static void qtimer_raise(void)
+{
+    raise_pcycle = bench_pcycle();
+    *QTMR_CNTP_TVAL = 1;
+    *QTMR_CNTP_CTL = 1;
+}
+
+static void qtimer_teardown(void)
+{
+    *QTMR_CNTP_CTL = 0;
+    *L2VIC_INT_ENABLE_CLEAR(QTIMER_VID) = IRQ_BIT(QTIMER_VID);
+}
+
+static const struct irq_path paths[] = {
+    /* name, setup, raise, teardown, handler re-enables */
+    { "swi",        NULL,         swi_raise,    NULL,            0 },
+    { "l2vic_soft", soft_setup,   soft_raise,   soft_teardown,   1 },
+    { "fastl2vic",  fast_setup,   fast_raise,   soft_teardown,   0 },
+    { "qtimer",     qtimer_setup, qtimer_raise, qtimer_teardown, 1 },
+};
+
+static uint32_t read_modectl(void)
+{
+    uint32_t modectl;
+    asm volatile("%0 = modectl\n\t" : "=r"(modectl));
+    return modectl;
+}
+
+/* MODECTL.W: threads in wait mode */
+static void wait_for_waiters(void)
+{
+    while (((read_modectl() >> 16) & waiter_mask) != waiter_mask) {
+    }
+}
+
+static void waiter(void *arg)
+{
+    set_thread_imask(0);
+    while (waiting) {
+        wait_for_interrupts();
+    }
+}
+
+static void start_waiters(uint32_t n)
+{
+    waiting = 1;
+    waiter_mask = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        thread_create(waiter, &stacks[i][STACK_SIZE - 16], i + 1, NULL);
+        waiter_mask |= 1 << (i + 1);
+    }
+    wait_for_waiters();
+}
+
+static void stop_waiters(void)
+{
+    wait_for_waiters();
+    waiting = 0;
+    asm volatile("resume(%0)\n\t" : : "r"(waiter_mask));
+    thread_join(waiter_mask);
+    waiter_mask = 0;
+}
+
+/* Raises one interrupt and waits until it was handled */
+static int deliver(void)
+{
+    uint32_t n = handled;
+
+    if (waiter_mask) {
+        wait_for_waiters();
+    }
+    path->raise();
+    for (uint32_t i = 0; handled == n; i++) {
+        if (i == SPIN_LIMIT) {
+            delivery_failed = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void run_rate(uint32_t iters, void *arg)
+{
+    for (uint32_t i = 0; i < iters && !delivery_failed; i++) {
+        deliver();
+    }
+}
+
+static void run_path(const struct irq_path *p, const char *param)
+{
+    path = p;
+    delivery_failed = 0;
+    if (p->setup) {
+        p->setup();
+    }
+
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        if (!deliver()) {
+            break;
+        }
+        samples[i] = handler_pcycle - raise_pcycle;
+    }
+    if (!delivery_failed) {
+        bench_report_latency(p->name, param, samples, SAMPLES);
+
+        /* name, param, fn, arg, packets, insts, vectors, bytes */
+        bench_kernel k = { p->name, param, run_rate, NULL, 0, 0, 0, 0 };
+        bench_result r = bench_run(&k);
+        bench_report(&k, &r);
+    }
+    if (delivery_failed) {
+        bench_error(p->name, "interrupt not delivered");
+    }
+
+    if (p->teardown) {
+        p->teardown();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char param[32];
+    uint32_t subsystem_base = GET_SUBSYSTEM_BASE();
+    uint32_t waiters = bench_max_threads() - 1;
+
+    if (waiters > MAX_WAITERS) {
+        waiters = MAX_WAITERS;
+    }
+    l2vic_base = subsystem_base + 0x10000;
+    qtmr_base = subsystem_base + 0x20000;
+    add_translation((void *)subsystem_base, (void *)subsystem_base, 4);
+    add_translation_extended(3, (void *)fastl2vic, GET_FASTL2VIC_BASE(), 16,
+                             7, 4, 0, 0, 3);
+
+    register_interrupt(SWI_IRQ, swi_handler);
+    register_interrupt(L2VIC_IRQ, l2vic_handler);
+
+    bench_init("interrupts", argc, argv);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(paths); i++) {
+        if (!bench_selected(paths[i].name)) {
+            continue;
+        }
+        set_thread_imask(0);
+        run_path(&paths[i], "config=single");
+
+        if (waiters) {
+            snprintf(param, sizeof(param), "config=wait;waiters=%u",
+                     (unsigned)waiters);
+            set_thread_imask(~0u);
+            start_waiters(waiters);
+            run_path(&paths[i], param);
+            stop_waiters();
+            set_thread_imask(0);
+        }
+    }
+    return bench_finish();
+}
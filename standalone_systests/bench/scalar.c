@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Scalar core throughput: hardware loops of 8 packets of one instruction
+ * class each (ALU, multiply, shifts, predicated jumps, hardware loops,
+ * loads/stores with each addressing mode, .new forwarding). The emulated
+ * MIPS of each kernel tracks the cost of that class in the TCG frontend.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bench.h"
+
+/* Loads/stores stay within the first 128 bytes, see the setups below */
+uint32_t scalar_buf[64] __attribute__((aligned(64)));
+
+#define CIRC_LEN 64
+
+#define BUF_SETUP \
+    "r10 = %[buf]\n\t" \
+    "r11 = add(r10, #32)\n\t"
+
+#define INDEX_SETUP \
+    "r10 = %[buf]\n\t" \
+    "r11 = #1\n\t" \
+    "r12 = #2\n\t"
+
+#define CIRC_SETUP \
+    BUF_SETUP \
+    "r12 = #" STR(CIRC_LEN) "\n\t" \
+    "m0 = r12\n\t" \
+    "m1 = r12\n\t" \
+    "cs0 = r10\n\t" \
+    "cs1 = r11\n\t"
+
+#define DECLARE_KERNEL(NAME, SETUP, BODY) \
+    static void NAME(uint32_t iters, void *buf) \
+    { \
+        asm volatile(SETUP BODY \
+                     : \
+                     : [iters] "r"(iters), [buf] "r"(buf) \
+                     : "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", \
+                       "r10", "r11", "r12", "p0", "m0", "m1", \
+                       "lc0", "sa0", "lc1", "sa1", "memory"); \
+    }
+
+#define PKT_JUMP_TAKEN \
+    "{ p0 = cmp.eq(r0, r0); if (p0.new) jump:t 2f }\n2:"
+#define PKT_JUMP_NOT_TAKEN \
+    "{ p0 = cmp.eq(r0, r1); if (p0.new) jump:nt 2f }\n2:"
+#define PKT_NEWVAL_JUMP \
+    "{ r0 = add(r0, #1); if (cmp.eq(r0.new, #0)) jump:nt 2f }\n2:"
+#define PKT_FILL "{ r2 = add(r2, #1) }"
+
+DECLARE_KERNEL(k_alu, "",
+    LOOP8("{ r0 = add(r0, r1); r2 = sub(r2, r3); r4 = and(r4, r5); r6 = or(r6, r7) }",
+          "{ r0 = add(r0, r1); r2 = sub(r2, r3); r4 = and(r4, r5); r6 = or(r6, r7) }"))
+DECLARE_KERNEL(k_alu_serial, "",
+    LOOP8("{ r0 = add(r0, #1) }", "{ r0 = add(r0, #1) }"))
+DECLARE_KERNEL(k_mpy, "",
+    LOOP8("{ r1:0 += mpy(r2, r3); r5:4 += mpy(r6, r7) }",
+          "{ r1:0 += mpy(r2, r3); r5:4 += mpy(r6, r7) }"))
+DECLARE_KERNEL(k_shift, "",
+    LOOP8("{ r0 = asl(r0, #1); r2 = lsr(r2, r3) }",
+          "{ r4 = asr(r4, #3); r6 = lsl(r6, r7) }"))
+DECLARE_KERNEL(k_jump_taken, "",
+    LOOP8(PKT_JUMP_TAKEN, PKT_FILL))
+DECLARE_KERNEL(k_jump_not_taken, "r1 = add(r0, #1)\n\t",
+    LOOP8(PKT_JUMP_NOT_TAKEN, PKT_FILL))
+DECLARE_KERNEL(k_pred_new, "",
+    LOOP8("{ p0 = cmp.gt(r0, r1); if (p0.new) r2 = add(r2, #1); if (!p0.new) r3 = add(r3, #1) }",
+          "{ p0 = cmp.gt(r0, r1); if (p0.new) r2 = add(r2, #1); if (!p0.new) r3 = add(r3, #1) }"))
+DECLARE_KERNEL(k_hwloop, "",
+    "loop1(1f, %[iters])\n\t"
+    ".falign\n"
+    "1:\n\t"
+    "{ loop0(2f, #8) }\n\t"
+    "2:\n\t"
+    "{ r0 = add(r0, #1) }:endloop0\n\t"
+    "{ r1 = add(r1, #1) }:endloop1\n\t")
+DECLARE_KERNEL(k_ld_offset, BUF_SETUP,
+    LOOP8("{ r0 = memw(r10 + #0); r1 = memw(r10 + #4) }",
+          "{ r2 = memw(r10 + #8); r3 = memw(r10 + #12) }"))
+DECLARE_KERNEL(k_ld_dword, BUF_SETUP,
+    LOOP8("{ r1:0 = memd(r10 + #0); r3:2 = memd(r10 + #8) }",
+          "{ r5:4 = memd(r10 + #16); r7:6 = memd(r10 + #24) }"))
+DECLARE_KERNEL(k_ld_postinc, BUF_SETUP,
+    LOOP8("{ r0 = memw(r10++#4); r1 = memw(r11++#4) }",
+          "{ r0 = memw(r10++#-4); r1 = memw(r11++#-4) }"))
+DECLARE_KERNEL(k_ld_indexed, INDEX_SETUP,
+    LOOP8("{ r0 = memw(r10 + r11 << #2); r1 = memw(r10 + r12 << #2) }",
+          "{ r2 = memw(r10 + r11 << #3); r3 = memw(r10 + r12 << #3) }"))
+DECLARE_KERNEL(k_ld_circ, CIRC_SETUP,
+    LOOP8("{ r0 = memw(r10++#4:circ(m0)); r1 = memw(r11++#4:circ(m1)) }",
+          "{ r2 = memw(r10++#4:circ(m0)); r3 = memw(r11++#4:circ(m1)) }"))
+DECLARE_KERNEL(k_ld_abs, "",
+    LOOP8("{ r0 = memw(##scalar_buf); r2 = add(r2, #1) }",
+          "{ r1 = memw(##scalar_buf+4); r3 = add(r3, #1) }"))
+DECLARE_KERNEL(k_st_offset, BUF_SETUP,
+    LOOP8("{ memw(r10 + #0) = r0; memw(r10 + #4) = r1 }",
+          "{ memw(r10 + #8) = r2; memw(r10 + #12) = r3 }"))
+DECLARE_KERNEL(k_st_postinc, BUF_SETUP,
+    LOOP8("{ memw(r10++#4) = r0; memw(r11++#4) = r1 }",
+          "{ memw(r10++#-4) = r0; memw(r11++#-4) = r1 }"))
+DECLARE_KERNEL(k_st_indexed, INDEX_SETUP,
+    LOOP8("{ memw(r10 + r11 << #2) = r0; memw(r10 + r12 << #2) = r1 }",
+          "{ memw(r10 + r11 << #3) = r2; memw(r10 + r12 << #3) = r3 }"))
+DECLARE_KERNEL(k_st_circ, CIRC_SETUP,
+    LOOP8("{ memw(r10++#4:circ(m0)) = r0; memw(r11++#4:circ(m1)) = r1 }",
+          "{ memw(r10++#4:circ(m0)) = r2; memw(r11++#4:circ(m1)) = r3 }"))
+DECLARE_KERNEL(k_ld_st, BUF_SETUP,
+    LOOP8("{ r0 = memw(r10 + #0); memw(r10 + #8) = r1 }",
+          "{ r2 = memw(r10 + #4); memw(r10 + #12) = r3 }"))
+DECLARE_KERNEL(k_newval_store, BUF_SETUP,
+    LOOP8("{ r0 = add(r0, #1); memw(r10 + #0) = r0.new }",
+          "{ r1 = add(r1, #1); memw(r10 + #4) = r1.new }"))
+DECLARE_KERNEL(k_newval_jump, "",
+    LOOP8(PKT_NEWVAL_JUMP, PKT_FILL))
+
+static const bench_kernel kernels[] = {
+    /* name, param, fn, arg, packets, insts, vectors, bytes per iteration */
+    { "alu",            NULL, k_alu,            NULL,       8, 32, 0,  0 },
+    { "alu_serial",     NULL, k_alu_serial,     NULL,       8,  8, 0,  0 },
+    { "mpy",            NULL, k_mpy,            NULL,       8, 16, 0,  0 },
+    { "shift",          NULL, k_shift,          NULL,       8, 16, 0,  0 },
+    { "jump_taken",     NULL, k_jump_taken,     NULL,       8, 12, 0,  0 },
+    { "jump_not_taken", NULL, k_jump_not_taken, NULL,       8, 12, 0,  0 },
+    { "pred_new",       NULL, k_pred_new,       NULL,       8, 24, 0,  0 },
+    { "hwloop",         NULL, k_hwloop,         NULL,      10, 10, 0,  0 },
+    { "ld_offset",      NULL, k_ld_offset,      scalar_buf, 8, 16, 0, 64 },
+    { "ld_dword",       NULL, k_ld_dword,       scalar_buf, 8, 16, 0, 128 },
+    { "ld_postinc",     NULL, k_ld_postinc,     scalar_buf, 8, 16, 0, 64 },
+    { "ld_indexed",     NULL, k_ld_indexed,     scalar_buf, 8, 16, 0, 64 },
+    { "ld_circ",        NULL, k_ld_circ,        scalar_buf, 8, 16, 0, 64 },
+    { "ld_abs",         NULL, k_ld_abs,         scalar_buf, 8, 16, 0, 32 },
+    { "st_offset",      NULL, k_st_offset,      scalar_buf, 8, 16, 0, 64 },
+    { "st_postinc",     NULL, k_st_postinc,     scalar_buf, 8, 16, 0, 64 },
+    { "st_indexed",     NULL, k_st_indexed,     scalar_buf, 8, 16, 0, 64 },
+    { "st_circ",        NULL, k_st_circ,        scalar_buf, 8, 16, 0, 64 },
+    { "ld_st",          NULL, k_ld_st,          scalar_buf, 8, 16, 0, 64 },
+    { "newval_store",   NULL, k_newval_store,   scalar_buf, 8, 16, 0, 32 },
+    { "newval_jump",    NULL, k_newval_jump,    NULL,       8, 12, 0,  0 },
+};
+
+int main(int argc, char **argv)
+{
+    bench_init("scalar", argc, argv);
+    bench_run_all(kernels, ARRAY_SIZE(kernels));
+    return bench_finish();
+}
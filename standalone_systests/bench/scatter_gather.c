@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * VTCM scatter/gather scaling: every scatter/gather form (plain, accumulate
+ * and predicated scatters, plain and predicated gathers) with halfword
+ * offsets (.h), word offsets (.w) and halfword elements with word offsets
+ * (.hw, the 16_32 form of standalone_vec), swept over
+ *   - the region size, up to all of the 2MB VTCM (64KB for .h, whose
+ *     offsets are 16 bits),
+ *   - the offset pattern: sequential, strided across the region, random,
+ *     and all lanes on the same address,
+ *   - 1 to 4 hardware threads issuing into the same region at once.
+ *
+ * Before it is timed, each form/pattern/region is run once on one thread and
+ * the region (or the gathered vector) is checked against a C scatter/gather,
+ * like the scalar_scatter_* and scalar_gather_* references of
+ * standalone_vec.
+ *
+ * The vectors/bytes columns add up all threads, so mvec_per_sec is the
+ * aggregate scatter/gather rate.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "cfgtable.h"
+#include "thread_common.h"
+#include "vtcm_common.h"
+#include "bench.h"
+
+#ifndef LOG2VLEN
+#define LOG2VLEN 7
+#endif
+#define VLEN (1 << LOG2VLEN)
+
+#define SG_MAX_THREADS 4
+
+/* Gather destinations at the end of VTCM, the region is everything before */
+#define VTCM_BYTES      (VTCM_SIZE_KB * VTCM_BYTES_PER_KB)
+#define GATHER_BYTES    0x1000
+#define REGION_MAX      (VTCM_BYTES - GATHER_BYTES)
+#define REGION_MAX_H    0x10000
+
+#define FILL_CHAR       0x5a
+
+/* Per-thread arguments, the asm loads the pointers by offset */
+struct sg_args {
+    void *region;       /* #0 */
+    uint32_t mask;      /* #4: region size - 1 */
+    void *offsets;      /* #8: v6 (.h/.w), v7:6 (.hw) */
+    void *values;       /* #12: v3 */
+    void *preds;        /* #16: q0 */
+    void *dst;          /* #20: gather destination, 2 vectors */
+    bench_fn kernel;
+};
+
+/*
+ * r14: region, m0: region size - 1, v7:6: offsets, v3: values, q0: lanes
+ * enabled in the predicate vector, r12: gather destination
+ */
+#define SG_SETUP \
+    "r14 = memw(%[arg] + #0)\n\t" \
+    "r13 = memw(%[arg] + #4)\n\t" \
+    "m0 = r13\n\t" \
+    "r13 = memw(%[arg] + #8)\n\t" \
+    "v6 = vmem(r13 + #0)\n\t" \
+    "v7 = vmem(r13 + #1)\n\t" \
+    "r13 = memw(%[arg] + #12)\n\t" \
+    "v3 = vmem(r13 + #0)\n\t" \
+    "r13 = memw(%[arg] + #16)\n\t" \
+    "v4 = vmem(r13 + #0)\n\t" \
+    "r13 = #-1\n\t" \
+    "q0 = vand(v4, r13)\n\t" \
+    "r12 = memw(%[arg] + #20)\n\t"
+
+/* Scatters complete before the kernel returns */
+#define SCATTER_SYNC \
+    "vmem(r14 + #0):scatter_release\n\t" \
+    "v0 = vmem(r14 + #0)\n\t"
+
+#define DECLARE_KERNEL(NAME, BODY) \
+    static void NAME(uint32_t iters, void *arg) \
+    { \
+        asm volatile(SG_SETUP BODY \
+                     : \
+                     : [iters] "r"(iters), [arg] "r"(arg) \
+                     : "r12", "r13", "r14", "m0", "v0", "v3", "v4", "v6", \
+                       "v7", "q0", "lc0", "sa0", "memory"); \
+    }
+
+#define SCATTER(OP) LOOP8(OP, OP) SCATTER_SYNC
+#define GATHER(OP) \
+    LOOP8("{ " OP "; vmem(r12 + #0) = vtmp.new }", \
+          "{ " OP "; vmem(r12 + #1) = vtmp.new }")
+
+DECLARE_KERNEL(k_vscatter_h,
+    SCATTER("{ vscatter(r14, m0, v6.h).h = v3 }"))
+DECLARE_KERNEL(k_vscatteracc_h,
+    SCATTER("{ vscatter(r14, m0, v6.h).h += v3 }"))
+DECLARE_KERNEL(k_vscatter_q_h,
+    SCATTER("{ if (q0) vscatter(r14, m0, v6.h).h = v3 }"))
+DECLARE_KERNEL(k_vgather_h,
+    GATHER("vtmp.h = vgather(r14, m0, v6.h).h"))
+DECLARE_KERNEL(k_vgather_q_h,
+    GATHER("if (q0) vtmp.h = vgather(r14, m0, v6.h).h"))
+
+DECLARE_KERNEL(k_vscatter_w,
+    SCATTER("{ vscatter(r14, m0, v6.w).w = v3 }"))
+DECLARE_KERNEL(k_vscatteracc_w,
+    SCATTER("{ vscatter(r14, m0, v6.w).w += v3 }"))
+DECLARE_KERNEL(k_vscatter_q_w,
+    SCATTER("{ if (q0) vscatter(r14, m0, v6.w).w = v3 }"))
+DECLARE_KERNEL(k_vgather_w,
+    GATHER("vtmp.w = vgather(r14, m0, v6.w).w"))
+DECLARE_KERNEL(k_vgather_q_w,
+    GATHER("if (q0) vtmp.w = vgather(r14, m0, v6.w).w"))
+
+DECLARE_KERNEL(k_vscatter_hw,
+    SCATTER("{ vscatter(r14, m0, v7:6.w).h = v3 }"))
+DECLARE_KERNEL(k_vscatteracc_hw,
+    SCATTER("{ vscatter(r14, m0, v7:6.w).h += v3 }"))
+DECLARE_KERNEL(k_vscatter_q_hw,
+    SCATTER("{ if (q0) vscatter(r14, m0, v7:6.w).h = v3 }"))
+DECLARE_KERNEL(k_vgather_hw,
+    GATHER("vtmp.h = vgather(r14, m0, v7:6.w).h"))
+DECLARE_KERNEL(k_vgather_q_hw,
+    GATHER("if (q0) vtmp.h = vgather(r14, m0, v7:6.w).h"))
+
+enum sg_width { SG_H, SG_W, SG_HW, SG_WIDTHS };
+enum sg_form { SG_SCATTER, SG_SCATTERACC, SG_SCATTER_Q, SG_GATHER, SG_GATHER_Q,
+               SG_FORMS };
+enum sg_pattern { SG_SEQ, SG_STRIDED, SG_RANDOM, SG_SAME, SG_PATTERNS };
+
+static const char *const width_names[SG_WIDTHS] = { "h", "w", "hw" };
+static const char *const form_names[SG_FORMS] = {
+    "vscatter", "vscatteracc", "vscatter_q", "vgather", "vgather_q",
+};
+static const char *const pattern_names[SG_PATTERNS] = {
+    "seq", "strided", "random", "same",
+};
+
+static const bench_fn sg_kernels[SG_WIDTHS][SG_FORMS] = {
+    { k_vscatter_h, k_vscatteracc_h, k_vscatter_q_h, k_vgather_h,
+      k_vgather_q_h },
+    { k_vscatter_w, k_vscatteracc_w, k_vscatter_q_w, k_vgather_w,
+      k_vgather_q_w },
+    { k_vscatter_hw, k_vscatteracc_hw, k_vscatter_q_hw, k_vgather_hw,
+      k_vgather_q_hw },
+};
+
+static const uint32_t region_sizes[] = {
+    0x4000, 0x10000, 0x40000, REGION_MAX,
+};
+
+/*
+ * Offsets/values/predicates per element of the values vector ("lane"). For
+ * .hw, lane 2i+j takes its offset from word i of vector j of the pair.
+ */
+#define MAX_LANES (VLEN / 2)
+static uint32_t lane_offsets[MAX_LANES];
+static uint32_t lane_values[MAX_LANES];
+static uint8_t lane_preds[MAX_LANES];
+
+static uint8_t offsets[2 * VLEN] __attribute__((aligned(VLEN)));
+static uint8_t values[VLEN] __attribute__((aligned(VLEN)));
+static uint8_t preds[VLEN] __attribute__((aligned(VLEN)));
+
+/* Expected region contents, in DDR */
+static uint8_t ref_region[REGION_MAX] __attribute__((aligned(VLEN)));
+static uint8_t ref_gather[VLEN] __attribute__((aligned(VLEN)));
+
+static uint8_t *vtcm;
+static struct sg_args args[SG_MAX_THREADS];
+static void *thread_args[SG_MAX_THREADS];
+static uint32_t nthreads;
+
+static uint32_t elem_size(enum sg_width w)
+{
+    return w == SG_W ? 4 : 2;
+}
+
+static uint32_t lanes(enum sg_width w)
+{
+    return VLEN / elem_size(w);
+}
+
+static uint32_t lcg_state;
+
+static uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return lcg_state >> 8;
+}
+
+/*
+ * The value stored by a lane only depends on its offset, so lanes hitting
+ * the same element store the same value whichever of them lands last.
+ */
+static uint32_t value_for(uint32_t offset)
+{
+    return (offset * 0x9e3779b1) ^ 0x01234567;
+}
+
+static void create_lanes(enum sg_width w, enum sg_pattern p, uint32_t size)
+{
+    uint32_t esize = elem_size(w);
+    uint32_t n = lanes(w);
+    uint32_t stride = size / n & ~(esize - 1);
+
+    lcg_state = size ^ (p << 24) ^ w;
+    for (uint32_t i = 0; i < n; i++) {
+        switch (p) {
+        case SG_SEQ:
+            lane_offsets[i] = i * esize;
+            break;
+        case SG_STRIDED:
+            lane_offsets[i] = i * stride;
+            break;
+        case SG_RANDOM:
+            lane_offsets[i] = lcg() % (size / esize) * esize;
+            break;
+        case SG_SAME:
+            lane_offsets[i] = 0;
+            break;
+        default:
+            break;
+        }
+        lane_values[i] = value_for(lane_offsets[i]);
+        lane_preds[i] = i % 3 == 0 || i % 5 == 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (w == SG_H) {
+            ((uint16_t *)offsets)[i] = lane_offsets[i];
+        } else if (w == SG_W) {
+            ((uint32_t *)offsets)[i] = lane_offsets[i];
+        } else {
+            ((uint32_t *)offsets)[(i & 1) * (VLEN / 4) + i / 2] =
+                lane_offsets[i];
+        }
+        if (esize == 2) {
+            ((uint16_t *)values)[i] = lane_values[i];
+            ((uint16_t *)preds)[i] = lane_preds[i] ? 0xffff : 0;
+        } else {
+            ((uint32_t *)values)[i] = lane_values[i];
+            ((uint32_t *)preds)[i] = lane_preds[i] ? 0xffffffff : 0;
+        }
+    }
+}
+
+static uint32_t load_elem(const uint8_t *p, uint32_t esize)
+{
+    return esize == 2 ? *(const uint16_t *)p : *(const uint32_t *)p;
+}
+
+static void store_elem(uint8_t *p, uint32_t esize, uint32_t val)
+{
+    if (esize == 2) {
+        *(uint16_t *)p = val;
+    } else {
+        *(uint32_t *)p = val;
+    }
+}
+
+/* One scatter of every lane using C */
+static void scalar_scatter(uint8_t *region, enum sg_width w, enum sg_form f)
+{
+    uint32_t esize = elem_size(w);
+
+    for (uint32_t i = 0; i < lanes(w); i++) {
+        uint8_t *p = region + lane_offsets[i];
+        if (f == SG_SCATTERACC) {
+            store_elem(p, esize, load_elem(p, esize) + lane_values[i]);
+        } else if (f == SG_SCATTER || lane_preds[i]) {
+            store_elem(p, esize, lane_values[i]);
+        }
+    }
+}
+
+/* One gather of every lane using C */
+static void scalar_gather(uint8_t *dst, const uint8_t *region,
+                          enum sg_width w, enum sg_form f)
+{
+    uint32_t esize = elem_size(w);
+
+    for (uint32_t i = 0; i < lanes(w); i++) {
+        if (f == SG_GATHER || lane_preds[i]) {
+            store_elem(dst + i * esize, esize,
+                       load_elem(region + lane_offsets[i], esize));
+        }
+    }
+}
+
+/* Region contents for the gathers, distinct per word */
+static void fill_region(uint8_t *region, uint32_t size)
+{
+    for (uint32_t i = 0; i < size / 4; i++) {
+        ((uint32_t *)region)[i] = i * 0x9e3779b1;
+    }
+}
+
+static void set_hvx_context(uint32_t n)
+{
+    asm volatile("r1 = ssr\n\t"
+                 "r1 = and(r1, ##0xc7ffffff)\n\t"
+                 "r1 = or(r1, %0)\n\t"
+                 "ssr = r1\n\t"
+                 "isync\n\t"
+                 :
+                 : "r"(n << 27)
+                 : "r1");
+}
+
+/* Runs on each thread, with its own HVX context */
+static void sg_thread(uint32_t iters, void *arg)
+{
+    struct sg_args *a = arg;
+    set_hvx_context(get_htid());
+    a->kernel(iters, a);
+}
+
+static void sg_run(uint32_t iters, void *arg)
+{
+    bench_parallel(sg_thread, iters, thread_args, nthreads);
+}
+
+static void setup_args(bench_fn kernel, uint32_t size)
+{
+    for (uint32_t t = 0; t < SG_MAX_THREADS; t++) {
+        args[t].region = vtcm;
+        args[t].mask = size - 1;
+        args[t].offsets = offsets;
+        args[t].values = values;
+        args[t].preds = preds;
+        args[t].dst = vtcm + REGION_MAX + t * 2 * VLEN;
+        args[t].kernel = kernel;
+        thread_args[t] = &args[t];
+    }
+}
+
+/* One iteration (8 scatters/gathers) on one thread against the C version */
+static void check(const char *name, enum sg_width w, enum sg_form f,
+                  uint32_t size)
+{
+    uint8_t *dst = args[0].dst;
+
+    nthreads = 1;
+    if (f == SG_GATHER || f == SG_GATHER_Q) {
+        fill_region(vtcm, size);
+        memset(dst, FILL_CHAR, 2 * VLEN);
+        memset(ref_gather, FILL_CHAR, VLEN);
+        sg_run(1, NULL);
+        scalar_gather(ref_gather, vtcm, w, f);
+        if (memcmp(dst, ref_gather, VLEN) ||
+            memcmp(dst + VLEN, ref_gather, VLEN)) {
+            bench_error(name, "gathered vector differs from the C gather");
+        }
+    } else {
+        memset(vtcm, FILL_CHAR, size);
+        memset(ref_region, FILL_CHAR, size);
+        sg_run(1, NULL);
+        for (int i = 0; i < 8; i++) {
+            scalar_scatter(ref_region, w, f);
+        }
+        if (memcmp(vtcm, ref_region, size)) {
+            bench_error(name, "region differs from the C scatter");
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char name[32];
+    char param[64];
+    uint32_t max_threads = bench_max_threads();
+    uint32_t contexts = read_cfgtable_field(CFGTABLE_HVX_CONTEXTS);
+
+    vtcm = setup_default_vtcm();
+    if (max_threads > contexts) {
+        max_threads = contexts;
+    }
+    if (max_threads > SG_MAX_THREADS) {
+        max_threads = SG_MAX_THREADS;
+    }
+
+    printf("# %d threads, %d HVX contexts\n", (int)max_threads,
+           (int)contexts);
+    bench_init("scatter_gather", argc, argv);
+
+    for (int w = 0; w < SG_WIDTHS; w++) {
+        for (int f = 0; f < SG_FORMS; f++) {
+            snprintf(name, sizeof(name), "%s_%s", form_names[f],
+                     width_names[w]);
+            if (!bench_selected(name)) {
+                continue;
+            }
+            int gather = f == SG_GATHER || f == SG_GATHER_Q;
+            for (uint32_t s = 0; s < ARRAY_SIZE(region_sizes); s++) {
+                uint32_t size = region_sizes[s];
+                if (w == SG_H && size > REGION_MAX_H) {
+                    continue;
+                }
+                for (int p = 0; p < SG_PATTERNS; p++) {
+                    create_lanes(w, p, size);
+                    setup_args(sg_kernels[w][f], size);
+                    check(name, w, f, size);
+
+                    for (nthreads = 1; nthreads <= max_threads; nthreads++) {
+                        snprintf(param, sizeof(param),
+                                 "region=%uK;pattern=%s;threads=%u",
+                                 (unsigned)(size / 1024), pattern_names[p],
+                                 (unsigned)nthreads);
+                        /* name, param, fn, arg, packets, insts, vectors, bytes */
+                        bench_kernel k = {
+                            name, param, sg_run, NULL,
+                            8 * nthreads, (gather ? 16 : 8) * nthreads,
+                            8 * nthreads,
+                            (gather ? 16 : 8) * VLEN * nthreads,
+                        };
+                        bench_result r = bench_run(&k);
+                        bench_report(&k, &r);
+                    }
+                }
+            }
+        }
+    }
+    return bench_finish();
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Semihosting I/O throughput and per-call overhead. Everything goes through
+ * trap0 directly, as in semihost.c, so no libc buffering is measured.
+ *
+ *   call         one HEX_SYS_* call per iteration (op=open+close is two),
+ *                iters / host_ms is the call rate
+ *   write/read   one HEX_SYS_WRITE/READ of chunk bytes per iteration, going
+ *                through a file of the given size and seeking back to its
+ *                start at the end; files from 1K to 256M, chunks from 1 byte
+ *                to 1M. Writes put back what the file holds at their offset
+ *   bulk_read    the whole file read back with a single HEX_SYS_READ straight
+ *                into its destination, a DDR buffer or VTCM (files that fit)
+ *
+ * The files are created in the working directory and removed at the end.
+ * The file is checked against the pattern it was written with after the
+ * writes, and so is every bulk read.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vtcm_common.h"
+#include "bench.h"
+
+#define HEX_SYS_OPEN            0x01
+#define HEX_SYS_CLOSE           0x02
+#define HEX_SYS_WRITE           0x05
+#define HEX_SYS_READ            0x06
+#define HEX_SYS_ISTTY           0x09
+#define HEX_SYS_SEEK            0x0a
+#define HEX_SYS_FLEN            0x0c
+#define HEX_SYS_REMOVE          0x0e
+#define HEX_SYS_CLOCK           0x10
+#define HEX_SYS_TIME            0x11
+#define HEX_SYS_ERRNO           0x13
+#define HEX_SYS_FTELL           0x100
+#define HEX_SYS_FSTAT           0x101
+#define HEX_SYS_STAT            0x103
+#define HEX_SYS_GETCWD          0x104
+#define HEX_SYS_ACCESS          0x105
+
+/* Angel open modes */
+#define OPEN_MODE_RB            1
+#define OPEN_MODE_WPLUSB        7
+
+#define R_OK_MODE               4
+
+#define KB                      1024
+#define MB                      (1024 * 1024)
+#define MAX_CHUNK               MB
+#define VTCM_BYTES              (VTCM_SIZE_KB * VTCM_BYTES_PER_KB)
+
+struct call_op {
+    const char *name;
+    uint32_t code;
+    uint32_t args[3];
+};
+
+struct transfer {
+    uint32_t code;
+    uint32_t fd;
+    uint32_t file_size;
+    uint32_t chunk;
+    uint8_t *buf;
+    uint32_t pos;
+    int failed;
+};
+
+/* Layout of the HEX_SYS_STAT/FSTAT result, see semihost.c */
+struct sys_stat {
+    uint64_t dev;
+    uint64_t ino;
+    uint32_t mode;
+    uint32_t nlink;
+    uint64_t rdev;
+    uint32_t size;
+    uint32_t __pad1;
+    uint32_t atime;
+    uint32_t mtime;
+    uint32_t ctime;
+    uint32_t __pad2;
+};
+
+static const uint32_t file_sizes[] = { KB, 64 * KB, MB, 16 * MB, 256 * MB };
+static const uint32_t chunk_sizes[] = { 1, 64, 4 * KB, 64 * KB, MB };
+
+static uint8_t *pattern;
+static uint8_t *scratch;
+static uint8_t *vtcm;
+static struct sys_stat st;
+static char cwd[256];
+
+static uint32_t sys(uint32_t code, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    uint32_t args[3] = { a0, a1, a2 };
+    uint32_t ret;
+
+    asm volatile("r0 = %1\n\t"
+                 "r1 = %2\n\t"
+                 "trap0(#0)\n\t"
+                 "%0 = r0\n\t"
+                 : "=r"(ret)
+                 : "r"(code), "r"(args)
+                 : "r0", "r1", "memory");
+    return ret;
+}
+
+static uint32_t sys_open(const char *name, uint32_t mode)
+{
+    return sys(HEX_SYS_OPEN, (uint32_t)name, mode, strlen(name));
+}
+
+static void size_str(char *buf, size_t len, uint32_t n)
+{
+    if (n >= MB && n % MB == 0) {
+        snprintf(buf, len, "%uM", (unsigned)(n / MB));
+    } else if (n >= KB && n % KB == 0) {
+        snprintf(buf, len, "%uK", (unsigned)(n / KB));
+    } else {
+        snprintf(buf, len, "%u", (unsigned)n);
+    }
+}
+
+static void k_call(uint32_t iters, void *arg)
+{
+    const struct call_op *op = arg;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        sys(op->code, op->args[0], op->args[1], op->args[2]);
+    }
+}
+
+static void k_open_close(uint32_t iters, void *arg)
+{
+    const char *name = arg;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        sys(HEX_SYS_CLOSE, sys_open(name, OPEN_MODE_RB), 0, 0);
+    }
+}
+
+static void k_transfer(uint32_t iters, void *arg)
+{
+    struct transfer *t = arg;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        if (t->pos + t->chunk > t->file_size) {
+            sys(HEX_SYS_SEEK, t->fd, 0, 0);
+            t->pos = 0;
+        }
+        /*
+         * The file is the pattern repeated and chunks divide MAX_CHUNK. READ
+         * and WRITE return the number of bytes not transferred.
+         */
+        if (sys(t->code, t->fd, (uint32_t)(t->buf + t->pos % MAX_CHUNK),
+                t->chunk)) {
+            t->failed = 1;
+        }
+        t->pos += t->chunk;
+    }
+}
+
+static void k_bulk_read(uint32_t iters, void *arg)
+{
+    struct transfer *t = arg;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        sys(HEX_SYS_SEEK, t->fd, 0, 0);
+        if (sys(HEX_SYS_READ, t->fd, (uint32_t)t->buf, t->file_size)) {
+            t->failed = 1;
+        }
+    }
+}
+
+static void run_calls(const char *name, uint32_t fd)
+{
+    char param[32];
+    /* name, code, args */
+    const struct call_op ops[] = {
+        { "clock",  HEX_SYS_CLOCK,  { 0, 0, 0 } },
+        { "time",   HEX_SYS_TIME,   { 0, 0, 0 } },
+        { "errno",  HEX_SYS_ERRNO,  { 0, 0, 0 } },
+        { "istty",  HEX_SYS_ISTTY,  { fd, 0, 0 } },
+        { "flen",   HEX_SYS_FLEN,   { fd, 0, 0 } },
+        { "ftell",  HEX_SYS_FTELL,  { fd, 0, 0 } },
+        { "seek",   HEX_SYS_SEEK,   { fd, 0, 0 } },
+        { "fstat",  HEX_SYS_FSTAT,  { fd, (uint32_t)&st, 0 } },
+        { "stat",   HEX_SYS_STAT,   { (uint32_t)name, (uint32_t)&st, 0 } },
+        { "access", HEX_SYS_ACCESS, { (uint32_t)name, R_OK_MODE, 0 } },
+        { "getcwd", HEX_SYS_GETCWD, { (uint32_t)cwd, sizeof(cwd), 0 } },
+    };
+
+    if (!bench_selected("call")) {
+        return;
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE(ops); i++) {
+        snprintf(param, sizeof(param), "op=%s", ops[i].name);
+        /* name, param, fn, arg, packets, insts, vectors, bytes */
+        bench_kernel k = { "call", param, k_call, (void *)&ops[i],
+                           0, 0, 0, 0 };
+        bench_result r = bench_run(&k);
+        bench_report(&k, &r);
+    }
+
+    bench_kernel k = { "call", "op=open+close", k_open_close, (void *)name,
+                       0, 0, 0, 0 };
+    bench_result r = bench_run(&k);
+    bench_report(&k, &r);
+}
+
+/* Creates the file, pattern repeated, 1M per call */
+static int create_file(const char *name, uint32_t size, uint32_t *fd)
+{
+    *fd = sys_open(name, OPEN_MODE_WPLUSB);
+    if ((int32_t)*fd < 0) {
+        return 0;
+    }
+    for (uint32_t pos = 0; pos < size; pos += MAX_CHUNK) {
+        uint32_t n = size - pos < MAX_CHUNK ? size - pos : MAX_CHUNK;
+        if (sys(HEX_SYS_WRITE, *fd, (uint32_t)pattern, n)) {
+            return 0;
+        }
+    }
+    return sys(HEX_SYS_FLEN, *fd, 0, 0) == size;
+}
+
+static void run_transfers(const char *kernel, uint32_t code, uint32_t fd,
+                          uint32_t size, const char *size_name)
+{
+    char param[32], chunk_name[16];
+
+    if (!bench_selected(kernel)) {
+        return;
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE(chunk_sizes); i++) {
+        uint32_t chunk = chunk_sizes[i];
+        if (chunk > size) {
+            break;
+        }
+        /* The writes put the same pattern back, the reads don't touch it */
+        uint8_t *buf = code == HEX_SYS_WRITE ? pattern : scratch;
+        struct transfer t = { code, fd, size, chunk, buf, 0, 0 };
+
+        size_str(chunk_name, sizeof(chunk_name), chunk);
+        snprintf(param, sizeof(param), "file=%s;chunk=%s", size_name,
+                 chunk_name);
+        sys(HEX_SYS_SEEK, fd, 0, 0);
+        /* name, param, fn, arg, packets, insts, vectors, bytes */
+        bench_kernel k = { kernel, param, k_transfer, &t, 0, 0, 0, chunk };
+        bench_result r = bench_run(&k);
+        bench_report(&k, &r);
+        if (t.failed) {
+            bench_error(kernel, "short transfer");
+        }
+    }
+}
+
+/* Whether the file still is the pattern repeated */
+static int check_file(uint32_t fd, uint32_t size)
+{
+    sys(HEX_SYS_SEEK, fd, 0, 0);
+    for (uint32_t pos = 0; pos < size; pos += MAX_CHUNK) {
+        uint32_t n = size - pos < MAX_CHUNK ? size - pos : MAX_CHUNK;
+        if (sys(HEX_SYS_READ, fd, (uint32_t)scratch, n) ||
+            memcmp(scratch, pattern, n)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void run_bulk_read(uint32_t fd, uint32_t size, const char *size_name,
+                          const char *buffer, uint8_t *buf)
+{
+    char param[32];
+    struct transfer t = { HEX_SYS_READ, fd, size, size, buf, 0, 0 };
+
+    snprintf(param, sizeof(param), "file=%s;buffer=%s", size_name, buffer);
+    memset(buf, 0, size);
+    k_bulk_read(1, &t);
+    for (uint32_t pos = 0; pos < size && !t.failed; pos += MAX_CHUNK) {
+        uint32_t n = size - pos < MAX_CHUNK ? size - pos : MAX_CHUNK;
+        if (memcmp(buf + pos, pattern, n)) {
+            t.failed = 1;
+        }
+    }
+    if (t.failed) {
+        bench_error("bulk_read", "data mismatch");
+        return;
+    }
+
+    /* name, param, fn, arg, packets, insts, vectors, bytes */
+    bench_kernel k = { "bulk_read", param, k_bulk_read, &t, 0, 0, 0, size };
+    bench_result r = bench_run(&k);
+    bench_report(&k, &r);
+    if (t.failed) {
+        bench_error("bulk_read", "short transfer");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char name[48], size_name[16];
+
+    bench_init("semihost", argc, argv);
+
+    pattern = malloc(MAX_CHUNK);
+    scratch = malloc(MAX_CHUNK);
+    if (!pattern || !scratch) {
+        bench_error("semihost", "out of memory");
+        return bench_finish();
+    }
+    for (uint32_t i = 0; i < MAX_CHUNK; i++) {
+        pattern[i] = i * 7 + (i >> 8);
+    }
+    vtcm = setup_default_vtcm();
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(file_sizes); i++) {
+        uint32_t size = file_sizes[i];
+        uint32_t fd;
+
+        size_str(size_name, sizeof(size_name), size);
+        snprintf(name, sizeof(name), "semihost_bench_%s.bin", size_name);
+        if (!create_file(name, size, &fd)) {
+            bench_error("semihost", "cannot create file");
+            break;
+        }
+
+        if (i == 0) {
+            run_calls(name, fd);
+        }
+        run_transfers("write", HEX_SYS_WRITE, fd, size, size_name);
+        if (bench_selected("write") && !check_file(fd, size)) {
+            bench_error("write", "file differs from the pattern");
+        }
+        run_transfers("read", HEX_SYS_READ, fd, size, size_name);
+
+        if (bench_selected("bulk_read")) {
+            uint8_t *ddr = malloc(size);
+            if (ddr) {
+                run_bulk_read(fd, size, size_name, "ddr", ddr);
+                free(ddr);
+            } else {
+                printf("# bulk_read file=%s: no DDR buffer\n", size_name);
+            }
+            if (size <= VTCM_BYTES) {
+                run_bulk_read(fd, size, size_name, "vtcm", vtcm);
+            }
+        }
+
+        sys(HEX_SYS_CLOSE, fd, 0, 0);
+        sys(HEX_SYS_REMOVE, (uint32_t)name, strlen(name), 0);
+    }
+
+    free(scratch);
+    free(pattern);
+    return bench_finish();
+}
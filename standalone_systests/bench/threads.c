@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Hardware thread scaling: each workload runs on 1..N threads at once, N
+ * being the threads enabled in the cfgtable, and reports the aggregate rate
+ * of all threads. With a parallel TCG the compute rate should grow with the
+ * thread count; a flat line means the guest threads are serialized.
+ *
+ *   compute                independent ALU loops, no shared data
+ *   llsc_shared            memw_locked increments of one shared counter; the
+ *                          insts column only counts the successful path,
+ *                          the store-conditional failures are printed apart
+ *   counter_false_sharing  memw += #1 on per-thread counters in one line
+ *   counter_padded         the same with a cache line per counter
+ *
+ * Every run checks the final counter values.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bench.h"
+
+#define LINE_SIZE 64
+
+struct thread_args {
+    volatile uint32_t *counter;
+    uint32_t retries;
+};
+
+enum counter_placement {
+    NO_COUNTER,
+    SHARED_COUNTER,     /* one counter for all threads */
+    SAME_LINE,          /* one counter per thread, all in one cache line */
+    PADDED,             /* one counter per thread and cache line */
+};
+
+struct workload {
+    const char *name;
+    bench_fn fn;
+    uint32_t packets_per_iter;
+    uint32_t insts_per_iter;
+    uint32_t incs_per_iter;     /* counter increments per iteration */
+    enum counter_placement placement;
+};
+
+static volatile uint32_t shared_counter __attribute__((aligned(LINE_SIZE)));
+static volatile uint32_t line_counters[BENCH_MAX_THREADS]
+    __attribute__((aligned(LINE_SIZE)));
+static volatile uint32_t padded_counters[BENCH_MAX_THREADS][LINE_SIZE / 4]
+    __attribute__((aligned(LINE_SIZE)));
+
+static struct thread_args args[BENCH_MAX_THREADS];
+static void *thread_args[BENCH_MAX_THREADS];
+static const struct workload *current;
+static uint32_t nthreads;
+
+static void k_compute(uint32_t iters, void *arg)
+{
+    asm volatile(LOOP8("{ r0 = add(r0, r1); r2 = sub(r2, r3); r4 = and(r4, r5); r6 = or(r6, r7) }",
+                       "{ r0 = add(r0, r1); r2 = sub(r2, r3); r4 = and(r4, r5); r6 = or(r6, r7) }")
+                 :
+                 : [iters] "r"(iters)
+                 : "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+                   "lc0", "sa0");
+}
+
+/*
+ * One increment per iteration. A failed store-conditional counts a retry
+ * and pauses, like the atomic_inc loops of sys_atomics, so the other threads
+ * get to run in a single-threaded TCG.
+ */
+static void k_llsc(uint32_t iters, void *arg)
+{
+    struct thread_args *a = arg;
+    uint32_t retries = 0;
+
+    asm volatile("loop0(1f, %[iters])\n\t"
+                 ".falign\n"
+                 "1:\n\t"
+                 "{ r0 = memw_locked(%[counter]) }\n\t"
+                 "{ r0 = add(r0, #1) }\n\t"
+                 "{ memw_locked(%[counter], p0) = r0 }\n\t"
+                 "{ if (!p0) jump:nt 2f }\n\t"
+                 "{ r1 = add(r1, #1) }:endloop0\n\t"
+                 "jump 3f\n"
+                 "2:\n\t"
+                 "{ %[retries] = add(%[retries], #1) }\n\t"
+                 "pause(#0)\n\t"
+                 "jump 1b\n"
+                 "3:\n\t"
+                 : [retries] "+r"(retries)
+                 : [iters] "r"(iters), [counter] "r"(a->counter)
+                 : "r0", "r1", "p0", "lc0", "sa0", "memory");
+    a->retries += retries;
+}
+
+static void k_counter(uint32_t iters, void *arg)
+{
+    struct thread_args *a = arg;
+
+    asm volatile(LOOP8("{ memw(%[counter] + #0) += #1 }",
+                       "{ memw(%[counter] + #0) += #1 }")
+                 :
+                 : [iters] "r"(iters), [counter] "r"(a->counter)
+                 : "lc0", "sa0", "memory");
+}
+
+static const struct workload workloads[] = {
+    /* name, fn, packets, insts, increments per iteration, counters */
+    { "compute",               k_compute, 8, 32, 0, NO_COUNTER },
+    { "llsc_shared",           k_llsc,    5,  5, 1, SHARED_COUNTER },
+    { "counter_false_sharing", k_counter, 8,  8, 8, SAME_LINE },
+    { "counter_padded",        k_counter, 8,  8, 8, PADDED },
+};
+
+static volatile uint32_t *counter_for(enum counter_placement placement,
+                                      uint32_t t)
+{
+    switch (placement) {
+    case SHARED_COUNTER:
+        return &shared_counter;
+    case SAME_LINE:
+        return &line_counters[t];
+    case PADDED:
+        return &padded_counters[t][0];
+    default:
+        return NULL;
+    }
+}
+
+static void run(uint32_t iters, void *arg)
+{
+    const struct workload *w = current;
+
+    for (uint32_t t = 0; t < nthreads; t++) {
+        args[t].counter = counter_for(w->placement, t);
+        args[t].retries = 0;
+        if (args[t].counter) {
+            *args[t].counter = 0;
+        }
+        thread_args[t] = &args[t];
+    }
+    bench_parallel(w->fn, iters, thread_args, nthreads);
+
+    if (w->placement == NO_COUNTER) {
+        return;
+    }
+    int shared = w->placement == SHARED_COUNTER;
+    uint32_t expect = iters * w->incs_per_iter * (shared ? nthreads : 1);
+    for (uint32_t t = 0; t < (shared ? 1 : nthreads); t++) {
+        if (*args[t].counter != expect) {
+            bench_error(w->name, "lost counter increments");
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char param[32];
+    uint32_t max_threads = bench_max_threads();
+
+    printf("# %d threads\n", (int)max_threads);
+    bench_init("threads", argc, argv);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(workloads); i++) {
+        const struct workload *w = &workloads[i];
+        if (!bench_selected(w->name)) {
+            continue;
+        }
+        current = w;
+        for (nthreads = 1; nthreads <= max_threads; nthreads++) {
+            uint32_t retries = 0;
+            snprintf(param, sizeof(param), "threads=%u", (unsigned)nthreads);
+            /* name, param, fn, arg, packets, insts, vectors, bytes */
+            bench_kernel k = {
+                w->name, param, run, NULL,
+                w->packets_per_iter * nthreads, w->insts_per_iter * nthreads,
+                0, w->incs_per_iter * 4 * nthreads,
+            };
+            bench_result r = bench_run(&k);
+            bench_report(&k, &r);
+            for (uint32_t t = 0; t < nthreads; t++) {
+                retries += args[t].retries;
+            }
+            if (w->placement == SHARED_COUNTER) {
+                printf("# %s %s: %u store-conditional failures\n", w->name,
+                       param, (unsigned)retries);
+            }
+        }
+    }
+    return bench_finish();
+}
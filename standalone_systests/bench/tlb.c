@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * TLB miss and MMU translation cost.
+ *
+ * A window of pages at WINDOW_VA, one every 1 << shift bytes, all aliasing
+ * the memory of target[], is refilled on demand by our own TLB miss handler
+ * into the last SLOTS entries of the JTLB (round robin, with the ASID taken
+ * from SSR). Misses outside the window go to the runtime handler.
+ *
+ *   stream        one load per page per iteration, packets = loads. The page
+ *                 size goes from 4K to 16M ("mixed" cycles through all of
+ *                 them), with a working set that fits in SLOTS or overflows
+ *                 it: sequential round robin refill makes every load of the
+ *                 overflowing sets miss, so the ns_per_packet difference
+ *                 between the two is the cost of a miss. With asids=N every
+ *                 iteration first switches to the next of N ASIDs, each
+ *                 having its own entries for the pages.
+ *   tlbw          one tlbw per iteration
+ *   tlbinvasid    writes resident=N entries of an ASID, then tlbinvasid of
+ *                 it; subtract N tlbw rows for the invalidate alone
+ *   asid_switch   set_asid() to the other of two ASIDs and one load through
+ *                 the window, the entries of both being resident
+ *
+ * The misses per iteration of the stream rows are printed as comments. Every
+ * working set is checked against the identity mapping of its pages first.
+ *
+ * The HSV39 page sizes of hsv39_tlb.c need a v81 build and machine; this
+ * covers the v68 TLB entry format only.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define DEBUG 0
+
+#include "mmu.h"
+#include "cfgtable.h"
+#include "bench.h"
+
+#define WINDOW_VA       0x40000000
+#define WINDOW_SIZE     0x40000000
+#define SLOTS           32
+#define MAX_PAGES       (2 * SLOTS)
+#define FIRST_ASID      1
+#define ASID_PAGES      8
+#define COUNT_PASSES    8
+
+#define PAGE_BITS(size) (TARGET_PAGE_BITS + 2 * __builtin_ctz(size))
+
+/* Read by the miss handler */
+uint32_t tlb_window_start;
+uint32_t tlb_window_end;
+uint32_t tlb_page_shift;
+uint64_t *tlb_entries;
+uint32_t tlb_slot_first;
+uint32_t tlb_slot_last;
+uint32_t tlb_next_slot;
+volatile uint32_t tlb_misses;
+
+struct working_set {
+    uint32_t pages;
+    uint32_t shift;
+    uint32_t asids;
+};
+
+static uint64_t entries[MAX_PAGES];
+static uint32_t page_pa[MAX_PAGES];
+static uint32_t target[1024] __attribute__((aligned(4096)));
+
+static const PageSize page_sizes[] = {
+    PAGE_4K, PAGE_16K, PAGE_64K, PAGE_256K, PAGE_1M, PAGE_4M, PAGE_16M,
+};
+
+/*
+ * TLB miss (read/write) handler: refills the entry of a window page with the
+ * current ASID, anything else is left to the runtime.
+ */
+asm(
+".global my_event_handle_tlbmissrw\n"
+".p2align 4\n"
+"my_event_handle_tlbmissrw:\n\t"
+    "crswap(sp, sgp0)\n\t"
+    "sp = add(sp, #-32)\n\t"
+    "memd(sp + #0) = r1:0\n\t"
+    "memd(sp + #8) = r3:2\n\t"
+    "memd(sp + #16) = r5:4\n\t"
+    "r4 = p3:0\n\t"
+    "memw(sp + #24) = r4\n\t"
+    "r0 = badva\n\t"
+    "r1 = memw(##tlb_window_start)\n\t"
+    "r2 = memw(##tlb_window_end)\n\t"
+    "p0 = cmp.gtu(r1, r0)\n\t"
+    "p1 = cmp.gtu(r2, r0)\n\t"
+    "p0 = or(p0, !p1)\n\t"
+    "if (p0) jump 2f\n\t"
+    "r0 = sub(r0, r1)\n\t"
+    "r2 = memw(##tlb_page_shift)\n\t"
+    "r0 = lsr(r0, r2)\n\t"
+    "r1 = memw(##tlb_entries)\n\t"
+    "r1:0 = memd(r1 + r0 << #3)\n\t"
+    "r2 = ssr\n\t"
+    "r2 = extractu(r2, #7, #8)\n\t"         /* SSR.ASID */
+    "r1 = insert(r2, #7, #20)\n\t"          /* PTE.ASID */
+    "r2 = memw(##tlb_next_slot)\n\t"
+    "r3 = memw(##tlb_slot_last)\n\t"
+    "r4 = memw(##tlb_slot_first)\n\t"
+    "tlblock\n\t"
+    "tlbw(r1:0, r2)\n\t"
+    "isync\n\t"
+    "tlbunlock\n\t"
+    "r2 = add(r2, #1)\n\t"
+    "p0 = cmp.gtu(r2, r3)\n\t"
+    "r2 = mux(p0, r4, r2)\n\t"
+    "memw(##tlb_next_slot) = r2\n\t"
+    "r2 = memw(##tlb_misses)\n\t"
+    "r2 = add(r2, #1)\n\t"
+    "memw(##tlb_misses) = r2\n\t"
+    "r4 = memw(sp + #24)\n\t"
+    "p3:0 = r4\n\t"
+    "r5:4 = memd(sp + #16)\n\t"
+    "r3:2 = memd(sp + #8)\n\t"
+    "r1:0 = memd(sp + #0)\n\t"
+    "sp = add(sp, #32)\n\t"
+    "crswap(sp, sgp0)\n\t"
+    "rte\n"
+"2:\n\t"
+    "r4 = memw(sp + #24)\n\t"
+    "p3:0 = r4\n\t"
+    "r5:4 = memd(sp + #16)\n\t"
+    "r3:2 = memd(sp + #8)\n\t"
+    "r1:0 = memd(sp + #0)\n\t"
+    "sp = add(sp, #32)\n\t"
+    "crswap(sp, sgp0)\n\t"
+    "jump event_handle_tlbmissrw\n\t"
+);
+
+DEFAULT_EVENT_HANDLE(my_event_handle_error,       HANDLE_ERROR_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_nmi,         HANDLE_NMI_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_tlbmissx,    HANDLE_TLBMISSX_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_reset,       HANDLE_RESET_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_rsvd,        HANDLE_RSVD_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_trap0,       HANDLE_TRAP0_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_trap1,       HANDLE_TRAP1_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_int,         HANDLE_INT_OFFSET)
+DEFAULT_EVENT_HANDLE(my_event_handle_fperror,     HANDLE_FPERROR_OFFSET)
+
+/* Invalidates the managed slots and maps the window with the given sizes */
+static void map_window(uint32_t pages, uint32_t shift, const PageSize *sizes,
+                       uint32_t nsizes)
+{
+    for (uint32_t slot = tlb_slot_first; slot <= tlb_slot_last; slot++) {
+        tlbw(0, slot);
+    }
+    asm volatile("isync\n\t");
+    tlb_next_slot = tlb_slot_first;
+
+    for (uint32_t i = 0; i < pages; i++) {
+        PageSize size = sizes[i % nsizes];
+        uint32_t va = WINDOW_VA + (i << shift);
+
+        page_pa[i] = page_start((uint32_t)target, PAGE_BITS(size));
+        /* The handler fills in the ASID */
+        entries[i] = create_mmu_entry(0, 0, 0, 0, va, 0, 0, 1, 0, 7,
+                                      page_pa[i], size);
+    }
+    tlb_entries = entries;
+    tlb_page_shift = shift;
+    tlb_window_start = WINDOW_VA;
+    tlb_window_end = WINDOW_VA + (pages << shift);
+}
+
+static int check_working_set(const struct working_set *ws)
+{
+    for (uint32_t a = 0; a < ws->asids; a++) {
+        set_asid(FIRST_ASID + a);
+        for (uint32_t i = 0; i < ws->pages; i++) {
+            volatile uint32_t *va =
+                (volatile uint32_t *)(WINDOW_VA + (i << ws->shift));
+            if (*va != *(volatile uint32_t *)page_pa[i]) {
+                return 0;
+            }
+        }
+    }
+    set_asid(FIRST_ASID);
+    return 1;
+}
+
+static void k_stream(uint32_t iters, void *arg)
+{
+    const struct working_set *ws = arg;
+    uint32_t stride = 1 << ws->shift;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        uint32_t va = WINDOW_VA;
+
+        if (ws->asids > 1) {
+            set_asid(FIRST_ASID + i % ws->asids);
+        }
+        asm volatile("loop0(1f, %[pages])\n\t"
+                     ".falign\n"
+                     "1:\n\t"
+                     "{ r0 = memw(%[va] + #0); %[va] = add(%[va], %[stride]) }:endloop0\n\t"
+                     : [va] "+r"(va)
+                     : [pages] "r"(ws->pages), [stride] "r"(stride)
+                     : "r0", "lc0", "sa0", "memory");
+    }
+}
+
+static void k_tlbw(uint32_t iters, void *arg)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        uint32_t j = i % SLOTS;
+        tlbw(entries[j], tlb_slot_first + j);
+        asm volatile("isync\n\t");
+    }
+}
+
+static void k_tlbinvasid(uint32_t iters, void *arg)
+{
+    uint32_t resident = (uint32_t)arg;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        for (uint32_t j = 0; j < resident; j++) {
+            tlbw(entries[j], tlb_slot_first + j);
+        }
+        tlbinvasid(FIRST_ASID << 20);
+        asm volatile("isync\n\t");
+    }
+}
+
+static void k_asid_switch(uint32_t iters, void *arg)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        set_asid(FIRST_ASID + (i & 1));
+        asm volatile("r0 = memw(%0 + #0)\n\t"
+                     : : "r"(WINDOW_VA) : "r0", "memory");
+    }
+}
+
+static void run_stream(const char *size_name, const PageSize *sizes,
+                       uint32_t nsizes, uint32_t pages, uint32_t asids)
+{
+    char param[48];
+    struct working_set ws = { pages, 0, asids };
+
+    for (uint32_t i = 0; i < nsizes; i++) {
+        if (PAGE_BITS(sizes[i]) > ws.shift) {
+            ws.shift = PAGE_BITS(sizes[i]);
+        }
+    }
+    if (pages << ws.shift > WINDOW_SIZE) {
+        return;
+    }
+    snprintf(param, sizeof(param), "page=%s;pages=%u;asids=%u", size_name,
+             (unsigned)pages, (unsigned)asids);
+
+    map_window(pages, ws.shift, sizes, nsizes);
+    if (!check_working_set(&ws)) {
+        bench_error("stream", "bad translation");
+        return;
+    }
+
+    /* name, param, fn, arg, packets, insts, vectors, bytes */
+    bench_kernel k = { "stream", param, k_stream, &ws, pages, 2 * pages,
+                       0, 4 * pages };
+    bench_result r = bench_run(&k);
+    bench_report(&k, &r);
+
+    uint32_t misses = tlb_misses;
+    k_stream(COUNT_PASSES * asids, &ws);
+    printf("# stream %s: %u misses per iteration\n", param,
+           (unsigned)((tlb_misses - misses) / (COUNT_PASSES * asids)));
+}
+
+static void run_tlb_ops(void)
+{
+    char param[32];
+
+    map_window(SLOTS, PAGE_BITS(PAGE_4K), page_sizes, 1);
+    for (uint32_t i = 0; i < SLOTS; i++) {
+        SET_FIELD(entries[i], PTE_ASID, FIRST_ASID);
+    }
+
+    if (bench_selected("tlbw")) {
+        /* name, param, fn, arg, packets, insts, vectors, bytes */
+        bench_kernel k = { "tlbw", "", k_tlbw, NULL, 0, 0, 0, 0 };
+        bench_result r = bench_run(&k);
+        bench_report(&k, &r);
+    }
+
+    if (bench_selected("tlbinvasid")) {
+        static const uint32_t resident[] = { 0, 1, SLOTS };
+        for (uint32_t i = 0; i < ARRAY_SIZE(resident); i++) {
+            snprintf(param, sizeof(param), "resident=%u",
+                     (unsigned)resident[i]);
+            bench_kernel k = { "tlbinvasid", param, k_tlbinvasid,
+                               (void *)resident[i], 0, 0, 0, 0 };
+            bench_result r = bench_run(&k);
+            bench_report(&k, &r);
+        }
+    }
+
+    if (bench_selected("asid_switch")) {
+        map_window(1, PAGE_BITS(PAGE_4K), page_sizes, 1);
+        bench_kernel k = { "asid_switch", "asids=2", k_asid_switch, NULL,
+                           0, 0, 0, 0 };
+        bench_result r = bench_run(&k);
+        bench_report(&k, &r);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t jtlb = read_cfgtable_field(CFGTABLE_JTLB_ENTRIES);
+    static const uint32_t asids[] = { 1, 2, 4, 8 };
+
+    printf("# %u JTLB entries, %u managed\n", (unsigned)jtlb, SLOTS);
+    bench_init("tlb", argc, argv);
+    if (jtlb < 2 * SLOTS) {
+        bench_error("tlb", "JTLB too small");
+        return bench_finish();
+    }
+    tlb_slot_first = jtlb - SLOTS;
+    tlb_slot_last = jtlb - 1;
+    target[0] = 0xc0ffee;
+
+    install_my_event_vectors();
+
+    if (bench_selected("stream")) {
+        for (uint32_t i = 0; i < ARRAY_SIZE(page_sizes); i++) {
+            const char *name = pgsize_str(page_sizes[i]);
+            run_stream(name, &page_sizes[i], 1, SLOTS / 2, 1);
+            run_stream(name, &page_sizes[i], 1, MAX_PAGES, 1);
+        }
+        run_stream("mixed", page_sizes, ARRAY_SIZE(page_sizes), SLOTS / 2, 1);
+        run_stream("mixed", page_sizes, ARRAY_SIZE(page_sizes), MAX_PAGES, 1);
+        for (uint32_t i = 0; i < ARRAY_SIZE(asids); i++) {
+            run_stream("4K", page_sizes, 1, ASID_PAGES, asids[i]);
+        }
+    }
+    run_tlb_ops();
+
+    /* Empty window, no managed entries left */
+    map_window(0, 0, page_sizes, 1);
+    set_asid(0);
+    setevb(old_evb);
+    return bench_finish();
+}
@@ -20,6 +20,9 @@ static uint32_t read_cfgtable_field(uint32_t offset)
     return val;
 }
 
+#define CFGTABLE_JTLB_ENTRIES       0x2c
+#define CFGTABLE_HVX_CONTEXTS       0x34
+#define CFGTABLE_THREAD_ENABLE_MASK 0x48
 #define CFGTABLE_CORE_ID    0x70
 #define CFGTABLE_CORE_COUNT 0x74
 #define GET_SUBSYSTEM_BASE() (read_cfgtable_field(0x8) << 16)
@@ -170,7 +170,7 @@ static void pmu_reset(void)
 }
 
 
-const char *regtype_to_str(enum regtype type)
+static inline const char *regtype_to_str(enum regtype type)
 {
     switch (type) {
     case SREG: return "sys";
@@ -181,39 +181,45 @@ const char *regtype_to_str(enum regtype type)
     abort();
 }
 
-static inline void __check_val_range(uint32_t val,
-                                     int regnum, enum regtype type,
-                                     uint32_t lo, uint32_t hi,
-                                     int line)
+/* The checks return 1 on a mismatch, 0 otherwise */
+static inline int __check_val_range(uint32_t val,
+                                    int regnum, enum regtype type,
+                                    uint32_t lo, uint32_t hi,
+                                    int line)
 {
     if (val < lo || val > hi) {
 
         printf("ERROR at line %d: %s counter %u outside"
                " [%"PRIu32", %"PRIu32"] range (%"PRIu32")\n",
                line, regtype_to_str(type), regnum, lo, hi, val);
-        err = 1;
+        return 1;
     }
+    return 0;
 }
 
-static inline void __check_val(uint32_t val, int regnum, enum regtype type,
-                               uint32_t exp, int line)
+static inline int __check_val(uint32_t val, int regnum, enum regtype type,
+                              uint32_t exp, int line)
 {
     if (val != exp) {
         printf("ERROR at line %d: %s counter %u has value %"PRIu32", "
                "expected %"PRIu32"\n",
                line, regtype_to_str(type), regnum, val, exp);
-        err = 1;
+        return 1;
     }
+    return 0;
 }
 
+/* These set the caller's err on a mismatch */
 #define check_range(regnum, regtype, lo, hi) \
-    __check_val_range(get_counter(regnum, regtype), regnum, regtype, lo, hi, __LINE__)
+    (err |= __check_val_range(get_counter(regnum, regtype), regnum, regtype, \
+                              lo, hi, __LINE__))
 
 #define check(regnum, regtype, exp) \
-   __check_val(get_counter(regnum, regtype), regnum, regtype, exp, __LINE__)
+    (err |= __check_val(get_counter(regnum, regtype), regnum, regtype, exp, \
+                        __LINE__))
 
 #define check_val_range(val, regnum, regtype, lo, hi) \
-    __check_val_range(val, regnum, regtype, lo, hi, __LINE__)
+    (err |= __check_val_range(val, regnum, regtype, lo, hi, __LINE__))
 
 #define COMMITTED_PKT_ANY 3
 #define COMMITTED_PKT_T0 12
@@ -0,0 +1,95 @@
+/*
+ * Per-region PMU event profiles for systests and benchmarks
+ *
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+/*
+ * Usage:
+ *
+ *     PROF_BEGIN("filter", COMMITTED_PKT_T0, HVX_PKT);
+ *     ...
+ *     PROF_END();
+ *
+ * A region counts the given PMU events (IDs as in pmu.h) and pcycles from
+ * PROF_BEGIN to the matching PROF_END. Regions nest: the events of a region
+ * are its own, the nested regions are not counted in them, while pcycles
+ * include them.
+ *
+ * There are 8 PMU counters. A region with more events measures them 8 at a
+ * time, the next group each time it runs, and the profile reports each event
+ * scaled to all runs of the region along with the runs it was measured in.
+ * PROF_RUNS() runs a block as many times as needed to measure every event
+ * once:
+ *
+ *     PROF_RUNS("kernel", e0, e1, ..., e11) {
+ *         kernel();
+ *     }
+ *
+ * A break or return out of the block ends the region of the current run.
+ *
+ * A region name stands for one list of events: PROF_BEGIN with a name
+ * already used with other events does not profile the region and returns
+ * nonzero, as it does when there are more than PROF_MAX_REGIONS names. The
+ * matching PROF_END is still needed.
+ *
+ * Every completed region is kept in a ring of PROF_RING_SIZE records (the
+ * oldest are dropped) and summed per region name. At exit the profile is
+ * written through semihosting: <base>.csv, one line per record and event,
+ * and <base>.json, the per region sums; <base> is "prof" unless
+ * prof_set_output() changed it.
+ *
+ * The PMU counts for the whole core, profile one thread at a time.
+ */
+
+#define PROF_MAX_EVENTS   32
+#define PROF_MAX_DEPTH    8
+#define PROF_MAX_REGIONS  64
+#define PROF_RING_SIZE    512
+
+#define PROF_BEGIN(NAME, ...) \
+    prof_begin((NAME), (const uint32_t[]){ __VA_ARGS__ }, \
+               sizeof((const uint32_t[]){ __VA_ARGS__ }) / sizeof(uint32_t))
+#define PROF_END() prof_end()
+
+/*
+ * prof_runs_left is nonzero while a run's region is open, so leaving the
+ * loop early through break or return ends it in prof_runs_cleanup().
+ */
+#define PROF_RUNS(NAME, ...) \
+    for (uint32_t prof_runs_left \
+             __attribute__((cleanup(prof_runs_cleanup))) = prof_groups( \
+             sizeof((const uint32_t[]){ __VA_ARGS__ }) / sizeof(uint32_t)); \
+         prof_runs_left && (PROF_BEGIN(NAME, __VA_ARGS__), 1); \
+         prof_runs_left--, PROF_END())
+
+/* Returns 0 if the region is profiled */
+int prof_begin(const char *name, const uint32_t *events, uint32_t nevents);
+void prof_end(void);
+
+static inline void prof_runs_cleanup(const uint32_t *runs_left)
+{
+    if (*runs_left) {
+        prof_end();
+    }
+}
+
+/* Event groups, and so runs, needed to measure nevents events */
+uint32_t prof_groups(uint32_t nevents);
+
+/* Count of the index-th event of a region, scaled to all its runs */
+uint64_t prof_count(const char *name, uint32_t index);
+
+/* Base name of the output files, "prof" by default */
+void prof_set_output(const char *base);
+
+/* Writes the profile now instead of at exit, returns 0 on success */
+int prof_dump(void);
+
+#endif /* PROF_H */
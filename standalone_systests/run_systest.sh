@@ -0,0 +1,111 @@
+#!/bin/bash
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+# Test launcher for the standalone system tests. CMakeLists.txt installs
+# it as the CMAKE_CROSSCOMPILING_EMULATOR, so ctest runs
+#
+#   run_systest.sh <program> [args...]
+#
+# from the test's own working directory, with the per-test settings
+# declared in CMakeLists.txt passed through the environment:
+#
+#   SYSTEST_SIMULATOR   qemu-system-hexagon or hexagon-sim binary
+#   SYSTEST_ARCH        Hexagon version, for hexagon-sim (-mv68, ...)
+#   SYSTEST_MACHINE     QEMU machine (-M)
+#   SYSTEST_SMP         QEMU -smp topology (optional)
+#   SYSTEST_SIM_ARGS    extra simulator arguments (optional)
+#   SYSTEST_COSIM       hexagon-sim cosim config file (optional)
+#   SYSTEST_FILES       files copied into the working directory first
+#   SYSTEST_EXIT        expected exit code, "nonzero" or "timeout"
+#   SYSTEST_RUN_FOR     seconds a "timeout" test has to keep running
+#   SYSTEST_REF         expected stdout (optional)
+#   SYSTEST_STDERR_REF  expected stderr (optional)
+#   SYSTEST_OUTPUT_MATCH  extended regex a line of stdout must match (optional)
+#
+# The launcher exits 0 when the program behaved as expected.
+
+set -uo pipefail
+
+if [[ $# -lt 1 ]]; then
+    echo "Usage: $0 <program> [args...]" >&2
+    exit 2
+fi
+
+PROGRAM="$1"
+shift
+
+SIM="${SYSTEST_SIMULATOR:-qemu-system-hexagon}"
+EXPECT="${SYSTEST_EXIT:-0}"
+
+for f in ${SYSTEST_FILES:-}; do
+    cp -f "$f" . || exit 2
+done
+
+if [[ "$(basename "$SIM")" == hexagon-sim* ]]; then
+    cmd=("$SIM" "-m${SYSTEST_ARCH:-v68}" --simulated_returnval)
+    if [[ -n "${SYSTEST_COSIM:-}" ]]; then
+        cmd+=(--timing --bypass_idle --cosim_file "$SYSTEST_COSIM")
+    fi
+    cmd+=(${SYSTEST_SIM_ARGS:-} -- "$PROGRAM" "$@")
+else
+    # Semihosting hands the program its command line, argv[0] included
+    semi="enable=on,target=native,arg=$(basename "$PROGRAM")"
+    for arg in "$@"; do
+        semi+=",arg=${arg//,/,,}"
+    done
+    cmd=("$SIM" -M "${SYSTEST_MACHINE:?SYSTEST_MACHINE is not set}")
+    if [[ -n "${SYSTEST_SMP:-}" ]]; then
+        cmd+=(-smp "$SYSTEST_SMP")
+    fi
+    cmd+=(-kernel "$PROGRAM" -semihosting-config "$semi" -nographic
+          ${SYSTEST_SIM_ARGS:-})
+fi
+
+out=$(mktemp)
+err=$(mktemp)
+trap 'rm -f "$out" "$err"' EXIT
+
+rc=0
+if [[ "$EXPECT" == timeout ]]; then
+    timeout "${SYSTEST_RUN_FOR:-10}" "${cmd[@]}" </dev/null >"$out" 2>"$err" || rc=$?
+else
+    "${cmd[@]}" </dev/null >"$out" 2>"$err" || rc=$?
+fi
+cat "$out"
+cat "$err" >&2
+
+case "$EXPECT" in
+    timeout)
+        if [[ $rc -ne 124 ]]; then
+            echo "FAIL: expected ${PROGRAM##*/} to still be running, it exited with $rc" >&2
+            exit 1
+        fi
+        ;;
+    nonzero)
+        if [[ $rc -eq 0 ]]; then
+            echo "FAIL: expected ${PROGRAM##*/} to fail, it exited with 0" >&2
+            exit 1
+        fi
+        ;;
+    *)
+        if [[ $rc -ne $EXPECT ]]; then
+            echo "FAIL: ${PROGRAM##*/} exited with $rc, expected $EXPECT" >&2
+            exit 1
+        fi
+        ;;
+esac
+
+if [[ -n "${SYSTEST_OUTPUT_MATCH:-}" ]] && ! grep -Eq -- "$SYSTEST_OUTPUT_MATCH" "$out"; then
+    echo "FAIL: no line of output matches '$SYSTEST_OUTPUT_MATCH'" >&2
+    exit 1
+fi
+if [[ -n "${SYSTEST_REF:-}" ]] && ! diff -u "$SYSTEST_REF" "$out" >&2; then
+    echo "FAIL: output differs from $SYSTEST_REF" >&2
+    exit 1
+fi
+if [[ -n "${SYSTEST_STDERR_REF:-}" ]] && ! diff -u "$SYSTEST_STDERR_REF" "$err" >&2; then
+    echo "FAIL: stderr differs from $SYSTEST_STDERR_REF" >&2
+    exit 1
+fi
+exit 0
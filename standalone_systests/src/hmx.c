@@ -143,6 +143,9 @@ int main()
     memcpy(weights_vtcm, weights, sizeof(weights));
     memcpy(bias_vtcm, bias, sizeof(bias));
 
+    /* neg-no-hmx faults right after this, make sure it gets out */
+    puts("starting HMX ops");
+    fflush(stdout);
     do_mxclracc();
     do_bias_mxmem2((uintptr_t)bias_vtcm);
     do_activation_weight((uintptr_t)activations_vtcm, activations_range,
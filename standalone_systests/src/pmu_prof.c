@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Test the PROF_BEGIN/PROF_END profiling regions: the committed packets of
+ * known loops, nested regions, more events than PMU counters, leaving
+ * PROF_RUNS early, reusing a name with other events and the ring wrapping
+ * around, then the CSV dump of the ring.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+int err;
+#include "hex_test.h"
+#include "pmu.h"
+#include "prof.h"
+
+/* Entering and leaving a region commits a few packets of its own */
+#define SLACK 100
+
+#define RUN_N_PACKETS(N) \
+    asm volatile("   loop0(1f, %0)\n" \
+                 "1: { nop }:endloop0\n" \
+                 : : "r"(N) : "lc0", "sa0")
+
+#define check_count(NAME, INDEX, N) \
+    check32_range(prof_count(NAME, INDEX), (N), (N) + SLACK)
+
+static void test_region(void)
+{
+    PROF_BEGIN("loop", COMMITTED_PKT_T0, COMMITTED_PKT_ANY);
+    RUN_N_PACKETS(1000);
+    PROF_END();
+
+    check_count("loop", 0, 1000);
+    check_count("loop", 1, 1000);
+}
+
+static void test_nested(void)
+{
+    PROF_BEGIN("outer", COMMITTED_PKT_T0);
+    RUN_N_PACKETS(500);
+    PROF_BEGIN("inner", COMMITTED_PKT_T0);
+    RUN_N_PACKETS(2000);
+    PROF_END();
+    RUN_N_PACKETS(500);
+    PROF_END();
+
+    /* The outer region does not count the inner one */
+    check_count("outer", 0, 1000);
+    check_count("inner", 0, 2000);
+}
+
+static void test_multiplexed(void)
+{
+    uint32_t runs = 0;
+
+    /* Two groups of events, so two runs */
+    PROF_RUNS("mux",
+              COMMITTED_PKT_T0, COMMITTED_PKT_T0, COMMITTED_PKT_T0,
+              COMMITTED_PKT_T0, COMMITTED_PKT_T0, COMMITTED_PKT_T0,
+              COMMITTED_PKT_T0, COMMITTED_PKT_T0, COMMITTED_PKT_ANY,
+              COMMITTED_PKT_T0) {
+        RUN_N_PACKETS(1000);
+        runs++;
+    }
+    check32(runs, 2);
+
+    /* Each event was counted in one run, scaled to both */
+    check_count("mux", 0, 2000);
+    check_count("mux", 8, 2000);
+    check_count("mux", 9, 2000);
+}
+
+static void test_runs_break(void)
+{
+    uint32_t runs = 0;
+
+    PROF_RUNS("break",
+              COMMITTED_PKT_T0, COMMITTED_PKT_T0, COMMITTED_PKT_T0,
+              COMMITTED_PKT_T0, COMMITTED_PKT_T0, COMMITTED_PKT_T0,
+              COMMITTED_PKT_T0, COMMITTED_PKT_T0, COMMITTED_PKT_T0) {
+        RUN_N_PACKETS(1000);
+        runs++;
+        break;
+    }
+    check32(runs, 1);
+
+    /* The break ended the region, so its run was counted */
+    check_count("break", 0, 1000);
+}
+
+static void test_mismatch(void)
+{
+    check32(PROF_BEGIN("loop", COMMITTED_PKT_T0), 1);
+    RUN_N_PACKETS(1000);
+    PROF_END();
+
+    /* The first "loop" region is left as it was */
+    check_count("loop", 0, 1000);
+    check_count("loop", 1, 1000);
+}
+
+static void test_ring(void)
+{
+    for (int i = 0; i < 2 * PROF_RING_SIZE; i++) {
+        PROF_BEGIN("ring", COMMITTED_PKT_T0);
+        RUN_N_PACKETS(10);
+        PROF_END();
+    }
+    check32_range(prof_count("ring", 0), 2 * PROF_RING_SIZE * 10,
+                  2 * PROF_RING_SIZE * (10 + SLACK));
+}
+
+/*
+ * The ring wrapped around: the CSV has the last PROF_RING_SIZE "ring"
+ * records, oldest first.
+ */
+static void test_dump(void)
+{
+    char line[128];
+    char region[16];
+    char event[32];
+    uint32_t seq, depth, id, prev_seq = 0;
+    int32_t parent;
+    uint64_t pcycles, count;
+    int records = 0;
+    FILE *fp;
+
+    prof_set_output("pmu_prof");
+    check32(prof_dump(), 0);
+
+    fp = fopen("pmu_prof.csv", "r");
+    if (!fp) {
+        printf("ERROR: cannot open pmu_prof.csv\n");
+        err++;
+        return;
+    }
+    if (!fgets(line, sizeof(line), fp) ||
+        strcmp(line, "seq,parent,depth,region,pcycles,event,event_name,"
+                     "count\n")) {
+        printf("ERROR: unexpected CSV header\n");
+        err++;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        int fields = sscanf(line, "%" SCNu32 ",%" SCNd32 ",%" SCNu32
+                            ",%15[^,],%" SCNu64 ",%" SCNu32 ",%31[^,],%"
+                            SCNu64, &seq, &parent, &depth, region, &pcycles,
+                            &id, event, &count);
+        check32(fields, 8);
+        if (fields != 8) {
+            break;
+        }
+        if (strcmp(region, "ring") || strcmp(event, "COMMITTED_PKT_T0")) {
+            printf("ERROR: record %d is %s/%s\n", records, region, event);
+            err++;
+        }
+        /* The older half of the "ring" records was dropped */
+        if (records == 0) {
+            check32_range(seq, PROF_RING_SIZE, UINT32_MAX);
+        } else {
+            check32(seq, prev_seq + 1);
+        }
+        check32(parent, -1);
+        check32(depth, 0);
+        check32(id, COMMITTED_PKT_T0);
+        check32_range(count, 10, 10 + SLACK);
+        prev_seq = seq;
+        records++;
+    }
+    fclose(fp);
+    check32(records, PROF_RING_SIZE);
+}
+
+int main()
+{
+    puts("Hexagon PMU profiling regions test");
+
+    test_region();
+    test_nested();
+    test_multiplexed();
+    test_runs_break();
+    test_mismatch();
+    test_ring();
+    test_dump();
+
+    printf("%s\n", ((err) ? "FAIL" : "PASS"));
+    return err;
+}
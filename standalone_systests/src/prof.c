@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "pmu.h"
+#include "prof.h"
+
+#define SYSCFG_PCYCLEEN_BIT 6
+
+struct prof_region {
+    const char *name;
+    uint32_t nevents;
+    uint32_t events[PROF_MAX_EVENTS];
+    uint32_t runs;
+    uint64_t pcycles;
+    uint64_t counts[PROF_MAX_EVENTS];
+    uint32_t measured[PROF_MAX_EVENTS];     /* runs each event was counted */
+};
+
+/* A region between PROF_BEGIN and PROF_END */
+struct prof_frame {
+    struct prof_region *region;
+    uint32_t seq;
+    uint32_t first;                         /* first event of the group */
+    uint32_t n;                             /* events in the group */
+    uint64_t pcycle;
+    uint64_t counts[NUM_PMU_CTRS];
+};
+
+struct prof_record {
+    const char *name;
+    uint32_t seq;
+    int32_t parent;
+    uint32_t depth;
+    uint64_t pcycles;
+    uint32_t n;
+    uint32_t events[NUM_PMU_CTRS];
+    uint64_t counts[NUM_PMU_CTRS];
+};
+
+static struct prof_region regions[PROF_MAX_REGIONS];
+static uint32_t nregions;
+static struct prof_frame frames[PROF_MAX_DEPTH];
+static uint32_t depth;
+static struct prof_record ring[PROF_RING_SIZE];
+static uint32_t nrecords;
+static uint32_t next_seq;
+static const char *output = "prof";
+static int initialized;
+
+static const struct {
+    uint32_t id;
+    const char *name;
+} event_names[] = {
+    { COMMITTED_PKT_ANY, "COMMITTED_PKT_ANY" },
+    { COMMITTED_PKT_T0,  "COMMITTED_PKT_T0" },
+    { COMMITTED_PKT_T1,  "COMMITTED_PKT_T1" },
+    { COMMITTED_PKT_T2,  "COMMITTED_PKT_T2" },
+    { COMMITTED_PKT_T3,  "COMMITTED_PKT_T3" },
+    { COMMITTED_PKT_T4,  "COMMITTED_PKT_T4" },
+    { COMMITTED_PKT_T5,  "COMMITTED_PKT_T5" },
+    { COMMITTED_PKT_T6,  "COMMITTED_PKT_T6" },
+    { COMMITTED_PKT_T7,  "COMMITTED_PKT_T7" },
+    { HVX_PKT,           "HVX_PKT" },
+};
+
+static const char *event_name(uint32_t id)
+{
+    for (uint32_t i = 0; i < sizeof(event_names) / sizeof(event_names[0]);
+         i++) {
+        if (event_names[i].id == id) {
+            return event_names[i].name;
+        }
+    }
+    return "";
+}
+
+static uint64_t read_pcycle(void)
+{
+    uint64_t pcycle;
+    asm volatile("%0 = pcycle\n\t" : "=r"(pcycle));
+    return pcycle;
+}
+
+static void enable_pcycle(void)
+{
+    asm volatile("r2 = syscfg\n\t"
+                 "r2 = setbit(r2, #%0)\n\t"
+                 "syscfg = r2\n\t"
+                 "isync\n\t"
+                 :
+                 : "i"(SYSCFG_PCYCLEEN_BIT)
+                 : "r2");
+}
+
+static void dump_at_exit(void)
+{
+    prof_dump();
+}
+
+static void init(void)
+{
+    pmu_reset();
+    enable_pcycle();
+    atexit(dump_at_exit);
+    initialized = 1;
+}
+
+static struct prof_region *find_region(const char *name,
+                                       const uint32_t *events,
+                                       uint32_t nevents)
+{
+    for (uint32_t i = 0; i < nregions; i++) {
+        struct prof_region *r = &regions[i];
+        if (strcmp(r->name, name)) {
+            continue;
+        }
+        if (r->nevents != nevents ||
+            memcmp(r->events, events, nevents * sizeof(uint32_t))) {
+            printf("prof: %s used with different events, not profiled\n",
+                   name);
+            return NULL;
+        }
+        return r;
+    }
+    if (nregions == PROF_MAX_REGIONS) {
+        printf("prof: more than %d regions, %s not profiled\n",
+               PROF_MAX_REGIONS, name);
+        return NULL;
+    }
+    struct prof_region *r = &regions[nregions++];
+    r->name = name;
+    r->nevents = nevents;
+    memcpy(r->events, events, nevents * sizeof(uint32_t));
+    return r;
+}
+
+/* Stops the PMU and adds the counts so far to the frame */
+static void pause_frame(struct prof_frame *f)
+{
+    pmu_stop();
+    for (uint32_t i = 0; i < f->n; i++) {
+        f->counts[i] += get_pmu_counter(i);
+    }
+}
+
+static void resume_frame(const struct prof_frame *f)
+{
+    for (uint32_t i = 0; i < f->n; i++) {
+        pmu_config(i, f->region->events[f->first + i]);
+    }
+    pmu_set_counters(0);
+    pmu_start();
+}
+
+uint32_t prof_groups(uint32_t nevents)
+{
+    return nevents ? (nevents + NUM_PMU_CTRS - 1) / NUM_PMU_CTRS : 1;
+}
+
+uint64_t prof_count(const char *name, uint32_t index)
+{
+    for (uint32_t i = 0; i < nregions; i++) {
+        const struct prof_region *r = &regions[i];
+        if (!strcmp(r->name, name)) {
+            if (index >= r->nevents || !r->measured[index]) {
+                return 0;
+            }
+            return r->counts[index] * r->runs / r->measured[index];
+        }
+    }
+    return 0;
+}
+
+void prof_set_output(const char *base)
+{
+    output = base;
+}
+
+int prof_begin(const char *name, const uint32_t *events, uint32_t nevents)
+{
+    if (!initialized) {
+        init();
+    }
+    if (nevents > PROF_MAX_EVENTS) {
+        printf("prof: %s has more than %d events, the rest are ignored\n",
+               name, PROF_MAX_EVENTS);
+        nevents = PROF_MAX_EVENTS;
+    }
+    if (depth == PROF_MAX_DEPTH) {
+        printf("prof: %s nested more than %d deep\n", name, PROF_MAX_DEPTH);
+        abort();
+    }
+    if (depth) {
+        pause_frame(&frames[depth - 1]);
+    }
+
+    struct prof_frame *f = &frames[depth++];
+    memset(f, 0, sizeof(*f));
+    f->region = find_region(name, events, nevents);
+    f->seq = next_seq++;
+    if (f->region) {
+        uint32_t group = f->region->runs % prof_groups(f->region->nevents);
+        f->first = group * NUM_PMU_CTRS;
+        f->n = f->region->nevents - f->first;
+        if (f->n > NUM_PMU_CTRS) {
+            f->n = NUM_PMU_CTRS;
+        }
+    }
+    resume_frame(f);
+    f->pcycle = read_pcycle();
+    return f->region ? 0 : 1;
+}
+
+void prof_end(void)
+{
+    uint64_t pcycle = read_pcycle();
+
+    if (!depth) {
+        printf("prof: PROF_END without PROF_BEGIN\n");
+        abort();
+    }
+    struct prof_frame *f = &frames[--depth];
+    pause_frame(f);
+
+    struct prof_region *r = f->region;
+    if (r) {
+        struct prof_record *rec = &ring[nrecords++ % PROF_RING_SIZE];
+        rec->name = r->name;
+        rec->seq = f->seq;
+        rec->parent = depth ? (int32_t)frames[depth - 1].seq : -1;
+        rec->depth = depth;
+        rec->pcycles = pcycle - f->pcycle;
+        rec->n = f->n;
+        for (uint32_t i = 0; i < f->n; i++) {
+            rec->events[i] = r->events[f->first + i];
+            rec->counts[i] = f->counts[i];
+            r->counts[f->first + i] += f->counts[i];
+            r->measured[f->first + i]++;
+        }
+        r->runs++;
+        r->pcycles += rec->pcycles;
+    }
+
+    if (depth) {
+        resume_frame(&frames[depth - 1]);
+    }
+}
+
+static void dump_csv(FILE *fp)
+{
+    uint32_t n = nrecords < PROF_RING_SIZE ? nrecords : PROF_RING_SIZE;
+
+    fprintf(fp, "seq,parent,depth,region,pcycles,event,event_name,count\n");
+    for (uint32_t i = nrecords - n; i < nrecords; i++) {
+        const struct prof_record *rec = &ring[i % PROF_RING_SIZE];
+        for (uint32_t e = 0; e < rec->n || (e == 0 && !rec->n); e++) {
+            fprintf(fp, "%" PRIu32 ",%" PRId32 ",%" PRIu32 ",%s,%" PRIu64,
+                    rec->seq, rec->parent, rec->depth, rec->name,
+                    rec->pcycles);
+            if (rec->n) {
+                fprintf(fp, ",%" PRIu32 ",%s,%" PRIu64 "\n", rec->events[e],
+                        event_name(rec->events[e]), rec->counts[e]);
+            } else {
+                fprintf(fp, ",,,\n");
+            }
+        }
+    }
+}
+
+static void dump_json(FILE *fp)
+{
+    uint32_t dropped =
+        nrecords > PROF_RING_SIZE ? nrecords - PROF_RING_SIZE : 0;
+
+    fprintf(fp, "{\n  \"dropped_records\": %" PRIu32 ",\n  \"regions\": [",
+            dropped);
+    for (uint32_t i = 0; i < nregions; i++) {
+        const struct prof_region *r = &regions[i];
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"runs\": %" PRIu32
+                ", \"pcycles\": %" PRIu64 ", \"events\": [",
+                i ? "," : "", r->name, r->runs, r->pcycles);
+        for (uint32_t e = 0; e < r->nevents; e++) {
+            uint64_t scaled = prof_count(r->name, e);
+            fprintf(fp, "%s\n      {\"id\": %" PRIu32 ", \"name\": \"%s\", "
+                    "\"count\": %" PRIu64 ", \"runs\": %" PRIu32
+                    ", \"scaled\": %" PRIu64 "}",
+                    e ? "," : "", r->events[e], event_name(r->events[e]),
+                    r->counts[e], r->measured[e], scaled);
+        }
+        fprintf(fp, "%s]}", r->nevents ? "\n    " : "");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+int prof_dump(void)
+{
+    char fname[64];
+    FILE *fp;
+
+    if (!initialized) {
+        return 0;
+    }
+    snprintf(fname, sizeof(fname), "%s.csv", output);
+    fp = fopen(fname, "w");
+    if (!fp) {
+        printf("prof: cannot open %s\n", fname);
+        return 1;
+    }
+    dump_csv(fp);
+    fclose(fp);
+
+    snprintf(fname, sizeof(fname), "%s.json", output);
+    fp = fopen(fname, "w");
+    if (!fp) {
+        printf("prof: cannot open %s\n", fname);
+        return 1;
+    }
+    dump_json(fp);
+    fclose(fp);
+    return 0;
+}
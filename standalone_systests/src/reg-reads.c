@@ -4,7 +4,6 @@
  */
 
 #include "timer.h"
-static int err; /* needed by pmu.h */
 #include "pmu.h"
 
 /* dummy function to set our breakpoint at */
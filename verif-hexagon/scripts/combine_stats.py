@@ -4,21 +4,50 @@
 # SPDX-License-Identifier: BSD-3-Clause-Clear
 #
 
+# Merges the verif_stats_*.json of several runs, typically the shards of
+# one campaign (--seed S --shard i/N), into combined_stats.json.
+
 from collections import Counter, OrderedDict
 import sys
 import json
 
 if __name__ == '__main__':
     insn_counter = Counter()
+    mem_counter = Counter()
+    rejections = 0
+    failures = []
+    seeds = set()
+    shards = set()
     for fname in sys.argv[1:]:
         with open(fname, 'rt') as f:
             entry = json.load(f)
         print(fname)
         insn_counter.update(entry['inst_counts'])
+        mem_counter.update(entry.get('mem_counts', {}))
+        rejections += entry.get('assembler_rejections', 0)
+        if 'seed' in entry:
+            seeds.add(entry['seed'])
+            shards.add(entry['shard'])
+        failures += entry.get('failures', [])
+
+    if len(seeds) > 1:
+        print(f'warning: merging runs with different seeds: {sorted(seeds)}')
+    shard_counts = {int(shard.split('/')[1]) for shard in shards}
+    if len(shard_counts) == 1:
+        shard_count = shard_counts.pop()
+        missing = sorted(set(range(shard_count)) -
+                         {int(shard.split('/')[0]) for shard in shards})
+        if missing:
+            print(f'warning: missing shards {missing} out of {shard_count}')
 
     counts_by_tag = OrderedDict(sorted(insn_counter.items()))
     stats = {
         'inst_counts': counts_by_tag,
+        'mem_counts': OrderedDict(sorted(mem_counter.items())),
+        'assembler_rejections': rejections,
+        'seeds': sorted(seeds),
+        'shards': sorted(shards),
+        'failures': sorted(failures, key=lambda f: f['index']),
     }
     with open('combined_stats.json', 'wt') as f:
         json.dump(dict(stats), f, indent=4)
@@ -11,7 +11,12 @@
 tmp_f=$(mktemp)
 for case in $(find packet_test_* -type d -name 'pkt_*')
 do
-    sdiff ${case}/output_{base,new}.txt |egrep '\|' > ${tmp_f} || continue
+    # Cases run with --snapshot keep a decoded form of their dumps.
+    out=output
+    if [[ -f ${case}/snapshot_base.txt && -f ${case}/snapshot_new.txt ]]; then
+        out=snapshot
+    fi
+    sdiff ${case}/${out}_{base,new}.txt |egrep '\|' > ${tmp_f} || continue
     echo ${case}
     head -n 3 ${tmp_f}
     reg=$(head -n 1 ${tmp_f} | egrep -o '.*\|' | egrep -m 1 -o '((r|v)[[:digit:]]+|ssr)')
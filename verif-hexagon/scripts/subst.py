@@ -10,11 +10,10 @@ from string import Template
 
 BASEDIR = os.path.join(os.path.dirname(__file__), "../")
 sys.path.append(BASEDIR)
-from src.run_test import TEMPL_FIELDS
+from src.run_test import TEMPL_FIELDS, read_case_templates
 
 if __name__ == '__main__':
-    tmpl_fname = os.path.join(BASEDIR, "etc", 'test_case.tmpl')
-    case = Template(open(tmpl_fname, 'rt').read())
+    case = Template(''.join(read_case_templates(BASEDIR)))
 
     sections = {}
     for field in TEMPL_FIELDS:
@@ -19,68 +19,144 @@ from src.run_test import QEMU, TOOLCHAIN_PATH
 
 BASEDIR = os.path.join(os.path.dirname(__file__), "../")
 
+def run_task(task):
+    from src.run_test import gen_test
+    from src.batch import gen_batch
+    test_cfg, indices = task
+    if test_cfg.perf is not None:
+        from src.perf import gen_perf_test
+        return [gen_perf_test(test_cfg, indices[0])]
+    if test_cfg.cases_per_binary == 1:
+        return [gen_test(test_cfg, indices[0])]
+    return gen_batch(test_cfg, indices)
+
 def run_verif(suite_cfg):
-    from src.run_test import gen_test, print_info
+    from src.run_test import print_info
+    from src.schedule import mem_counts_of
+    from src.stats import StatsSink, phase_summary
     print_info(suite_cfg.test_cfg)
+    per_binary = suite_cfg.test_cfg.cases_per_binary
+    indices = suite_cfg.indices
+    tasks = [(suite_cfg.test_cfg, indices[first:first + per_binary])
+             for first in range(0, len(indices), per_binary)]
+    stamp = time.strftime('%Y%d%b_%H%M', time.gmtime())
+    sink = StatsSink(f'verif_cases_{stamp}.jsonl', suite_cfg.test_count,
+                     suite_cfg.report_interval)
     with mp.Pool(processes=suite_cfg.proc_count) as p:
-        results = []
-        for i in range(suite_cfg.test_count):
-            res = p.apply_async(gen_test, (suite_cfg.test_cfg,) )
-            results.append(res)
+        # Results are consumed as they complete, a slow case doesn't hold
+        # back the reporting of the ones submitted after it.
+        results = p.imap_unordered(run_task, tasks)
 
         t0 = time.time()
         passes = 0
         total_packets = 0
+        comp_errors = 0
+        done = 0
         tag_count = Counter()
-        bar = log.progress_bar('Running tests', len(results))
-        for i, res in enumerate(results):
+        mem_count = Counter()
+        failures = []
+        perf_cases = []
+        task_of = {index: k for k, (_, task_indices) in enumerate(tasks)
+                   for index in task_indices}
+        finished_tasks = set()
+        timed_out = set()
+        bar = log.progress_bar('Running tests', suite_cfg.test_count)
+        while done < suite_cfg.test_count:
             try:
-                fails, case = res.get(timeout=300.)
+                outcomes = results.next(timeout=300. * per_binary)
+            except StopIteration:
+                break
             except mp.TimeoutError:
-                print('timed out waiting for a result')
-                bar.update(i + 1)
+                # Tasks are handed out in order, one at a time: the ones
+                # started that haven't come back are still running.
+                started = min(len(tasks), len(finished_tasks) + suite_cfg.proc_count)
+                running = [index for k in range(started) if k not in finished_tasks
+                           for index in tasks[k][1]]
+                timed_out.update(running)
+                print(f'timed out waiting for a result, still running: {running}')
                 continue
 
-            for packet in case.packets:
-                tag_count.update(packet.tags)
-
-            total_packets += len(case.packets) * case.cfg.test_iters
-
-            if fails:
-                os.makedirs(suite_cfg.test_cfg.output, exist_ok=True)
-                shutil.move(case.dir, suite_cfg.test_cfg.output)
-
-                new_case_dir = os.path.join(suite_cfg.test_cfg.output,
-                    os.path.basename(case.dir))
-                repro = os.path.join(new_case_dir, 'repro.sh')
-                with open(repro, 'rt') as f:
-                    subst_text = f.read()
-
-                subst_text = subst_text.replace('__FILL_IN_DIR__',
-                    new_case_dir)
-                with open(repro, 'wt') as f:
-                    f.write(subst_text)
-
-                print('case:',case.dir, 'to', new_case_dir)
-            else:
-                passes += 1
-            bar.update(i + 1)
+            finished_tasks.update(task_of[case.index] for _, case in outcomes)
+            for fails, case in outcomes:
+                # Before record_outcome() moves the case dir
+                sink.add(fails, case)
+                passes += record_outcome(suite_cfg, fails, case, tag_count,
+                                         failures)
+                mem_count.update(mem_counts_of(case.packets))
+                total_packets += len(case.packets) * case.cfg.test_iters
+                comp_errors += case.tries - 1
+                if case.perf is not None:
+                    perf_cases.append(case)
+            done += len(outcomes)
+            bar.update(done)
         dur_sec = time.time() - t0
-        print(f'{passes} passes out of {len(results)} runs')
+        sink.report()
+        sink.close()
+        print(f'{passes} passes out of {suite_cfg.test_count} runs')
         print(f'test rate: {total_packets / dur_sec:.2f} packets/sec')
+        print(f'assembler rejections: {comp_errors}')
 
-        stamp = time.strftime('%Y%d%b_%H%M', time.gmtime())
         counts_by_tag = OrderedDict(sorted(tag_count.items()))
         stats = {
             'inst_counts': counts_by_tag,
+            'mem_counts': OrderedDict(sorted(mem_count.items())),
+            'assembler_rejections': comp_errors,
+            'phase_times': phase_summary(sink.times),
+            'seed': suite_cfg.test_cfg.seed,
+            'shard': suite_cfg.shard,
+            'failures': sorted(failures, key=lambda f: f['index']),
+            # Cases that were running when a result took too long to come
+            'timed_out': sorted(timed_out),
         }
+        if suite_cfg.test_cfg.perf is not None:
+            from src.perf import summarize
+            stats['perf'] = summarize(perf_cases)
         with open(f'verif_stats_{stamp}.json', 'wt') as f:
             json.dump(stats, f, indent=4)
             f.write('\n')
 
-        return passes == len(results)
+        return passes == suite_cfg.test_count
+
+def record_outcome(suite_cfg, fails, case, tag_count, failures):
+    from src.run_test import infra_error
+    for packet in case.packets:
+        tag_count.update(packet.tags)
+
+    if not fails:
+        return 1
+
+    guide = suite_cfg.test_cfg.guide
+    if guide is not None and guide.corpus_dir is not None:
+        from src.schedule import add_to_corpus
+        add_to_corpus(guide.corpus_dir, case)
+
+    os.makedirs(suite_cfg.test_cfg.output, exist_ok=True)
+    shutil.move(case.dir, suite_cfg.test_cfg.output)
+
+    new_case_dir = os.path.join(suite_cfg.test_cfg.output,
+        os.path.basename(case.dir))
+    repro = os.path.join(new_case_dir, 'repro.sh')
+    with open(repro, 'rt') as f:
+        subst_text = f.read()
+
+    subst_text = subst_text.replace('__FILL_IN_DIR__',
+        new_case_dir)
+    with open(repro, 'wt') as f:
+        f.write(subst_text)
 
-SuiteCfg = namedtuple('SuiteCfg', 'test_cfg,test_count,proc_count')
+    # Enough to generate the same case again
+    with open(os.path.join(new_case_dir, 'case_id.txt'), 'wt') as f:
+        f.write(f'--seed {case.cfg.seed} --case-index {case.index}'
+                f' --case-attempt {case.tries - 1}\n')
+    infra = infra_error(case._replace(dir=new_case_dir))
+    failures.append({'index': case.index, 'case': new_case_dir,
+                     'infra_error': infra})
+
+    print('infrastructure error:' if infra else 'case:', case.dir, 'to',
+          new_case_dir)
+    return 0
+
+SuiteCfg = namedtuple('SuiteCfg', 'test_cfg,test_count,proc_count,report_interval,indices,shard')
 
 def load_iset(args):
     import importlib
@@ -157,6 +233,99 @@ def parse_args():
         help='Indicate whether all packets succeeded on exit code',
         default=False,
         required=False)
+    parser.add_argument('-s', '--snapshot', action='store_true',
+        help='Have the test program dump its state to a file through'
+         ' semihosting and compare the dumps, instead of reading registers'
+         ' with hexagon-lldb',
+        default=False,
+        required=False)
+    parser.add_argument('-c', '--cases-per-binary', type=int,
+        help='Number of cases to put in each test program; more than one'
+         ' requires --snapshot',
+        default=1,
+        required=False)
+    parser.add_argument('--persistent', action='store_true',
+        help='Keep one QEMU instance per worker and load each test program'
+         ' into it through the gdbstub, instead of starting QEMU for every'
+         ' case; requires --snapshot',
+        default=False,
+        required=False)
+    parser.add_argument('--obj-cache', action='store_true',
+        help='Assemble the sections that do not depend on the generated'
+         ' packets once, into an object cached under the output dir, and'
+         ' stop proposing packet shapes that keep failing to assemble',
+        default=False,
+        required=False)
+    parser.add_argument('--no-legality-check', dest='legality_check',
+        action='store_false',
+        help='Do not check packets against the iset grouping rules before'
+         ' compiling them, leave it all to the assembler',
+        default=True,
+        required=False)
+    parser.add_argument('--guided', action='store_true',
+        help='Bias generation toward the tags, memory access sizes and'
+         ' addressing modes exercised the least so far. Implied by --stats,'
+         ' --gcov-dir and --corpus',
+        default=False,
+        required=False)
+    parser.add_argument('--stats', type=str, nargs='+',
+        help='verif_stats_*.json files from previous runs to seed the'
+         ' guided generation counts with',
+        default=[],
+        required=False)
+    parser.add_argument('--gcov-dir', type=str,
+        help='A QEMU build dir with gcov output (see "packet_verif coverage");'
+         ' tags whose QEMU code was never called get generated more often',
+        default=None,
+        required=False)
+    parser.add_argument('--corpus', type=str,
+        help='Dir of the persistent corpus: packets from failing cases are'
+         ' added to it, and replayed in guided generation',
+        default=None,
+        required=False)
+    parser.add_argument('--report-interval', type=float,
+        help='Seconds between the throughput and phase time reports printed'
+         ' while running; every case is also logged to verif_cases_*.jsonl',
+        default=60.,
+        required=False)
+    parser.add_argument('--seed', type=int,
+        help='Seed for the generation; each case draws from its own stream'
+         ' derived from the seed and its index. A random one is picked and'
+         ' printed if not given',
+        default=None,
+        required=False)
+    parser.add_argument('--shard', type=str,
+        help='i/N: only run the cases whose index is i modulo N, out of the'
+         ' --test-count cases of the whole campaign',
+        default='0/1',
+        required=False)
+    parser.add_argument('--case-index', type=int,
+        help='Only generate and run the case with this index, e.g. to'
+         ' reproduce a failure with the same --seed',
+        default=None,
+        required=False)
+    parser.add_argument('--case-attempt', type=int,
+        help='With --case-index, the generation attempt to start from: cases'
+         ' that did not compile, or that shared a batch with one that did not,'
+         ' are generated again as the next attempt',
+        default=0,
+        required=False)
+    parser.add_argument('--perf', action='store_true',
+        help='Compare the speed of --base-qemu and --qemu-bin instead of'
+         ' their results: each case runs standalone under both, and the'
+         ' cases where the new QEMU is slower beyond --perf-threshold are'
+         ' kept. Use a large --iters-per-case',
+        default=False,
+        required=False)
+    parser.add_argument('--perf-repeat', type=int,
+        help='Runs of each case per QEMU in --perf mode, the fastest is kept',
+        default=3,
+        required=False)
+    parser.add_argument('--perf-threshold', type=float,
+        help='Relative slowdown of the new QEMU above which a case is'
+         ' reported in --perf mode',
+        default=0.1,
+        required=False)
     parser.add_argument('--toolchain-path', type=str,
         help='The path for the hexagon toolchain',
         default=TOOLCHAIN_PATH,
@@ -168,27 +337,87 @@ def parse_args():
     if args.hex_rev is not None and args.iset is not None:
         sys.exit("--iset and --hex-rev are incompatible. Use just one of them.")
 
+    if args.cases_per_binary < 1:
+        sys.exit("--cases-per-binary must be at least 1")
+    if args.cases_per_binary > 1 and not args.snapshot:
+        sys.exit("--cases-per-binary needs --snapshot to tell the cases apart")
+
+    if args.persistent and not args.snapshot:
+        sys.exit("--persistent needs --snapshot")
+
+    if args.perf:
+        if args.base_qemu is None:
+            sys.exit("--perf needs a --base-qemu to compare with")
+        if args.snapshot:
+            sys.exit("--perf runs the programs standalone, without --snapshot")
+        if args.perf_repeat < 1:
+            sys.exit("--perf-repeat must be at least 1")
+
     for qemu in (args.qemu_bin, args.base_qemu):
         if qemu is None:
             continue
         if not os.path.isfile(qemu) or not os.access(qemu, os.X_OK):
             sys.exit(f"'{qemu}' is not a valid qemu executable")
 
+    try:
+        args.shard = tuple(int(n) for n in args.shard.split('/'))
+        if len(args.shard) != 2 or not 0 <= args.shard[0] < args.shard[1]:
+            raise ValueError
+    except ValueError:
+        sys.exit("--shard must be i/N, with 0 <= i < N")
+    if args.case_index is not None and args.seed is None:
+        sys.exit("--case-index needs the --seed the case was generated with")
+    if args.case_attempt and args.case_index is None:
+        sys.exit("--case-attempt needs --case-index")
+    if args.case_attempt < 0:
+        sys.exit("--case-attempt must not be negative")
+    if args.seed is None:
+        import random
+        args.seed = random.randrange(2**32)
+
+    args.guided = args.guided or bool(args.stats) or \
+        args.gcov_dir is not None or args.corpus is not None
+
     return args
 
 if __name__ == '__main__':
     args = parse_args()
-    from src.run_test import TestCfg, get_inst_tags, setup_toolchain
+    from src.run_test import TestCfg, get_inst_tags, setup_toolchain, \
+        read_case_templates
     setup_toolchain(args.toolchain_path)
-    test_case_src_template = open(os.path.join(BASEDIR, 'etc/test_case.tmpl'), 'rt').read()
-    test_case_src_template = Template(test_case_src_template)
+    case_templates = read_case_templates(BASEDIR)
+    test_case_src_template = Template(''.join(case_templates))
+    split_templates = tuple(Template(text) for text in case_templates)
+    batch_templates = None
+    if args.cases_per_binary > 1:
+        batch_templates = tuple(
+            Template(open(os.path.join(BASEDIR, f'etc/{name}.tmpl'), 'rt').read())
+            for name in ('batch', 'batch_case'))
     iset = load_iset(args)
     tags = list(get_inst_tags(iset.iset))
+    guide = None
+    if args.guided:
+        from src.schedule import load_guide
+        guide = load_guide(args.stats, args.gcov_dir, args.corpus, tags)
+    perf = None
+    if args.perf:
+        from src.perf import PerfCfg
+        perf = PerfCfg(args.perf_repeat, args.perf_threshold)
     cflags = f'-g -m{iset.q6version} -mhvx-ieee-fp -mhvx-qfloat -mhvx -mhmx'
     test_cfg = TestCfg(iset.iset, iset.q6version, tags, args.iters_per_case,
         args.packets_per_case, args.max_insts_per_packet, cflags,
-        test_case_src_template, args.output_dir, args.qemu_bin, args.base_qemu)
-    suite = SuiteCfg(test_cfg, args.test_count, args.proc_count)
+        test_case_src_template, args.output_dir, args.qemu_bin, args.base_qemu,
+        args.snapshot, args.cases_per_binary, batch_templates,
+        args.persistent, args.obj_cache, split_templates,
+        args.legality_check, guide, args.seed, perf, args.case_attempt)
+    print(f'seed: {args.seed}')
+    if args.case_index is not None:
+        indices = [args.case_index]
+    else:
+        shard, shards = args.shard
+        indices = list(range(shard, args.test_count, shards))
+    suite = SuiteCfg(test_cfg, len(indices), args.proc_count,
+        args.report_interval, indices, '/'.join(map(str, args.shard)))
 
     success = run_verif(suite)
     if args.exit_code:
@@ -0,0 +1,269 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Batching: many independent cases are assembled into a single test
+# program, so that the compile, link and emulator boot costs are paid
+# once per batch instead of once per case. Each case restores the
+# memory window and control registers before running, so it sees the
+# same initial state it would get as a standalone program. Results are
+# split back per case from the snapshot dumps.
+
+from collections import namedtuple
+from tempfile import mkdtemp
+import os.path
+import shutil
+import time
+
+from src import log
+from src import snapshot
+from src.run_test import TestCase, CompError, DebugRun, MUTATIONS, PHASES, \
+    TEMPL_FIELDS, seed_case, gen_packet_set, gen_case_src_sections, compile, \
+    run_once, run_fns, write_repro, decode_snapshots, error_lines, lines_owner, \
+    gen_test, infra_error_fname, _snapshot_qemu_cmd, _snapshot_hexagon_sim_cmd
+from src.initialization import _MEM_BYTES, _MEM_PADDING_REPEAT, _MEM_WORDS
+
+BatchCase = namedtuple('BatchCase', 'case,sections')
+
+_HVX_BYTES = 128
+_MEM_PADDING_BYTES = _MEM_PADDING_REPEAT * _MEM_WORDS * 4
+_MEM_TOTAL_BYTES = _MEM_BYTES + 2 * _MEM_PADDING_BYTES
+
+# Batch compilations that fail without an error in any case regenerate the
+# whole batch; after this many the cases are run one by one instead.
+_MAX_UNMAPPED_RETRIES = 3
+
+# Predicates are set by each case's pred_init, every other user control
+# register is brought back to its value at program start.
+_batch_ctrls = [creg for name, creg in snapshot.snapshot_ctrls if name != 'p3_0']
+
+def gen_batch_routines():
+    save = ['r0 = ##batch_ctrls']
+    restore = ['r0 = ##batch_ctrls']
+    for i, creg in enumerate(_batch_ctrls):
+        save += [f'r1 = c{creg}', f'memw(r0+#{i * 4}) = r1']
+        restore += [f'r1 = memw(r0+#{i * 4})', f'c{creg} = r1']
+    save = '\n    '.join(save)
+    restore = '\n    '.join(restore)
+
+    return f'''
+    .data
+.p2align 2
+batch_ctrls:
+.skip {len(_batch_ctrls) * 4}
+    .text
+
+// r0: address of the case's memory image
+.align 0x04
+memory_reset:
+    r1 = ##memory_prefix
+    r2 = #{_MEM_TOTAL_BYTES // _HVX_BYTES}
+1:
+    v0 = vmem(r0++#1)
+    vmem(r1++#1) = v0
+    r2 = add(r2, #-1)
+    p0 = cmp.gt(r2, #0)
+    if (p0) jump 1b
+    jumpr r31
+
+.align 0x04
+ctrl_save:
+    {save}
+    jumpr r31
+
+.align 0x04
+ctrl_restore:
+    {restore}
+    jumpr r31
+'''
+
+def gen_dispatch(test_cfg, batch):
+    def case_calls(k):
+        yield f'    r0 = ##memory_image_{k}'
+        yield '    call memory_reset'
+        yield '    call ctrl_restore'
+        yield f'    call gpreg_init_{k}'
+        yield f'    call pred_init_{k}'
+        yield f'    call hvx_reg_init_{k}'
+        for i in range(test_cfg.test_iters):
+            yield f'    call test_case_{k}'
+            yield '    call snapshot_save'
+            yield f'    call mutate_{MUTATIONS[i % len(MUTATIONS)]}_{k}'
+    return '\n'.join(f'\n'.join(case_calls(k)) + '\n'
+                     for k in range(len(batch)))
+
+def case_jump_targets(sections, k):
+    '''Each case jumps to its own jump targets, under labels of its own.'''
+    label = f'.Lcase{k}_jump_target'
+    return {field: sections[field].replace('.Ljump_target', label)
+            for field in ('jump_targets', 'test_packets')}
+
+def gen_batch_src(test_cfg, batch):
+    batch_tmpl, case_tmpl = test_cfg.batch_tmpl
+    cases = [case_tmpl.substitute(bc.sections, case_index=k,
+                                  **case_jump_targets(bc.sections, k))
+             for k, bc in enumerate(batch)]
+    shared = batch[0].sections
+    return batch_tmpl.substitute(
+        mem_padding_bytes=_MEM_PADDING_BYTES,
+        mem_bytes=_MEM_BYTES,
+        invalid_packet=shared['invalid_packet'],
+        snapshot_routines=shared['snapshot_routines'],
+        snapshot_open=shared['snapshot_open'],
+        snapshot_close=shared['snapshot_close'],
+        batch_routines=gen_batch_routines(),
+        cases='\n'.join(cases),
+        dispatch=gen_dispatch(test_cfg, batch))
+
+def failing_cases(src_text, filename, compiler_output):
+    '''Maps the assembler's error lines back to the cases they belong to.'''
+    owner = lines_owner(src_text, r'memory_image_(\d+):', r'main:')
+    return {owner[line] for line in error_lines(filename, compiler_output)
+            if line < len(owner) and owner[line] is not None}
+
+def new_batch_case(test_cfg, index, tries=None):
+    # Seeded like the standalone cases, see create_test()
+    if tries is None:
+        tries = test_cfg.first_attempt + 1
+    t0 = time.time()
+    seed_case(test_cfg, index, tries - 1)
+    packets = gen_packet_set(test_cfg)
+    times = dict.fromkeys(PHASES, 0.)
+    times['generate'] = time.time() - t0
+    case = TestCase(test_cfg, packets, None, None, tries, times, index)
+    return BatchCase(case, gen_case_src_sections(case))
+
+def compile_batch(test_cfg, batch, batch_dir, exe):
+    filename = os.path.join(batch_dir, 'out.S')
+    iters = 0
+    unmapped = 0
+    while True:
+        iters += 1
+        src_text = gen_batch_src(test_cfg, batch)
+        with open(filename, 'wt') as f:
+            f.write(src_text)
+        p = compile(exe, test_cfg.cflags, filename)
+        if p.returncode == 0:
+            break
+        output = p.stdout.decode('utf-8') + p.stderr.decode('utf-8')
+        log.debug(("Batch compilation failed.\n"
+                      "=============== OUTPUT\n"
+                      f"{output}\n"
+                      "================"))
+        bad = failing_cases(src_text, filename, output)
+        if not bad:
+            unmapped += 1
+            if unmapped > _MAX_UNMAPPED_RETRIES:
+                raise CompError('batch comp err')
+            bad = range(len(batch))
+        for k in bad:
+            old = batch[k].case
+            batch[k] = new_batch_case(test_cfg, old.index, old.tries + 1)
+    log.info(f'compile_batch took {iters} tries')
+    return batch
+
+def save_failing_case(bc, base, new, batch_dir):
+    '''Creates a standalone case dir with a single-case repro.'''
+    case_dir = mkdtemp(prefix='pkt_')
+    case = bc.case._replace(dir=case_dir,
+                            exe=os.path.join(case_dir, 'test_out'))
+    cfg = case.cfg
+
+    for field in TEMPL_FIELDS:
+        with open(os.path.join(case_dir, field), 'wt') as f:
+            f.write(bc.sections[field])
+    with open(os.path.join(case_dir, 'out.S'), 'wt') as f:
+        f.write(cfg.tmpl.substitute(bc.sections))
+
+    for version, dump in (('base', base), ('new', new)):
+        with open(os.path.join(case_dir, f'snapshot_{version}.bin'), 'wb') as f:
+            f.write(dump)
+        for name in (f'output_{version}.txt', f'output_{version}_err.txt',
+                     f'timeout_{version}.txt'):
+            path = os.path.join(batch_dir, name)
+            if os.path.exists(path):
+                shutil.copy(path, os.path.join(case_dir, f'batch_{name}'))
+        path = os.path.join(batch_dir, infra_error_fname(version))
+        if os.path.exists(path):
+            shutil.copy(path, case_dir)
+
+    if cfg.base_qemu is None:
+        base_cmd = _snapshot_hexagon_sim_cmd(case)
+    else:
+        base_cmd = _snapshot_qemu_cmd(case, cfg.base_qemu)
+    write_repro(case, DebugRun(base_cmd, None),
+                DebugRun(_snapshot_qemu_cmd(case), None))
+    decode_snapshots(case)
+    return case
+
+def read_dump(batch_dir, version):
+    path = os.path.join(batch_dir, f'snapshot_{version}.bin')
+    if not os.path.exists(path):
+        return b''
+    with open(path, 'rb') as f:
+        return f.read()
+
+def run_batch(test_cfg, batch):
+    batch_dir = mkdtemp(prefix='batch_')
+    exe = os.path.join(batch_dir, 'test_out')
+
+    t0 = time.time()
+    try:
+        batch = compile_batch(test_cfg, batch, batch_dir, exe)
+    except CompError:
+        log.info(f'batch of {len(batch)} cases does not compile, '
+                 'running them one by one')
+        shutil.rmtree(batch_dir)
+        return [gen_test(test_cfg, bc.case.index) for bc in batch]
+    t_sec = time.time() - t0
+    log.info(f'batch creation took {t_sec:.2f} seconds')
+
+    packets = [p for bc in batch for p in bc.case.packets]
+    batch_case = TestCase(test_cfg, packets, batch_dir, exe)
+    base_fn, new_fn = run_fns(batch_case)
+
+    t0 = time.time()
+    base_timed_out, base_err, _ = run_once(batch_case, base_fn, "base")
+    t1 = time.time()
+    new_timed_out, new_err, _ = run_once(batch_case, new_fn, "new")
+    t2 = time.time()
+    log.info(f'batch run of {len(batch)} cases took {t2 - t0:.2f} seconds')
+    run_failed = base_timed_out or base_err or new_timed_out or new_err
+    # The shared costs are split evenly among the cases
+    shared = {'compile': t_sec, 'base': t1 - t0, 'new': t2 - t1}
+    for bc in batch:
+        for phase, t in shared.items():
+            bc.case.times[phase] += t / len(batch)
+
+    base, new = read_dump(batch_dir, 'base'), read_dump(batch_dir, 'new')
+    case_bytes = test_cfg.test_iters * snapshot.RECORD_BYTES
+    complete = min(len(base), len(new)) // case_bytes
+
+    results = []
+    remaining = []
+    for k, bc in enumerate(batch):
+        t0 = time.time()
+        if run_failed and k > complete:
+            # Nothing is known about the cases after the one that broke
+            # the run, give them another go without it.
+            remaining.append(bc)
+            continue
+        case_base = base[k * case_bytes:(k + 1) * case_bytes]
+        case_new = new[k * case_bytes:(k + 1) * case_bytes]
+        matches = k < complete and case_base == case_new
+        bc.case.times['compare'] += time.time() - t0
+        if matches:
+            results.append((False, bc.case))
+        else:
+            results.append((True, save_failing_case(bc, case_base, case_new,
+                                                    batch_dir)))
+
+    shutil.rmtree(batch_dir)
+    if remaining:
+        results += run_batch(test_cfg, remaining)
+    return results
+
+def gen_batch(test_cfg, indices):
+    batch = [new_batch_case(test_cfg, index) for index in indices]
+    return run_batch(test_cfg, batch)
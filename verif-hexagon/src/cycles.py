@@ -0,0 +1,563 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Cycle model accuracy. For every opcode in the DECODE_OPINFO table of
+# the standalone systests' cycle_estimates.h.inc, a hardware loop of one
+# packet with that instruction is run under QEMU and timed with pcycle.
+# Besides the instruction alone, the packet parallelism is checked with
+# two independent copies of it in the packet, and with an add next to
+# it: a packet is expected to take as long as its slowest instruction.
+#
+# Each loop is timed at two trip counts and the difference is used, so
+# the pcycle reads and the loop setup cancel out. What remains of the
+# loop itself is measured on a { nop } loop and subtracted.
+#
+# Memory instructions get their base register pointed into a data
+# buffer before the loop, with small offsets and no post-increment, so
+# every iteration accesses the same place.
+
+import argparse
+import json
+import multiprocessing as mp
+import os
+import os.path
+import random
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import time
+from collections import namedtuple, defaultdict, OrderedDict
+from string import Template
+from tempfile import mkdtemp
+
+from src import log
+from src import server
+from src import snapshot
+from src.gen_all import regs_in_double_reg
+from src.gen_usr import populate_inst
+from src.legality import Inst, get_checker
+from src.regs import gprs
+from src.run_test import QEMU, TOOLCHAIN_PATH, QEMU_MACHINE_NAME, \
+    setup_toolchain, compile, error_lines, lines_owner, _run
+
+BASEDIR = os.path.join(os.path.dirname(__file__), "../")
+ESTIMATES = os.path.join(BASEDIR,
+    '../standalone_systests/src/cycle_estimates.h.inc')
+
+DUMP_FNAME = 'cycles.bin'
+SYSCFG_PCYCLEEN_BIT = 6
+# pcycle at the start and end of the short and of the long loop
+STAMPS = 4
+MODES = ('single', 'dual', 'add')
+BASELINE_TAG = 'A2_nop'
+FILLER_TAG = 'A2_addi'
+POPULATE_TRIES = 20
+# The base registers point to the middle of it, the largest offset
+# (memd(Rs32+#s11:3)) stays inside
+DATA_BYTES = 32 * 1024
+DATA_BASE = f'##cycles_data+{DATA_BYTES // 2}'
+
+Kernel = namedtuple('Kernel', 'tag,mode,insts,expected,setup')
+Measured = namedtuple('Measured', 'kernel,cycles')
+CyclesCfg = namedtuple('CyclesCfg', 'arch,cflags,tmpl,qemu_bin,iters,output,keep')
+
+_estimate_pat = re.compile(
+    r'DECODE_OPINFO\((\w+),\s*DECODE_CYCLES\((\d+)\)\)')
+_ctrl_dest = re.compile(r'^\s*C\w+\s*=')
+_reg_pair = re.compile(r'\br(\d+):(\d+)\b')
+_reg = re.compile(r'\br(\d+)\b')
+# The address operands, for the iset syntax and the populated one
+_addr = re.compile(r'\b(v?mem\w*|dc\w+|ic\w+|l2fetch|allocframe|deallocframe)'
+                   r'\(([^()]*)\)')
+_addr_immed = re.compile(r'(\+\+)?#([sSuU])(\d+)(?::(\d+))?')
+_iset_base = re.compile(r'\s*R\w+32(?!\s*(<<|=))')
+_base = re.compile(r'\s*(r\d+)\b(?!:)')
+_mod_reg = re.compile(r'\bm[01]\b')
+
+# Not timed at all
+_omit_attrs = {
+    'A_PRIV': 'privileged',
+    'A_FAKEINSN': 'not an instruction',
+    'A_MAPPING': 'not an instruction',
+    # Toolchain fails to compile those at the moment
+    'A_EXTENSION_AUDIO': 'not supported by the toolchain',
+}
+
+def parse_estimates(path):
+    with open(path, 'rt') as f:
+        return OrderedDict((tag, int(cycles))
+                           for tag, cycles in _estimate_pat.findall(f.read()))
+
+class _Insts(list):
+    '''(name, syntax) pairs for the packet checker, which takes a dict;
+    the same name can appear twice here.'''
+    def items(self):
+        return list.__iter__(self)
+
+    def __iter__(self):
+        return (name for name, _ in list.__iter__(self))
+
+class _Packet:
+    def __init__(self, pairs):
+        self.insts = _Insts(pairs)
+
+def used_regs(syntax):
+    regs = set()
+    for hi, lo in _reg_pair.findall(syntax):
+        regs.update((f'r{hi}', f'r{lo}'))
+    regs.update(f'r{n}' for n in _reg.findall(syntax))
+    return regs
+
+def unusable(iset, tag):
+    '''Why tag can't be timed in a loop, or None.'''
+    inst = iset[tag]
+    syntax = inst['syntax']
+    attrs = inst['attrs'].split(',')
+    if tag.startswith('dep_'):
+        return 'not an instruction'
+    for attr, reason in _omit_attrs.items():
+        if attr in attrs:
+            return reason
+    if re.search(r'\b(trap\d|swi)\b', syntax):
+        return 'raises an exception'
+    if _ctrl_dest.match(syntax):
+        return 'writes a control register'
+    if Inst(syntax, attrs).is_branch:
+        return 'branch'
+    if 'loop' in syntax:
+        return 'sets up a hardware loop'
+    if 'scatter' in syntax or 'gather' in syntax:
+        return 'scatter/gather needs a VTCM buffer'
+    if ':circ' in syntax or ':brev' in syntax:
+        return 'circular or bit-reversed addressing'
+    for _, operand in _addr.findall(syntax):
+        if not _iset_base.match(operand) or 'gp' in operand:
+            return 'absolute or gp-relative address'
+        if operand.lstrip().startswith('Rx') and '++' not in operand:
+            return 'moves its base register'
+    return None
+
+def addr_immed(m):
+    '''A small aligned offset, no post-increment.'''
+    if m.group(1):
+        return '++#0'
+    signed = m.group(2) in 'sS'
+    bits, shift = int(m.group(3)), int(m.group(4) or 0)
+    top = (1 << (bits - 1 if signed else bits)) - 1
+    n = random.randint(-min(4, top + 1) if signed else 0, min(3, top))
+    return f'#{n << shift}'
+
+def fix_addr_immeds(syntax):
+    return _addr.sub(
+        lambda m: f'{m.group(1)}({_addr_immed.sub(addr_immed, m.group(2))})',
+        syntax)
+
+def kernel_setup(pairs):
+    '''The instructions that point the base registers of the packet into
+    cycles_data, and zero its other address registers, or None if the
+    packet writes one of them.'''
+    bases, zeroed, written = set(), set(), set()
+    for _, syntax in pairs:
+        for _, operand in _addr.findall(syntax):
+            m = _base.match(operand)
+            base = {m.group(1)} if m else set()
+            bases |= base
+            zeroed |= used_regs(operand) - base
+        dest = Inst(syntax, ()).dest
+        if dest:
+            written.update(regs_in_double_reg(dest))
+    if bases & zeroed or (bases | zeroed) & written:
+        return None
+    setup = []
+    mods = sorted(set().union(*(_mod_reg.findall(syntax)
+                                for _, syntax in pairs)))
+    if mods:
+        # r2 holds the trip count until loop0, see gen_kernel_src()
+        setup.append('r2 = #0')
+        setup += [f'{mod} = r2' for mod in mods]
+    setup += [f'{reg} = {DATA_BASE}' for reg in sorted(bases)]
+    setup += [f'{reg} = #0' for reg in sorted(zeroed)]
+    return setup
+
+def populate(iset, tag, others=()):
+    '''Operands for tag such that the packet it forms with others passes
+    the legality check and can be set up by kernel_setup(), or None.'''
+    checker = get_checker(iset)
+    inst = dict(iset[tag], syntax=fix_addr_immeds(iset[tag]['syntax']))
+    for _ in range(POPULATE_TRIES):
+        # Atomics come with a pre instruction pointing their address at
+        # memory_access; kernel_setup() takes care of it here.
+        _, syntax = populate_inst(inst)
+        pairs = list(others) + [(tag, syntax)]
+        if checker.check(_Packet(pairs)) is None and \
+           kernel_setup(pairs) is not None:
+            return pairs
+    return None
+
+def new_kernel(tag, mode, pairs, expected):
+    return Kernel(tag, mode, [s for _, s in pairs], expected,
+                  kernel_setup(pairs))
+
+def filler(iset, pairs):
+    '''An add on a register the packet doesn't use.'''
+    used = set().union(*(used_regs(syntax) for _, syntax in pairs))
+    free = [reg for reg in gprs if reg not in used]
+    if not free:
+        return None
+    reg = random.choice(free)
+    packet = pairs + [(FILLER_TAG, f'{reg} = add({reg}, #1)')]
+    if get_checker(iset).check(_Packet(packet)) is not None:
+        return None
+    return packet
+
+def gen_kernels(iset, tags, estimates, modes):
+    '''The kernels to time, and the tags left out with the reason.'''
+    kernels = [Kernel(BASELINE_TAG, 'single', ['nop'],
+                      estimates.get(BASELINE_TAG, 1), [])]
+    skipped = {}
+    for tag in tags:
+        reason = unusable(iset, tag)
+        if reason is not None:
+            skipped[tag] = reason
+            continue
+        est = estimates[tag]
+        single = populate(iset, tag)
+        if single is None:
+            skipped[tag] = 'no legal operands'
+            continue
+        if 'single' in modes:
+            kernels.append(new_kernel(tag, 'single', single, est))
+        if 'dual' in modes:
+            dual = populate(iset, tag, single)
+            if dual is not None:
+                kernels.append(new_kernel(tag, 'dual', dual, est))
+        if 'add' in modes:
+            add = filler(iset, single)
+            if add is not None:
+                kernels.append(new_kernel(tag, 'add', add,
+                                          max(est, estimates.get(FILLER_TAG, 1))))
+    return kernels, skipped
+
+def gen_kernel_src(k, kernel, iters):
+    lines = ['.align 0x04', f'cycles_kernel_{k}:', f'    // {kernel.tag} ({kernel.mode})']
+    packet = '\n      '.join(kernel.insts)
+    for run, n in enumerate(iters):
+        off = (k * STAMPS + run * 2) * 8
+        lines += [
+            f'    r2 = ##{n}',
+            f'    loop0(.Lcycles_{k}_{run}, r2)',
+            '    r1:0 = pcycle',
+            f'    memd(##cycles_results+{off}) = r1:0',
+        ]
+        # Inside the timed part, but the same at both trip counts
+        lines += [f'    {inst}' for inst in kernel.setup]
+        lines += [
+            f'.Lcycles_{k}_{run}:',
+            '    {',
+            f'      {packet}',
+            '    }:endloop0',
+            '    r1:0 = pcycle',
+            f'    memd(##cycles_results+{off + 8}) = r1:0',
+        ]
+    lines.append('    jumpr r31')
+    lines.append(f'cycles_kernel_end_{k}:')
+    return '\n'.join(lines)
+
+def gen_dump(count):
+    args = 'cycles_args'
+    insts = snapshot._semihost_call(snapshot.HEX_SYS_OPEN,
+        ('##cycles_fname', f'#{snapshot.OPEN_MODE_WB}', f'#{len(DUMP_FNAME)}'),
+        args)
+    insts.append('memw(##cycles_fd) = r0')
+    insts += snapshot._semihost_call(snapshot.HEX_SYS_WRITE,
+        ('memw(##cycles_fd)', '##cycles_results', f'##{count * STAMPS * 8}'),
+        args)
+    insts += snapshot._semihost_call(snapshot.HEX_SYS_CLOSE,
+        ('memw(##cycles_fd)',), args)
+    return '    ' + '\n    '.join(insts)
+
+def gen_prog(cfg, kernels):
+    return cfg.tmpl.substitute(
+        results_bytes=len(kernels) * STAMPS * 8,
+        data_bytes=DATA_BYTES,
+        dump_fname=DUMP_FNAME,
+        kernels='\n\n'.join(gen_kernel_src(k, kernel, cfg.iters)
+                            for k, kernel in enumerate(kernels)),
+        pcycle_bit=SYSCFG_PCYCLEEN_BIT,
+        calls='\n'.join(f'    call cycles_kernel_{k}'
+                        for k in range(len(kernels))),
+        dump=gen_dump(len(kernels)),
+        invalid_packet='.word 0x6fffdffc')
+
+def rejected_kernels(filename, src_text, p):
+    owner = lines_owner(src_text, r'cycles_kernel_(\d+):', r'cycles_kernel_end_\d+:')
+    output = p.stdout.decode('utf-8') + p.stderr.decode('utf-8')
+    return {owner[line] for line in error_lines(filename, output)
+            if line < len(owner) and owner[line] is not None}
+
+def build_and_run(cfg, kernels):
+    '''Returns the measurements and the kernels that failed, with the
+    reason. Kernels the assembler rejects are dropped and the rest
+    rebuilt; a program that doesn't run to the end is split in two.'''
+    failed = []
+    workdir = mkdtemp(prefix='cycles_', dir=cfg.output)
+    filename = os.path.join(workdir, 'cycles.S')
+    exe = os.path.join(workdir, 'cycles')
+    while kernels:
+        src_text = gen_prog(cfg, kernels)
+        with open(filename, 'wt') as f:
+            f.write(src_text)
+        p = compile(exe, cfg.cflags, filename)
+        if p.returncode == 0:
+            break
+        bad = rejected_kernels(filename, src_text, p)
+        if not bad:
+            log.debug(f"Compilation failed.\n{p.stderr.decode('utf-8')}")
+            if len(kernels) == 1:
+                failed.append((kernels[0], 'assembler rejected'))
+                kernels = []
+                break
+            half = len(kernels) // 2
+            shutil.rmtree(workdir)
+            a, fa = build_and_run(cfg, kernels[:half])
+            b, fb = build_and_run(cfg, kernels[half:])
+            return a + b, failed + fa + fb
+        failed += [(kernels[k], 'assembler rejected') for k in sorted(bad)]
+        kernels = [kernel for k, kernel in enumerate(kernels) if k not in bad]
+    if not kernels:
+        shutil.rmtree(workdir)
+        return [], failed
+
+    dump = os.path.join(workdir, DUMP_FNAME)
+    cmd = server.standalone_cmd(cfg.qemu_bin, QEMU_MACHINE_NAME[cfg.arch], exe)
+    try:
+        p = _run(cmd, cwd=workdir)
+        ok = p.returncode == 0 and os.path.exists(dump) and \
+            os.path.getsize(dump) == len(kernels) * STAMPS * 8
+    except subprocess.TimeoutExpired:
+        ok = False
+    if not ok:
+        if len(kernels) == 1:
+            log.info(f'{kernels[0].tag} ({kernels[0].mode}): run failed, kept in {workdir}')
+            return [], failed + [(kernels[0], 'run failed')]
+        half = len(kernels) // 2
+        shutil.rmtree(workdir)
+        a, fa = build_and_run(cfg, kernels[:half])
+        b, fb = build_and_run(cfg, kernels[half:])
+        return a + b, failed + fa + fb
+
+    with open(dump, 'rb') as f:
+        stamps = struct.unpack(f'<{len(kernels) * STAMPS}Q', f.read())
+    if not cfg.keep:
+        shutil.rmtree(workdir)
+    short, long_ = cfg.iters
+    measured = []
+    for k, kernel in enumerate(kernels):
+        t = stamps[k * STAMPS:(k + 1) * STAMPS]
+        cycles = ((t[3] - t[2]) - (t[1] - t[0])) / (long_ - short)
+        measured.append(Measured(kernel, cycles))
+    return measured, failed
+
+def run_task(task):
+    return build_and_run(*task)
+
+def report(measured, failed, skipped, tolerance, top):
+    baseline = next(m for m in measured
+                    if m.kernel.tag == BASELINE_TAG and m.kernel.mode == 'single')
+    overhead = baseline.cycles - baseline.kernel.expected
+
+    rows = []
+    by_mode = defaultdict(list)
+    for m in measured:
+        if m is baseline:
+            continue
+        cycles = m.cycles - overhead
+        deviation = cycles - m.kernel.expected
+        rows.append({
+            'tag': m.kernel.tag,
+            'mode': m.kernel.mode,
+            'packet': m.kernel.insts,
+            'expected': m.kernel.expected,
+            'measured': round(cycles, 3),
+            'deviation': round(deviation, 3),
+        })
+        by_mode[m.kernel.mode].append(deviation)
+    mismodeled = sorted((r for r in rows if abs(r['deviation']) > tolerance),
+                        key=lambda r: (-abs(r['deviation']), r['tag'], r['mode']))
+
+    print(f'loop overhead: {overhead:.3f} cycles per iteration')
+    summary = {}
+    for mode in MODES:
+        devs = by_mode.get(mode)
+        if not devs:
+            continue
+        exact = sum(1 for d in devs if abs(d) <= tolerance)
+        summary[mode] = {
+            'measured': len(devs),
+            'within_tolerance': exact,
+            'mean_abs_deviation': round(sum(abs(d) for d in devs) / len(devs), 3),
+        }
+        print(f'{mode}: {exact} of {len(devs)} opcodes within {tolerance} cycles'
+              f', mean |deviation| {summary[mode]["mean_abs_deviation"]}')
+    print(f'not measured: {len(skipped)} skipped, {len(failed)} failed')
+    if mismodeled:
+        print('largest deviations (measured - expected):')
+    for r in mismodeled[:top]:
+        print(f'  {r["tag"]} ({r["mode"]}): {r["measured"]} vs {r["expected"]}'
+              f' ({r["deviation"]:+})')
+
+    not_measured = dict(skipped)
+    for kernel, reason in failed:
+        not_measured[f'{kernel.tag} ({kernel.mode})'] = reason
+    return rows, {
+        'loop_overhead': round(overhead, 3),
+        'tolerance': tolerance,
+        'summary': summary,
+        'mismodeled': [f'{r["tag"]} ({r["mode"]})' for r in mismodeled],
+        'not_measured': OrderedDict(sorted(not_measured.items())),
+    }
+
+def write_csv(fname, rows):
+    with open(fname, 'wt') as f:
+        f.write('tag,mode,expected,measured,deviation,packet\n')
+        for r in rows:
+            packet = '; '.join(r['packet'])
+            f.write(f'{r["tag"]},{r["mode"]},{r["expected"]},{r["measured"]},'
+                    f'{r["deviation"]},"{packet}"\n')
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='Compare the pcycle counts of QEMU with the cycle'
+        ' estimates, for every opcode',
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('-q', '--qemu-bin', type=str,
+        help='location of the QEMU binary',
+        default=QEMU)
+    parser.add_argument('-r', '--hex-rev', type=int,
+        help='Hexagon revision to test',
+        default=None)
+    parser.add_argument('-t', '--iset', type=str,
+        help='A custom path to an iset.py to be used',
+        default=None)
+    parser.add_argument('--estimates', type=str,
+        help='The DECODE_OPINFO table with the expected cycles',
+        default=os.path.normpath(ESTIMATES))
+    parser.add_argument('--tags', type=str, nargs='+',
+        help='Only measure these opcodes',
+        default=None)
+    parser.add_argument('--modes', type=str, nargs='+', choices=MODES,
+        help='Packets to time: the instruction alone, two copies of it,'
+         ' or next to an add',
+        default=list(MODES))
+    parser.add_argument('-i', '--iters', type=int,
+        help='Loop iterations the measurement is made over',
+        default=1000)
+    parser.add_argument('--kernels-per-binary', type=int,
+        help='Loops timed by each test program',
+        default=100)
+    parser.add_argument('--tolerance', type=float,
+        help='Deviation from the estimate, in cycles per packet, above'
+         ' which an opcode is reported as mis-modeled',
+        default=0.1)
+    parser.add_argument('--top', type=int,
+        help='Largest deviations to print, all are in the report',
+        default=20)
+    parser.add_argument('--seed', type=int,
+        help='Seed for the operand choice',
+        default=0)
+    parser.add_argument('-o', '--output-dir', type=str,
+        help='Path to build the test programs in',
+        default=os.path.join(os.getcwd(), 'cycles_' + time.strftime('%Y%b%d_%H%M%S')))
+    parser.add_argument('--keep', action='store_true',
+        help='Keep the test programs',
+        default=False)
+    parser.add_argument('-j', '--proc-count', type=int,
+        help='Process count',
+        default=max(1, int(mp.cpu_count() * .85)))
+    parser.add_argument('-e', '--exit-code', action='store_true',
+        help='Exit with an error if any opcode is mis-modeled',
+        default=False)
+    parser.add_argument('--toolchain-path', type=str,
+        help='The path for the hexagon toolchain',
+        default=TOOLCHAIN_PATH)
+    parser.add_argument('-l', '--logging', type=int,
+        help='Set verbosity level: 0, 1 (default), 2, or 3 (highest verbosity)',
+        default=1)
+    args = parser.parse_args()
+    log.config(args.logging)
+
+    if args.hex_rev is not None and args.iset is not None:
+        sys.exit("--iset and --hex-rev are incompatible. Use just one of them.")
+    if args.iters < 1:
+        sys.exit("--iters must be at least 1")
+    if args.kernels_per_binary < 1:
+        sys.exit("--kernels-per-binary must be at least 1")
+    if not os.path.isfile(args.qemu_bin) or not os.access(args.qemu_bin, os.X_OK):
+        sys.exit(f"'{args.qemu_bin}' is not a valid qemu executable")
+    return args
+
+def main():
+    from src.__main__ import load_iset
+    args = parse_args()
+    setup_toolchain(args.toolchain_path)
+    iset = load_iset(args)
+    estimates = parse_estimates(args.estimates)
+
+    tags = args.tags if args.tags is not None else list(estimates)
+    skipped = {}
+    for tag in tags:
+        if tag not in estimates:
+            skipped[tag] = 'no estimate'
+        elif tag not in iset.iset:
+            skipped[tag] = 'not in the iset'
+    tags = [tag for tag in tags if tag not in skipped]
+
+    random.seed(args.seed)
+    kernels, unusable_tags = gen_kernels(iset.iset, tags, estimates, args.modes)
+    skipped.update(unusable_tags)
+    print(f'{len(kernels)} loops to time for {len(tags) - len(unusable_tags)} opcodes')
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    tmpl = Template(open(os.path.join(BASEDIR, 'etc/cycles.tmpl'), 'rt').read())
+    cflags = f'-m{iset.q6version} -mhvx-ieee-fp -mhvx-qfloat -mhvx -mhmx'
+    # The short loop is just long enough to settle
+    iters = (args.iters // 10 + 1, args.iters // 10 + 1 + args.iters)
+    cfg = CyclesCfg(iset.q6version, cflags, tmpl, args.qemu_bin, iters,
+                    args.output_dir, args.keep)
+    # The baseline loop is the first kernel of the first program
+    per_binary = args.kernels_per_binary
+    tasks = [(cfg, kernels[first:first + per_binary])
+             for first in range(0, len(kernels), per_binary)]
+
+    measured, failed = [], []
+    with mp.Pool(processes=args.proc_count) as p:
+        bar = log.progress_bar('Timing', len(tasks))
+        for done, (m, f) in enumerate(p.imap_unordered(run_task, tasks), 1):
+            measured += m
+            failed += f
+            bar.update(done)
+    if not any(m.kernel.tag == BASELINE_TAG for m in measured):
+        log.critical('The baseline loop could not be timed')
+
+    rows, stats = report(measured, failed, skipped, args.tolerance, args.top)
+    stats['seed'] = args.seed
+    stats['iters'] = list(iters)
+    stats['kernels'] = rows
+    stamp = time.strftime('%Y%d%b_%H%M', time.gmtime())
+    write_csv(f'cycles_{stamp}.csv', rows)
+    with open(f'cycles_{stamp}.json', 'wt') as f:
+        json.dump(stats, f, indent=4)
+        f.write('\n')
+    print(f'report: cycles_{stamp}.csv, cycles_{stamp}.json')
+
+    if not args.keep and not os.listdir(args.output_dir):
+        os.rmdir(args.output_dir)
+    if args.exit_code:
+        sys.exit(bool(stats['mismodeled']))
+
+if __name__ == '__main__':
+    main()
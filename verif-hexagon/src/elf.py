@@ -0,0 +1,54 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Just enough of an ELF32 little-endian reader to load a test program
+# into a running emulator: the loadable segments, the entry point and
+# the symbol table.
+
+import struct
+from collections import namedtuple
+
+Segment = namedtuple('Segment', 'addr,data,memsz')
+
+PT_LOAD = 1
+SHT_SYMTAB = 2
+
+class ElfError(Exception):
+    pass
+
+class Elf:
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.raw = f.read()
+        if self.raw[:4] != b'\x7fELF' or self.raw[4] != 1 or self.raw[5] != 1:
+            raise ElfError(f'{path}: not an ELF32 little-endian file')
+        (self.entry, self.phoff, self.shoff, _, _, self.phentsize,
+         self.phnum, self.shentsize, self.shnum, _) = \
+            struct.unpack_from('<IIIIHHHHHH', self.raw, 0x18)
+
+    def segments(self):
+        for i in range(self.phnum):
+            (p_type, offset, vaddr, _, filesz, memsz, _, _) = \
+                struct.unpack_from('<IIIIIIII', self.raw,
+                                   self.phoff + i * self.phentsize)
+            if p_type == PT_LOAD and memsz:
+                yield Segment(vaddr, self.raw[offset:offset + filesz], memsz)
+
+    def _section(self, i):
+        return struct.unpack_from('<IIIIIIIIII', self.raw,
+                                  self.shoff + i * self.shentsize)
+
+    def symbols(self):
+        syms = {}
+        for i in range(self.shnum):
+            (_, sh_type, _, _, offset, size, link, _, _, entsize) = self._section(i)
+            if sh_type != SHT_SYMTAB:
+                continue
+            strtab_off = self._section(link)[4]
+            for off in range(offset, offset + size, entsize):
+                name, value = struct.unpack_from('<II', self.raw, off)
+                end = self.raw.index(b'\0', strtab_off + name)
+                syms[self.raw[strtab_off + name:end].decode('ascii')] = value
+        return syms
@@ -86,8 +86,14 @@ def filter_regs(from_regs, exclude_regs):
 class PacketGenError(Exception):
     pass
 
-def get_mem_access(inits, packet):
-    access_size = random.choice(list(access_size_syntax.keys()))
+def pick(choices, weights):
+    if weights is None:
+        return random.choice(choices)
+    return random.choices(choices, weights)[0]
+
+def get_mem_access(inits, packet, sched=None):
+    sizes = list(access_size_syntax.keys())
+    access_size = pick(sizes, sched.size_weights(sizes) if sched else None)
     size = access_size_syntax[access_size]
     mem_addr_regs = ('r1', 'r2', 'r3')
     init_written_regs = get_written_regs(inits)
@@ -97,7 +103,7 @@ def get_mem_access(inits, packet):
         size.replace('mem', 'memu')
 
     addr_modes = ('reg_offset', 'reg_sum', 'reg_incr',)
-    mode = random.choice(addr_modes)
+    mode = pick(addr_modes, sched.mode_weights(addr_modes) if sched else None)
 
     written_regs = get_written_regs(packet)
     if mode == 'reg_incr':
@@ -65,8 +65,11 @@ def get_hvx_pred_insts(): return [f'{reg} = {randvbool()}' for reg in vec_preds4
 def randbool(): return random.choice(['cmp.eq(r0,r0)','cmp.eq(r0,r1)'])
 def get_pred_insts(): return [f'{reg} = {randbool()}' for reg in preds]
 
-test_gpr_insts = get_gpr_insts()
-test_gpr_init  = '\n    '.join(test_gpr_insts)
+def get_gpr_values(): return [init_state_val() for r in gprs]
+def gpr_init_insts(values):
+    return '\n    '.join(f'{r} = #0x{v:08x}' for r, v in zip(gprs, values))
+def gpr_init_words(values):
+    return '\n    '.join(f'.word 0x{v:08x}' for v in values)
 
 _MEM_WORDS = 16
 _MEM_REPEAT = 128
@@ -85,8 +88,74 @@ def get_hvx_init():
     test_hvx_init  = hvx_setup + hvx_regs
     return test_hvx_init
 
-test_pred_init = '\n    '.join(get_pred_insts())
+def get_pred_init(): return '\n    '.join(get_pred_insts())
 
-mem_rand_words = '\n    '.join('.word 0x{:08x}'.format(randval()) for i in range(_MEM_WORDS))
+def pred_init_word(pred_init, gpr_values):
+    '''The p3:0 value pred_init leaves, run right after the GPR init.'''
+    r0, r1 = gpr_values[0], gpr_values[1]
+    value = 0
+    for i, inst in enumerate(pred_init.split('\n')):
+        if inst.endswith('cmp.eq(r0,r0)') or r0 == r1:
+            value |= 0xff << (8 * i)
+    return f'.word 0x{value:08x}'
+
+def get_mem_rand_words():
+    return '\n    '.join('.word 0x{:08x}'.format(randval()) for i in range(_MEM_WORDS))
+
+def gen_init_routines():
+    '''The memory window and the routines that set the initial state of a
+    standalone case from its memory_image, pred_image and gpr_image. They
+    are the same for every case, and go in the cached fixed object.'''
+    padding_bytes = _MEM_PADDING_REPEAT * _MEM_WORDS * 4
+    blocks = _MEM_REPEAT + 2 * _MEM_PADDING_REPEAT
+    copy = '\n    '.join(f'r5:4 = memd(r2+#{off})\n    memd(r0+#{off}) = r5:4'
+                         for off in range(0, _MEM_WORDS * 4, 8))
+    loads = '\n    '.join(f'{r} = memw(r28+#{i * 4})'
+                         for i, r in enumerate(gprs) if r != 'r28')
+    return f'''
+.global memory_access
+.align 8
+memory_prefix:
+.skip {padding_bytes}
+memory_access:
+.skip {_MEM_BYTES}
+memory_suffix:
+.skip {padding_bytes}
+    .type memory_access, @object
+
+// Fills the memory window with copies of memory_image
+.align 0x04
+.global memory_init
+memory_init:
+    r0 = ##memory_prefix
+    r1 = #{blocks}
+1:
+    r2 = ##memory_image
+    {copy}
+    r0 = add(r0, #{_MEM_WORDS * 4})
+    r1 = add(r1, #-1)
+    p0 = cmp.gt(r1, #0)
+    if (p0) jump 1b
+    jumpr r31
+
+// Goes before gpreg_init, it needs a GPR
+.align 0x04
+.global pred_init
+pred_init:
+    r0 = ##pred_image
+    r0 = memw(r0+#0)
+    p3:0 = r0
+    jumpr r31
+
+.align 0x04
+.global gpreg_init
+gpreg_init:
+    r28 = ##gpr_image
+    {loads}
+    r28 = memw(r28+#{gprs.index('r28') * 4})
+    jumpr r31
+    .type gpreg_init, @function
+    .size gpreg_init, . - gpreg_init
+'''
 
 JUMP_TARGET_CNT = 6
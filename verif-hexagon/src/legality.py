@@ -0,0 +1,205 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Packet legality model. Rejecting illegal packets used to be left to
+# hexagon-clang, which costs a full compiler spawn per rejected case.
+# This checks the packet grouping rules from the iset attributes before
+# anything is written out: solo instructions, slot assignment, memory
+# and store counts, branch counts, HVX resources, duplicate destinations
+# (but for writers predicated on opposite senses of one predicate) and
+# .new producers. Attributes missing from an iset simply don't
+# constrain anything, the assembler remains the final judge.
+
+import re
+from itertools import permutations
+
+from src.gen_all import regs_in_double_reg
+
+ALL_SLOTS = frozenset(range(4))
+MAX_WORDS = 4
+
+_slot_only_attrs = {
+    'A_RESTRICT_SLOT0ONLY': {0},
+    'A_RESTRICT_SLOT1ONLY': {1},
+    'A_RESTRICT_SLOT2ONLY': {2},
+    'A_RESTRICT_SLOT3ONLY': {3},
+}
+_solo_attrs = ('A_RESTRICT_SOLO', 'A_RESTRICT_NOPACKET')
+_mem_attrs = ('A_LOAD', 'A_STORE', 'A_MEMOP')
+_branch_attrs = ('A_JUMP', 'A_COF')
+
+# Slots by instruction type, for isets that carry a 'type' field.
+_type_slots = {
+    'ALU32': ALL_SLOTS,
+    'XTYPE': {2, 3},
+    'J': {2, 3},
+    'JR': {2},
+    'CR': {3},
+    'LD': {0, 1},
+    'ST': {0, 1},
+    'SYSTEM': {0, 2, 3},
+}
+
+# HVX resources: (units used, {limited resource: units})
+_hvx_resources = {
+    'A_CVI_4SLOT': (4, {}),
+    'A_CVI_VA_DV': (2, {}),
+    'A_CVI_VX_DV': (2, {'VX': 2}),
+    'A_CVI_VP_VS': (2, {'VP': 1, 'VS': 1}),
+    'A_CVI_VX': (1, {'VX': 1}),
+    'A_CVI_VP': (1, {'VP': 1}),
+    'A_CVI_VS': (1, {'VS': 1}),
+    'A_CVI_VA': (1, {}),
+}
+_hvx_limits = {'VX': 2, 'VP': 1, 'VS': 1}
+
+_pred_dest = re.compile(r'^(p[0-3])\s*=')
+_reg_dest = re.compile(r'^(r\d+(?::\d+)?)\s*=')
+_new_reg = re.compile(r'\b(r\d+)\.new\b')
+_new_pred = re.compile(r'\b(p[0-3])\.new\b')
+_post_incr = re.compile(r'\((r\d+)\+\+')
+_cond = re.compile(r'^if\s*\(\s*(!?)\s*(p[0-3](?:\.new)?)\s*\)')
+
+class Inst:
+    def __init__(self, syntax, attrs, itype=None):
+        self.syntax = syntax
+        self.attrs = attrs
+        text = re.sub(r'^if\s*\([^)]*\)\s*', '', syntax.strip())
+        m = _cond.match(syntax.strip())
+        # (predicate, negated), None for an unconditional instruction
+        self.cond = (m.group(2), m.group(1) == '!') if m else None
+        self.dest = None
+        self.pair_dest = False
+        m = _reg_dest.match(text)
+        if m:
+            self.dest = m.group(1)
+            self.pair_dest = ':' in self.dest
+        m = _pred_dest.match(text)
+        self.pred_dest = m.group(1) if m else None
+        self.new_regs = set(_new_reg.findall(syntax))
+        self.new_preds = set(_new_pred.findall(syntax))
+        self.incremented = set(_post_incr.findall(syntax))
+
+        is_mem = any(a in attrs for a in _mem_attrs) or bool(
+            re.search(r'\bv?mem[a-z]*\(', syntax))
+        self.is_store = is_mem and bool(re.match(r'^(if\s*\([^)]*\)\s*)?v?mem\w*\(.*\)\S*\s*=', syntax.strip()))
+        self.is_mem = is_mem
+        self.is_hvx_mem = is_mem and 'vmem' in syntax
+        self.is_nv_store = self.is_store and bool(self.new_regs)
+        self.is_branch = any(a in attrs for a in _branch_attrs) or \
+            bool(re.search(r'\bjump\b', syntax))
+        self.words = 2 if ('##' in syntax or 'immext' in syntax) else 1
+
+        slots = set(_type_slots.get(itype, ALL_SLOTS))
+        if is_mem:
+            slots &= {0, 1}
+        if self.is_nv_store:
+            slots &= {0}
+        if self.is_branch:
+            slots &= {2, 3}
+        for attr, only in _slot_only_attrs.items():
+            if attr in attrs:
+                slots &= only
+        if 'A_RESTRICT_NOSLOT1' in attrs:
+            slots.discard(1)
+        self.slots = frozenset(slots)
+
+    def written_regs(self):
+        regs = set(regs_in_double_reg(self.dest)) if self.dest else set()
+        return regs | self.incremented
+
+def complementary(a, b):
+    '''Whether a and b are predicated on opposite senses of the same
+    predicate, so that they may write the same register.'''
+    return a.cond is not None and b.cond is not None and \
+        a.cond[0] == b.cond[0] and a.cond[1] != b.cond[1]
+
+class PacketChecker:
+    def __init__(self, iset):
+        self.iset = iset
+
+    def _inst(self, name, syntax):
+        if name in self.iset:
+            entry = self.iset[name]
+            return Inst(syntax, entry['attrs'].split(','), entry.get('type'))
+        # Synthesized memory accesses
+        return Inst(syntax, ())
+
+    def check(self, packet):
+        '''Returns None for a legal packet, otherwise the reason why not.'''
+        insts = [self._inst(name, syntax) for name, syntax in packet.insts.items()]
+
+        if len(insts) > 1:
+            for name in packet.insts:
+                if name in self.iset and any(a in self.iset[name]['attrs'].split(',')
+                                             for a in _solo_attrs):
+                    return f'{name} must be alone in its packet'
+
+        if sum(i.words for i in insts) > MAX_WORDS:
+            return 'too many words'
+        if not any(all(s in inst.slots for s, inst in zip(perm, insts))
+                   for perm in permutations(range(4), len(insts))):
+            return 'no slot assignment'
+
+        mem = [i for i in insts if i.is_mem]
+        stores = [i for i in mem if i.is_store]
+        if len(mem) > 2:
+            return 'too many memory accesses'
+        if len(stores) > 2:
+            return 'too many stores'
+        if any(i.is_nv_store for i in stores) and len(stores) > 1:
+            return 'new-value store with another store'
+        hvx_mem = [i for i in mem if i.is_hvx_mem]
+        if sum(1 for i in hvx_mem if i.is_store) > 1 or \
+           sum(1 for i in hvx_mem if not i.is_store) > 1:
+            return 'too many HVX memory accesses'
+        if sum(1 for i in insts if i.is_branch) > 2:
+            return 'too many branches'
+
+        units = 0
+        limited = {}
+        for inst in insts:
+            for attr, (used, res) in _hvx_resources.items():
+                if attr in inst.attrs:
+                    units += used
+                    for name, n in res.items():
+                        limited[name] = limited.get(name, 0) + n
+                    break
+        if units > 4:
+            return 'too many HVX resources'
+        if any(limited.get(name, 0) > limit for name, limit in _hvx_limits.items()):
+            return 'HVX resource conflict'
+
+        written = {}
+        writers = {}
+        for inst in insts:
+            for reg in inst.written_regs():
+                if not all(complementary(other, inst)
+                           for other in writers.get(reg, ())):
+                    return f'{reg} written twice'
+                writers.setdefault(reg, []).append(inst)
+                written.setdefault(reg, inst)
+        for inst in insts:
+            for reg in inst.new_regs:
+                producer = written.get(reg)
+                if producer is None or producer is inst:
+                    return f'{reg}.new without a producer'
+                if producer.pair_dest:
+                    return f'{reg}.new from an invalid producer'
+            for pred in inst.new_preds:
+                # Compound compare-and-jumps produce their own predicate
+                if re.search(rf'\b{pred}\s*=', inst.syntax):
+                    continue
+                if not any(other.pred_dest == pred for other in insts
+                           if other is not inst):
+                    return f'{pred}.new without a producer'
+        return None
+
+_checkers = {}
+
+def get_checker(iset):
+    if id(iset) not in _checkers:
+        _checkers[id(iset)] = PacketChecker(iset)
+    return _checkers[id(iset)]
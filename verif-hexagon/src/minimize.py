@@ -0,0 +1,285 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Delta-debugging minimizer for failing cases. Starting from a case dir
+# saved by 'packet_verif verif', it shrinks, one after the other: the set
+# of packets, the instructions within each remaining packet, the test
+# iterations, and the initial register and memory state (values are
+# zeroed rather than removed). Each candidate is rebuilt from the case's
+# section files and checked with the case's own repro.sh; candidates of a
+# ddmin step are tried in parallel.
+
+import argparse
+import multiprocessing as mp
+import os
+import re
+import shutil
+import subprocess
+import sys
+from collections import namedtuple
+from tempfile import mkdtemp
+
+from src import log
+from src.run_test import TEMPL_FIELDS
+
+Packet = namedtuple('Packet', 'pre,label,tags,insts,attrs')
+
+_packet_pat = re.compile(
+    r'\n(?P<pre>(?:[^\n]*\n)*?)\s*(?P<label>\d+):\n'
+    r'\s*// tags: (?P<tags>[^\n]*)\n'
+    r'\s*\{\n(?P<body>(?:[^\n]*\n)*?)\s*\}(?P<attrs>\S*)')
+
+def parse_packets(text):
+    packets = []
+    for m in _packet_pat.finditer(text):
+        lines = lambda s: [l.strip() for l in s.split('\n') if l.strip()]
+        packets.append(Packet(lines(m.group('pre')), m.group('label'),
+                              m.group('tags'), lines(m.group('body')),
+                              m.group('attrs')))
+    return packets
+
+def format_packets(packets):
+    def format_packet(p):
+        pre_packet = '\n        '.join(p.pre)
+        test_packet = '\n          '.join(p.insts)
+        return f'''
+        {pre_packet}
+        {p.label}:
+        // tags: {p.tags}
+        {{
+          {test_packet}
+        }}{p.attrs}
+    '''
+    return '\n'.join(format_packet(p) for p in packets)
+
+def split_iters(text):
+    iters = []
+    for line in text.split('\n'):
+        if line.strip() == 'call test_case' or not iters:
+            iters.append([])
+        iters[-1].append(line)
+    return ['\n'.join(it) for it in iters]
+
+# How each piece of initial state is simplified
+_zeroed = (
+    (re.compile(r'^(r\d+) = #0x[0-9a-f]+$'), r'\1 = #0x00000000'),
+    (re.compile(r'^(v\d+) = .*$'), r'\1 = vxor(\1,\1)'),
+    (re.compile(r'^\.word 0x[0-9a-f]+$'), r'.word 0x00000000'),
+)
+
+def zero_line(line):
+    for pat, repl in _zeroed:
+        if pat.match(line.strip()):
+            return pat.sub(repl, line.strip())
+    return None
+
+STATE_FIELDS = ('gpr_image', 'hvx_init', 'hvx_mutate', 'mem_init')
+
+def state_items(sections):
+    '''The (field, line index) of every simplifiable state line.'''
+    items = []
+    for field in STATE_FIELDS:
+        for i, line in enumerate(sections[field].split('\n')):
+            if zero_line(line) not in (None, line.strip()):
+                items.append((field, i))
+    return items
+
+def with_state(sections, kept, all_items):
+    sections = dict(sections)
+    kept = set(kept)
+    for field in STATE_FIELDS:
+        lines = sections[field].split('\n')
+        for item in all_items:
+            if item[0] == field and item not in kept:
+                lines[item[1]] = zero_line(lines[item[1]])
+        sections[field] = '\n    '.join(l.strip() for l in lines)
+    return sections
+
+def first_diff(base, new):
+    '''Name of the first register/location that differs, if any.'''
+    base_lines = base.split('\n')
+    new_lines = new.split('\n')
+    for b, n in zip(base_lines, new_lines):
+        if b != n and '=' in b:
+            return b.split('=')[0].strip()
+        if b != n:
+            return b.strip()
+    return None if len(base_lines) == len(new_lines) else 'length'
+
+# What repro.sh creates, and the minimizer's own dirs
+_REPRO_OUTPUTS = ('test_out', 'out_repro.S', '*_output.txt', 'snapshot*.bin',
+                  'min', 'min_*')
+
+class Minimizer:
+    def __init__(self, case_dir, proc_count, timeout, same_diff):
+        self.case_dir = os.path.realpath(case_dir)
+        self.proc_count = proc_count
+        self.timeout = timeout
+        self.same_diff = same_diff
+        self.work = mkdtemp(prefix='min_', dir=self.case_dir)
+        self.trials = 0
+        with open(os.path.join(self.case_dir, 'repro.sh'), 'rt') as f:
+            self.repro = f.read()
+        self.sections = {}
+        for field in TEMPL_FIELDS:
+            with open(os.path.join(self.case_dir, field), 'rt') as f:
+                self.sections[field] = f.read()
+        self.signature = None
+
+    def write_case(self, dest, sections):
+        # The repro needs more than the sections (test_case_script.lldb in
+        # lldb mode): start from a copy of the case, without its outputs.
+        shutil.copytree(self.case_dir, dest, dirs_exist_ok=True,
+                        ignore=shutil.ignore_patterns(*_REPRO_OUTPUTS))
+        for field in TEMPL_FIELDS:
+            with open(os.path.join(dest, field), 'wt') as f:
+                f.write(sections[field])
+        repro = os.path.join(dest, 'repro.sh')
+        with open(repro, 'wt') as f:
+            f.write(re.sub(r'^(\S*subst\.py) \S+', rf'\1 {dest}', self.repro,
+                           flags=re.M))
+        os.chmod(repro, 0o755)
+
+    def outcome(self, sections):
+        '''Runs a candidate, returns the first difference or None.'''
+        trial = mkdtemp(dir=self.work)
+        try:
+            self.write_case(trial, sections)
+            try:
+                subprocess.run(['bash', 'repro.sh'], cwd=trial,
+                    stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                    timeout=self.timeout)
+            except subprocess.TimeoutExpired:
+                return None
+            outputs = [os.path.join(trial, f'{version}_output.txt')
+                       for version in ('base', 'new')]
+            # The candidate must build, and both emulators must produce
+            # something for the difference to mean anything.
+            if not os.path.exists(os.path.join(trial, 'test_out')) or \
+               not all(os.path.exists(o) and os.path.getsize(o) for o in outputs):
+                return None
+            texts = []
+            for o in outputs:
+                with open(o, 'rt', errors='replace') as f:
+                    texts.append(f.read())
+            base, new = texts
+            return first_diff(base, new)
+        finally:
+            shutil.rmtree(trial, ignore_errors=True)
+
+    def interesting(self, sections):
+        diff = self.outcome(sections)
+        if diff is None:
+            return False
+        return not self.same_diff or diff == self.signature
+
+    def ddmin(self, items, build, pool, allow_empty=False):
+        '''Classic ddmin: a 1-minimal subset of items for which
+        build(subset) still reproduces the failure.'''
+        if allow_empty and self.interesting(build([])):
+            return []
+        # Work on indices, items aren't necessarily distinct
+        idx = list(range(len(items)))
+        subset = lambda c: [items[i] for i in c]
+        n = 2
+        while len(idx) >= 2:
+            chunk = (len(idx) + n - 1) // n
+            subsets = [idx[i:i + chunk] for i in range(0, len(idx), chunk)]
+            complements = [[x for x in idx if x not in s] for s in subsets]
+            candidates = subsets + (complements if len(subsets) > 2 else [])
+            results = pool.map(_interesting,
+                               [(self, build(subset(c))) for c in candidates])
+            self.trials += len(candidates)
+            found = next((i for i, ok in enumerate(results) if ok), None)
+            if found is None:
+                if n >= len(idx):
+                    break
+                n = min(len(idx), n * 2)
+                continue
+            idx = candidates[found]
+            n = 2 if found < len(subsets) else max(n - 1, 2)
+            log.info(f'  {len(idx)} left after {self.trials} runs')
+        return subset(idx)
+
+    def run(self):
+        self.signature = self.outcome(self.sections)
+        if self.signature is None:
+            log.critical(f'{self.case_dir} does not reproduce a mismatch')
+        print(f'original case differs first at: {self.signature}')
+
+        sections = self.sections
+        with mp.Pool(processes=self.proc_count) as pool:
+            packets = parse_packets(sections['test_packets'])
+            print(f'packets: {len(packets)}')
+            build = lambda ps: dict(sections, test_packets=format_packets(ps))
+            packets = self.ddmin(packets, build, pool)
+            sections = build(packets)
+
+            for k in range(len(packets)):
+                print(f'instructions in packet {packets[k].label}: {len(packets[k].insts)}')
+                def build_insts(insts, k=k):
+                    ps = list(packets)
+                    ps[k] = ps[k]._replace(insts=insts)
+                    return dict(sections, test_packets=format_packets(ps))
+                insts = self.ddmin(packets[k].insts, build_insts, pool)
+                packets[k] = packets[k]._replace(insts=insts)
+                sections = build(packets)
+
+            iters = split_iters(sections['test_cases'])
+            print(f'iterations: {len(iters)}')
+            build = lambda its: dict(sections, test_cases='\n'.join(its))
+            iters = self.ddmin(iters, build, pool)
+            sections = build(iters)
+
+            items = state_items(sections)
+            print(f'initial state values: {len(items)}')
+            build = lambda kept: with_state(sections, kept, items)
+            sections = build(self.ddmin(items, build, pool, allow_empty=True))
+
+        dest = os.path.join(self.case_dir, 'min')
+        self.write_case(dest, sections)
+        shutil.rmtree(self.work, ignore_errors=True)
+        print(f'{self.trials} runs, minimized case: {dest}')
+        print(f'  {len(packets)} packets, '
+              f'{sum(len(p.insts) for p in packets)} instructions, '
+              f'{len(iters)} iterations')
+        return dest
+
+def _interesting(args):
+    minimizer, sections = args
+    return minimizer.interesting(sections)
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='Shrink a failing case to a minimal repro',
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('case_dir', type=str,
+        help='A pkt_* dir saved by a verif run')
+    parser.add_argument('-j', '--proc-count', type=int,
+        help='Number of candidates run in parallel',
+        default=max(1, int(mp.cpu_count() * .85)),
+        required=False)
+    parser.add_argument('--timeout', type=float,
+        help='Timeout, in seconds, for each candidate',
+        default=225.,
+        required=False)
+    parser.add_argument('--any-diff', dest='same_diff', action='store_false',
+        help='Accept candidates that differ anywhere, instead of only the'
+         ' ones that differ first at the same place as the original',
+        default=True,
+        required=False)
+    parser.add_argument('-l', '--logging', type=int,
+        help='Set verbosity level: 0, 1 (default), 2, or 3 (highest verbosity)',
+        default=1,
+        required=False)
+    args = parser.parse_args()
+    log.config(args.logging)
+    if not os.path.exists(os.path.join(args.case_dir, 'repro.sh')):
+        sys.exit(f"'{args.case_dir}' has no repro.sh")
+    return args
+
+if __name__ == '__main__':
+    args = parse_args()
+    Minimizer(args.case_dir, args.proc_count, args.timeout, args.same_diff).run()
@@ -0,0 +1,76 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Assembly object cache. The parts of a test program that don't depend
+# on the generated packets are assembled once, into an object named
+# after the hash of their source and compiler flags, and every case just
+# links against it. The cache dir can be shared by all workers: objects
+# are created under a temporary name and renamed into place.
+#
+# Packet shapes that keep failing to assemble are also remembered, so
+# that the generator stops proposing them.
+
+import hashlib
+import os
+from collections import Counter
+
+# A shape is rejected after failing this many times without ever
+# assembling. A single failure can just be an unlucky operand choice.
+NEGATIVE_THRESHOLD = 3
+
+class ObjCacheError(Exception):
+    pass
+
+class ObjCache:
+    def __init__(self, cache_dir):
+        self.dir = cache_dir
+        os.makedirs(self.dir, exist_ok=True)
+        self.hits = 0
+        self.misses = 0
+
+    def object_for(self, src_text, flags, compile_fn):
+        '''Returns the path of the object for src_text, assembling it with
+        compile_fn(obj, src) if it isn't cached yet.'''
+        key = hashlib.sha256((flags + '\0' + src_text).encode('utf-8')).hexdigest()
+        obj = os.path.join(self.dir, f'{key}.o')
+        if os.path.exists(obj):
+            self.hits += 1
+            return obj
+
+        self.misses += 1
+        tmp = f'{obj}.{os.getpid()}'
+        src = f'{tmp}.S'
+        with open(src, 'wt') as f:
+            f.write(src_text)
+        p = compile_fn(tmp, src)
+        os.remove(src)
+        if p.returncode != 0:
+            raise ObjCacheError(p.stderr.decode('utf-8'))
+        os.replace(tmp, obj)
+        return obj
+
+class NegativeCache:
+    def __init__(self):
+        self.failures = Counter()
+        self.assembled = set()
+
+    def failed(self, shape):
+        if shape not in self.assembled:
+            self.failures[shape] += 1
+
+    def passed(self, shape):
+        self.assembled.add(shape)
+        self.failures.pop(shape, None)
+
+    def rejects(self, shape):
+        return self.failures[shape] >= NEGATIVE_THRESHOLD
+
+_obj_caches = {}
+negative = NegativeCache()
+
+def get_cache(output_dir):
+    if output_dir not in _obj_caches:
+        _obj_caches[output_dir] = ObjCache(os.path.join(output_dir, 'objcache'))
+    return _obj_caches[output_dir]
@@ -0,0 +1,177 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Differential performance mode. The generated test programs make
+# decent TCG microbenchmarks: each case is run standalone, without the
+# debugger, under the base and the new QEMU, keeping the best wall time
+# of a few repeats along with the peak RSS. Most of a run is QEMU startup
+# and loading the program, so the same program without its test section
+# is timed as well and its time taken off: the rates and the slowdowns are
+# those of the test section. Cases where the new build is slower than the
+# base beyond a threshold are kept, and the slowdowns are summarized per
+# instruction tag to point at the affected class.
+
+import json
+import math
+import os
+import os.path
+import shlex
+import shutil
+import stat
+import subprocess
+import threading
+import time
+from collections import namedtuple, defaultdict
+
+from src import log
+from src.run_test import RUN_TIMEOUT, TEMPL_FIELDS, create_test, compile, \
+    _snapshot_qemu_cmd
+
+PerfCfg = namedtuple('PerfCfg', 'repeat,threshold')
+PerfRun = namedtuple('PerfRun', 'wall,maxrss_kb,returncode')
+# base_idle and new_idle: the runs of the program without its test section
+PerfResult = namedtuple('PerfResult', 'base,new,insts,base_idle,new_idle')
+
+IDLE_EXE = 'idle_out'
+# Floor of the test section time, for tests within the timing noise
+_MIN_TEST_SECS = 1e-3
+
+def perf_run(cmd, cwd):
+    '''Runs cmd, returns its wall time and peak RSS.'''
+    log.debug(f'Running "{cmd}"')
+    t0 = time.perf_counter()
+    p = subprocess.Popen(shlex.split(cmd), cwd=cwd, stdin=subprocess.DEVNULL,
+        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    timer = threading.Timer(RUN_TIMEOUT, p.kill)
+    timer.start()
+    try:
+        # wait4() rather than Popen.wait() to get the child's own rusage
+        _, status, rusage = os.wait4(p.pid, 0)
+    finally:
+        timer.cancel()
+    wall = time.perf_counter() - t0
+    p.returncode = os.waitstatus_to_exitcode(status)
+    return PerfRun(wall, rusage.ru_maxrss, p.returncode)
+
+def best_run(cmd, cwd, repeat):
+    runs = [perf_run(cmd, cwd) for _ in range(repeat)]
+    return min(runs, key=lambda r: r.wall)
+
+def test_insts(case):
+    '''Instructions executed in the test packets, over all iterations.'''
+    per_iter = sum(len(p.insts) + len(p.pre_insts) for p in case.packets)
+    return per_iter * case.cfg.test_iters
+
+def test_secs(run, idle):
+    '''Wall time of the test section alone.'''
+    return max(run.wall - idle.wall, _MIN_TEST_SECS)
+
+def slowdown(result):
+    return test_secs(result.new, result.new_idle) / \
+        test_secs(result.base, result.base_idle)
+
+def gen_idle_prog(case):
+    '''Builds the case's program without its test section, returns its
+    path.'''
+    sections = {}
+    for field in TEMPL_FIELDS:
+        with open(os.path.join(case.dir, field), 'rt') as f:
+            sections[field] = f.read()
+    sections['test_cases'] = ''
+    filename = os.path.join(case.dir, 'idle.S')
+    with open(filename, 'wt') as f:
+        f.write(case.cfg.tmpl.substitute(sections))
+    exe = os.path.join(case.dir, IDLE_EXE)
+    p = compile(exe, case.cfg.cflags, filename)
+    if p.returncode != 0:
+        # It is the program that just compiled, less some calls
+        log.critical(f"The idle program of {case.dir} does not compile:\n"
+                     f"{p.stderr.decode('utf-8')}")
+    return exe
+
+def write_perf_repro(case, cmds):
+    repro = os.path.join(case.dir, 'repro.sh')
+    with open(repro, 'wt') as f:
+        s = os.fstat(f.fileno())
+        os.fchmod(f.fileno(), s.st_mode | stat.S_IEXEC)
+        f.write(f'''#!/bin/bash
+# case dir: __FILL_IN_DIR__
+cd "$(dirname "$0")"
+''')
+        for cmd in cmds:
+            f.write(f"time {cmd.replace(case.dir, '.')}\n")
+
+def gen_perf_test(test_cfg, index):
+    case = create_test(test_cfg, index)
+    idle_case = case._replace(exe=gen_idle_prog(case))
+    base_cmd = _snapshot_qemu_cmd(case, test_cfg.base_qemu)
+    new_cmd = _snapshot_qemu_cmd(case)
+    base_idle_cmd = _snapshot_qemu_cmd(idle_case, test_cfg.base_qemu)
+    new_idle_cmd = _snapshot_qemu_cmd(idle_case)
+
+    repeat = test_cfg.perf.repeat
+    base = best_run(base_cmd, case.dir, repeat)
+    new = best_run(new_cmd, case.dir, repeat)
+    base_idle = best_run(base_idle_cmd, case.dir, repeat)
+    new_idle = best_run(new_idle_cmd, case.dir, repeat)
+    case.times['base'] += base.wall + base_idle.wall
+    case.times['new'] += new.wall + new_idle.wall
+    result = PerfResult(base, new, test_insts(case), base_idle, new_idle)
+    case = case._replace(perf=result)
+
+    failed = any(run.returncode != 0
+                 for run in (base, new, base_idle, new_idle))
+    slow = slowdown(result) > 1. + test_cfg.perf.threshold
+    log.info(f'base {base.wall:.3f}s ({base_idle.wall:.3f}s idle),'
+             f' new {new.wall:.3f}s ({new_idle.wall:.3f}s idle),'
+             f' {slowdown(result):.2f}x')
+    if not (slow or failed):
+        shutil.rmtree(case.dir)
+        return False, case
+
+    write_perf_repro(case, (base_cmd, new_cmd, base_idle_cmd, new_idle_cmd))
+    with open(os.path.join(case.dir, 'perf.json'), 'wt') as f:
+        json.dump(perf_entry(result), f, indent=4)
+        f.write('\n')
+    return True, case
+
+def perf_entry(result):
+    entry = {}
+    for version, run, idle in (('base', result.base, result.base_idle),
+                               ('new', result.new, result.new_idle)):
+        secs = test_secs(run, idle)
+        entry[version] = {
+            'wall': round(run.wall, 4),
+            'idle_wall': round(idle.wall, 4),
+            'test_secs': round(secs, 4),
+            'insts_per_sec': round(result.insts / secs),
+            'maxrss_kb': run.maxrss_kb,
+            'returncode': run.returncode,
+        }
+    entry['slowdown'] = round(slowdown(result), 4)
+    return entry
+
+def summarize(cases, top=10):
+    '''Geometric mean slowdown, overall and per tag.'''
+    overall = []
+    by_tag = defaultdict(list)
+    for case in cases:
+        ratio = math.log(slowdown(case.perf))
+        overall.append(ratio)
+        for tag in {tag for packet in case.packets for tag in packet.tags}:
+            by_tag[tag].append(ratio)
+    geomean = lambda logs: math.exp(sum(logs) / len(logs)) if logs else 1.
+    tags = sorted(((geomean(logs), tag, len(logs)) for tag, logs in by_tag.items()),
+                  reverse=True)
+
+    print(f'geomean slowdown (new/base): {geomean(overall):.3f}x'
+          f' over {len(overall)} cases')
+    print('slowest tags:')
+    for ratio, tag, n in tags[:top]:
+        print(f'  {tag}: {ratio:.3f}x ({n} cases)')
+    return {
+        'geomean_slowdown': geomean(overall),
+        'by_tag': {tag: {'slowdown': ratio, 'cases': n} for ratio, tag, n in tags},
+    }
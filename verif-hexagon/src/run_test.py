@@ -16,20 +16,29 @@ import shutil
 import time
 import sys
 import stat
+import re
 
 from src import log
 from src.gen_usr import populate_inst
 from src.gen_all import get_mem_access, PacketGenError
 from src.regs import m, ctrls, preds, vec_preds4, vecs, gprs
-from src.initialization import test_gpr_init, get_hvx_init, test_pred_init, \
-    mem_rand_words, _MEM_REPEAT, _MEM_PADDING_REPEAT, JUMP_TARGET_CNT
+from src.initialization import get_gpr_values, gpr_init_insts, \
+    gpr_init_words, get_hvx_init, get_pred_init, pred_init_word, \
+    get_mem_rand_words, gen_init_routines, _MEM_REPEAT, _MEM_PADDING_REPEAT, \
+    JUMP_TARGET_CNT
 from src import mut
 from src import log
 from src.adjust_output import adjust_binary_output
+from src import snapshot
+from src import server
+from src import objcache
+from src import legality
+from src import schedule
 
 QEMU = '/prj/qct/llvm/target/vp_qemu_llvm/qemu_builds/build-latest/Tools/QEMUHexagon/bin/qemu-system-hexagon'
 TOOLCHAIN_PATH = '/prj/qct/llvm/release/internal/HEXAGON/branch-23.0/linux64/latest/Tools/bin'
 LLDB, CC, SIM = '', '', ''
+RUN_TIMEOUT = 225.
 
 def setup_toolchain(path):
     global LLDB, CC, SIM
@@ -39,12 +48,12 @@ def setup_toolchain(path):
 
 #from memory_profiler import profile
 #@profile
-def _run(cmd, env=None, block=True):
+def _run(cmd, env=None, block=True, cwd=None):
     log.debug(f'Running "{cmd}"')
     try:
-        debug_res = subprocess.run(shlex.split(cmd), timeout=225.,
+        debug_res = subprocess.run(shlex.split(cmd), timeout=RUN_TIMEOUT,
              stdout=subprocess.PIPE, stderr=subprocess.PIPE,
-            env=env)
+            env=env, cwd=cwd)
     except subprocess.TimeoutExpired as e:
         log.debug(f'timeout while executing "{e.cmd}"')
         raise
@@ -93,6 +102,67 @@ def _debug_hexagon_sim(test_case):
     extra_args = f'{mach_arg} --pmu_statsfile /dev/null'
     return _debug(extra_args, test_case)
 
+def _snapshot(cmd, test_case, version, env=None):
+    # The guest writes its dump relative to the emulator's working dir.
+    dump = os.path.join(test_case.dir, snapshot.SNAPSHOT_FNAME)
+    if os.path.exists(dump):
+        os.remove(dump)
+    run_info = DebugRun(cmd, env)
+    run = _run(cmd, env=env, cwd=test_case.dir)
+    if os.path.exists(dump):
+        os.replace(dump, os.path.join(test_case.dir, f'snapshot_{version}.bin'))
+    return run_info, run
+
+def _snapshot_qemu_cmd(test_case, qemu=None):
+    if qemu is None:
+        qemu = test_case.cfg.qemu_bin
+    return server.standalone_cmd(qemu, QEMU_MACHINE_NAME[test_case.cfg.arch],
+                                 test_case.exe)
+
+def _snapshot_hexagon_sim_cmd(test_case):
+    mach_arg = f'--m{sim_machine_name(test_case.cfg.arch)}'
+    return f'{SIM} {mach_arg} --pmu_statsfile /dev/null {test_case.exe}'
+
+def _snapshot_qemu(test_case, version, qemu=None):
+    return _snapshot(_snapshot_qemu_cmd(test_case, qemu), test_case, version)
+
+def _snapshot_hexagon_sim(test_case, version):
+    return _snapshot(_snapshot_hexagon_sim_cmd(test_case), test_case, version)
+
+def infra_error_fname(version):
+    return f'infra_error_{version}.txt'
+
+def infra_error(test_case):
+    '''Whether the case failed because an emulator could not run it at all.'''
+    return any(os.path.exists(os.path.join(test_case.dir, infra_error_fname(v)))
+               for v in ('base', 'new'))
+
+def _persistent_qemu(test_case, version, qemu=None):
+    if qemu is None:
+        qemu = test_case.cfg.qemu_bin
+    srv = server.get_server(qemu, QEMU_MACHINE_NAME[test_case.cfg.arch],
+                            RUN_TIMEOUT)
+    dump = os.path.join(srv.workdir, snapshot.SNAPSHOT_FNAME)
+    if os.path.exists(dump):
+        os.remove(dump)
+    # The repro still runs a standalone emulator, with the server's options.
+    run_info = DebugRun(server.standalone_cmd(qemu, srv.machine, test_case.exe),
+                        None)
+    try:
+        run = srv.run(test_case.exe)
+    except OSError as e:
+        # Not the case's fault: the case is kept as an infrastructure
+        # error, and the next one starts a fresh emulator.
+        log.info(f'{qemu} failed on {test_case.exe}: {e}')
+        srv.stop()
+        with open(os.path.join(test_case.dir, infra_error_fname(version)),
+                  'wt') as f:
+            f.write(f'{e}\n')
+        run = subprocess.CompletedProcess(run_info.cmd, 1, b'', str(e).encode())
+    if os.path.exists(dump):
+        shutil.move(dump, os.path.join(test_case.dir, f'snapshot_{version}.bin'))
+    return run_info, run
+
 def compile_cmd(tc_bin, cflags, test_input):
     cmd = f'{CC} -g -o {tc_bin} {cflags} {test_input}'
     return cmd
@@ -101,6 +171,55 @@ def compile(tc_bin, cflags, test_input):
     cmd = compile_cmd(tc_bin, cflags, test_input)
     return _run(cmd)
 
+def compile_obj(obj, cflags, test_input):
+    return _run(f'{CC} -g -c -o {obj} {cflags} {test_input}')
+
+def error_lines(filename, compiler_output):
+    '''Yields the (0-based) source lines the compiler complained about.'''
+    pattern = re.escape(os.path.basename(filename)) + r':(\d+):\d+: error'
+    for m in re.finditer(pattern, compiler_output):
+        yield int(m.group(1)) - 1
+
+def lines_owner(src_text, label_pattern, end_pattern):
+    '''For every line of src_text, the index captured by the last
+    label_pattern match seen, or None outside of any.'''
+    owner = []
+    current = None
+    for line in src_text.split('\n'):
+        m = re.match(label_pattern, line)
+        if m:
+            current = int(m.group(1))
+        elif re.match(end_pattern, line):
+            current = None
+        owner.append(current)
+    return owner
+
+def packet_lines_owner(src_text):
+    '''For every line of a test_case, the index of the packet it belongs
+    to, or None. A packet's pre_insts come before its label: the lines
+    between a packet's closing brace and the next label are the next
+    packet's.'''
+    owner = []
+    pending = None
+    current = None
+    for line in src_text.split('\n'):
+        m = re.match(r'\s*(\d+):\s*$', line)
+        if m:
+            current = int(m.group(1))
+            for i in pending or ():
+                owner[i] = current
+            pending = None
+        elif re.match(r'test_case:', line):
+            pending = []
+        elif re.match(r'test_end:', line):
+            current, pending = None, None
+        owner.append(current)
+        if pending is not None:
+            pending.append(len(owner) - 1)
+        elif current is not None and re.match(r'\s*\}', line):
+            current, pending = None, []
+    return owner
+
 def get_inst_tags(iset):
     log.workaround("QTOOL-77570, QTOOL-78875")
     log.workaround("QTOOL-88095")
@@ -183,13 +302,38 @@ run
 '''
 
 TestPacket = namedtuple('TestPacket', 'pre_insts,insts,tags,valid_attrs')
+def packet_shape(packet):
+    synth = (name for name in packet.insts if name.startswith('synth_'))
+    return tuple(sorted(packet.tags)) + tuple(sorted(synth))
+
+def corpus_packet(cfg, entry):
+    '''Replays a corpus packet, as it was or with new operands.'''
+    if random.choice((True, False)):
+        return TestPacket(entry['pre_insts'], entry['insts'], entry['tags'],
+                          set(entry['valid_attrs']))
+    init = []
+    case = {}
+    for tag in entry['tags']:
+        pre, inst_syntax = populate_inst(cfg.iset[tag])
+        case[tag] = inst_syntax
+        if pre is not None:
+            init.append(pre)
+    return TestPacket(init, case, entry['tags'], set())
+
 def gen_packet(cfg):
     iset = cfg.iset
     tags = cfg.tags
+    sched = schedule.get_scheduler(cfg.guide) if cfg.guide else None
+    if sched is not None:
+        entry = sched.corpus_entry()
+        if entry is not None and all(tag in iset for tag in entry['tags']):
+            return corpus_packet(cfg, entry)
+
     packet_inst_count = random.randint(1, cfg.inst_per_packet)
     non_solo_tags = [t for t in tags if 'A_RESTRICT_SOLO' not in iset[t]['attrs'].split(',')]
-    packet = random.choices(
-        non_solo_tags if packet_inst_count > 0 else tags,
+    choices = non_solo_tags if packet_inst_count > 0 else tags
+    packet = random.choices(choices,
+        weights=sched.tag_weights(choices) if sched else None,
         k=packet_inst_count)
 
     init = []
@@ -207,13 +351,13 @@ def gen_packet(cfg):
 
     packet_attrs = set()
     if random.random() < 0.5 and len(case) < 4 and not has_extender:
-        pre, access = get_mem_access(init, case.values())
+        pre, access = get_mem_access(init, case.values(), sched)
         init.append(pre)
         case['synth_mem'] = access
         added_mem_inst += 1
 
         if len(case) < 4:
-            pre, access = get_mem_access(init, case.values())
+            pre, access = get_mem_access(init, case.values(), sched)
             init.append(pre)
             case['synth_mem2'] = access
             added_mem_inst += 1
@@ -223,6 +367,15 @@ def gen_packet(cfg):
 
     return TestPacket(init, case, packet, packet_attrs)
 
+INIT_ROUTINES = gen_init_routines()
+
+MUTATIONS = (
+    'xor',
+    'rot',
+    'flip',
+    'brev',
+)
+
 def gen_case_src_sections(case):
     def get_test_packets():
         for packet_index, (init_insts, packet, tags, possible_attrs) in enumerate(case.packets):
@@ -242,16 +395,22 @@ def gen_case_src_sections(case):
             yield test_packet
 
     test_packets = '\n'.join(get_test_packets())
-    gpr_init = test_gpr_init
+    gpr_values = get_gpr_values()
+    gpr_init = gpr_init_insts(gpr_values)
     hvx_init = get_hvx_init()
-    pred_init = test_pred_init
-    mem_init = mem_rand_words
+    pred_init = get_pred_init()
+    mem_init = get_mem_rand_words()
+    # The standalone program sets its initial state with the fixed
+    # routines of init_routines from these, batches use the code above.
+    gpr_image = gpr_init_words(gpr_values)
+    pred_image = pred_init_word(pred_init, gpr_values)
+    init_routines = INIT_ROUTINES
     mem_repeat = str(_MEM_REPEAT)
     mem_padding_repeat = str(_MEM_PADDING_REPEAT)
 
 #   hvx_mutate = mut.vec_rot
     hvx_mutate = get_hvx_init()
-    gpr_xor = mut.gpr_xor
+    gpr_xor = mut.get_gpr_xor()
     gpr_flip = mut.gpr_flip
     gpr_brev = mut.gpr_brev
     gpr_rot = mut.gpr_rot
@@ -268,32 +427,75 @@ def gen_case_src_sections(case):
 
     jump_targets = '\n'.join(_jump_targets)
 
-    muts = (
-        'xor',
-        'rot',
-        'flip',
-        'brev',
-    )
-    def pick_mut(i): return muts[i%len(muts)]
+    def pick_mut(i): return MUTATIONS[i%len(MUTATIONS)]
 
-    test_cases = [f'''    call test_case
+    save_state = '\n    call snapshot_save' if case.cfg.snapshot else ''
+    test_cases = [f'''    call test_case{save_state}
     call mutate_{pick_mut(i)}''' for i in range(case.cfg.test_iters)]
     test_cases = '\n'.join(test_cases)
+
+    if case.cfg.snapshot:
+        snapshot_routines = snapshot.gen_snapshot_routines()
+        snapshot_open = '    call snapshot_open'
+        snapshot_close = '    call snapshot_close'
+    else:
+        snapshot_routines, snapshot_open, snapshot_close = '', '', ''
     return locals()
 
-TestCfg = namedtuple('TestCfg', 'iset,arch,tags,test_iters,test_packets,inst_per_packet,cflags,tmpl,output,qemu_bin,base_qemu')
-TestCase = namedtuple('TestCase', 'cfg,packets,dir,exe')
+TestCfg = namedtuple('TestCfg', 'iset,arch,tags,test_iters,test_packets,inst_per_packet,cflags,tmpl,output,qemu_bin,base_qemu,snapshot,cases_per_binary,batch_tmpl,persistent,obj_cache,split_tmpl,legality_check,guide,seed,perf,first_attempt')
+TestCase = namedtuple('TestCase', 'cfg,packets,dir,exe,tries,times,index,perf',
+    defaults=(1, None, None, None))
+
+# Phases timed for each case, see src/stats.py
+PHASES = ('generate', 'compile', 'base', 'new', 'compare')
 
 class CompError(Exception):
     pass
 
+def compile_cached(test_case, case):
+    '''Assembles only the packets part of the program and links it with
+    the cached object for the rest.'''
+    cfg = test_case.cfg
+    fixed_tmpl, packets_tmpl = cfg.split_tmpl
+    cache = objcache.get_cache(cfg.output)
+    try:
+        fixed_obj = cache.object_for(fixed_tmpl.substitute(case), CC + cfg.cflags,
+            lambda obj, src: compile_obj(obj, cfg.cflags, src))
+    except objcache.ObjCacheError as e:
+        log.debug(f"Compilation of the fixed sections failed:\n{e}")
+        raise CompError('comp err')
+
+    filename = os.path.join(test_case.dir, 'test_packets.S')
+    src_text = packets_tmpl.substitute(case)
+    with open(filename, 'wt') as f:
+        f.write(src_text)
+    return _run(f'{CC} -g -o {test_case.exe} {cfg.cflags} {filename} {fixed_obj}'), \
+        filename, src_text
+
+def update_negative_cache(test_case, p, filename, src_text):
+    shapes = [packet_shape(packet) for packet in test_case.packets]
+    if p.returncode == 0:
+        for shape in shapes:
+            objcache.negative.passed(shape)
+        return
+    owner = packet_lines_owner(src_text)
+    output = p.stdout.decode('utf-8') + p.stderr.decode('utf-8')
+    bad = {owner[line] for line in error_lines(filename, output)
+           if line < len(owner) and owner[line] is not None}
+    for index in bad:
+        objcache.negative.failed(shapes[index])
+
 def gen_case_prog(test_case):
     filename = os.path.join(test_case.dir, 'out.S')
     case = gen_case_src_sections(test_case)
     with open(filename, 'wt') as f:
         case_text = test_case.cfg.tmpl.substitute(case)
         f.write(case_text)
-    p = compile(test_case.exe, test_case.cfg.cflags, filename)
+    if test_case.cfg.obj_cache:
+        p, packets_fname, packets_text = compile_cached(test_case, case)
+        update_negative_cache(test_case, p, packets_fname, packets_text)
+    else:
+        p = compile(test_case.exe, test_case.cfg.cflags, filename)
     if p.returncode != 0:
         log.debug(("Compilation failed.\n"
                       "=============== OUTPUT\n"
@@ -324,7 +526,9 @@ def run_once(test_case, runfn, version):
     if run:
         file = os.path.join(test_case.dir, f'output_{version}.txt')
         with open(file, 'wb') as f:
-            stdout = adjust_binary_output(run.stdout)
+            stdout = run.stdout
+            if not test_case.cfg.snapshot:
+                stdout = adjust_binary_output(stdout)
             f.write(stdout)
         file = os.path.join(test_case.dir, f'output_{version}_err.txt')
         with open(file, 'wb') as f:
@@ -340,15 +544,24 @@ def print_info(test_cfg):
     print(f"  BASE: {base}")
     print(f"  NEW:  {test_cfg.qemu_bin}")
 
-def run_case(test_case):
-    if test_case.cfg.base_qemu is None:
+def run_fns(test_case):
+    if test_case.cfg.snapshot:
+        qemu_fn = _persistent_qemu if test_case.cfg.persistent else _snapshot_qemu
+        if test_case.cfg.base_qemu is None:
+            base_fn = lambda case: _snapshot_hexagon_sim(case, "base")
+        else:
+            base_fn = lambda case: qemu_fn(case, "base",
+                                           qemu=test_case.cfg.base_qemu)
+        new_fn = lambda case: qemu_fn(case, "new")
+    elif test_case.cfg.base_qemu is None:
         base_fn = _debug_hexagon_sim
+        new_fn = _debug_qemu
     else:
         base_fn = lambda case: _debug_qemu(case, qemu=test_case.cfg.base_qemu)
+        new_fn = _debug_qemu
+    return base_fn, new_fn
 
-    base_timed_out, base_err, base_inf = run_once(test_case, base_fn, "base")
-    new_timed_out, new_err, new_inf = run_once(test_case, _debug_qemu, "new")
-
+def write_repro(test_case, base_inf, new_inf):
     repro = os.path.join(test_case.dir, 'repro.sh')
     base_env = '\n'.join([f'{key}={val} \\' for key, val in base_inf.env.items()]) if base_inf and base_inf.env else ''
     base_cmd = base_inf.cmd.replace(test_case.dir, '.') if base_inf else '/bin/false'
@@ -358,9 +571,30 @@ def run_case(test_case):
     subst_py = os.path.join(os.path.dirname(__file__), '..', 'scripts', 'subst.py')
     adjust_py = os.path.join(os.path.dirname(__file__), 'adjust_output.py')
 
+    snapshot_py = os.path.join(os.path.dirname(__file__), 'snapshot.py')
+    verif_dir = os.path.realpath(os.path.join(os.path.dirname(__file__), '..'))
+
     with open(repro, 'wt') as f:
         s = os.fstat(f.fileno())
         os.fchmod(f.fileno(), s.st_mode | stat.S_IEXEC)
+        if test_case.cfg.snapshot:
+            f.write(f'''#!/bin/bash
+{subst_py} __FILL_IN_DIR__ || exit 1
+{comp_cmd} || exit 1
+
+{base_cmd}
+mv {snapshot.SNAPSHOT_FNAME} snapshot_base.bin
+
+{new_cmd}
+mv {snapshot.SNAPSHOT_FNAME} snapshot_new.bin
+
+PYTHONPATH={verif_dir} python3 {snapshot_py} snapshot_base.bin > base_output.txt
+PYTHONPATH={verif_dir} python3 {snapshot_py} snapshot_new.bin > new_output.txt
+
+exec diff base_output.txt new_output.txt
+''')
+            return
+
         f.write(f'''#!/bin/bash
 {subst_py} __FILL_IN_DIR__ || exit 1
 {comp_cmd} || exit 1
@@ -376,6 +610,18 @@ def run_case(test_case):
 
 exec diff base_output.txt new_output.txt
 ''')
+
+def run_case(test_case):
+    base_fn, new_fn = run_fns(test_case)
+
+    t0 = time.time()
+    base_timed_out, base_err, base_inf = run_once(test_case, base_fn, "base")
+    t1 = time.time()
+    new_timed_out, new_err, new_inf = run_once(test_case, new_fn, "new")
+    test_case.times['base'] += t1 - t0
+    test_case.times['new'] += time.time() - t1
+
+    write_repro(test_case, base_inf, new_inf)
     return (new_timed_out or base_timed_out), (new_err or base_err)
 
 def gen_packet_set(test_cfg):
@@ -386,39 +632,77 @@ def gen_packet_set(test_cfg):
             try:
                 packet = gen_packet(test_cfg)
             except PacketGenError:
-                pass
+                continue
+            if test_cfg.obj_cache and objcache.negative.rejects(packet_shape(packet)):
+                packet = None
+            elif test_cfg.legality_check:
+                reason = legality.get_checker(test_cfg.iset).check(packet)
+                if reason is not None:
+                    log.debug(f'illegal packet ({reason}): {list(packet.insts.values())}')
+                    packet = None
+        if test_cfg.guide:
+            schedule.get_scheduler(test_cfg.guide).update(packet)
         packets.append(packet)
     return packets
 
 
+CASE_TEMPLATES = ('test_case.tmpl', 'test_packets.tmpl')
+
+def read_case_templates(basedir):
+    '''The test program is the fixed sections followed by the packets.'''
+    return [open(os.path.join(basedir, 'etc', name), 'rt').read()
+            for name in CASE_TEMPLATES]
+
 TEMPL_FIELDS = '''gpr_brev
         gpr_flip
+        gpr_image
         gpr_init
         gpr_rot
         gpr_xor
         hvx_init
         hvx_mutate
+        init_routines
         invalid_packet
         jump_targets
+        pred_image
         pred_init
         mem_padding_repeat
         mem_init
         mem_repeat
+        snapshot_close
+        snapshot_open
+        snapshot_routines
         test_cases
         test_packets'''.split()
 
 
-def create_test(test_cfg):
+def seed_case(test_cfg, index, attempt):
+    '''Each generation attempt of each case draws from its own stream, so
+    that a case can be generated again from the seed, its index and the
+    attempt that compiled.'''
+    random.seed(f'{test_cfg.seed}:{index}:{attempt}')
+
+def create_test(test_cfg, index):
     cant_compile = True
     tmpdir = mkdtemp(prefix='pkt_')
-    iters = 0
+    # An attempt is numbered iters - 1, as the case's tries are
+    iters = test_cfg.first_attempt
+    times = dict.fromkeys(PHASES, 0.)
     while cant_compile:
         iters += 1
         try:
+            t0 = time.time()
+            seed_case(test_cfg, index, iters - 1)
             packets = gen_packet_set(test_cfg)
+            t1 = time.time()
+            times['generate'] += t1 - t0
             exe = os.path.join(tmpdir,'test_out')
-            test_case = TestCase(test_cfg, packets, tmpdir, exe)
-            sections = gen_case_prog(test_case)
+            test_case = TestCase(test_cfg, packets, tmpdir, exe, iters, times,
+                                 index)
+            try:
+                sections = gen_case_prog(test_case)
+            finally:
+                times['compile'] += time.time() - t1
 
             for field in TEMPL_FIELDS:
                 fname = os.path.join(tmpdir, field)
@@ -434,9 +718,31 @@ def create_test(test_cfg):
         return test_case
     return None
 
-def gen_test(test_cfg):
+def compare_outputs(case):
+    if not case.cfg.snapshot:
+        return filecmp.cmp(
+                os.path.join(case.dir, 'output_base.txt'),
+                os.path.join(case.dir, 'output_new.txt'))
+    base, new = (os.path.join(case.dir, f'snapshot_{version}.bin')
+                 for version in ('base', 'new'))
+    if not os.path.exists(base) or not os.path.exists(new):
+        return False
+    return filecmp.cmp(base, new, shallow=False)
+
+def decode_snapshots(case):
+    # Keep a human readable form of the dumps for review.sh
+    for version in ('base', 'new'):
+        dump = os.path.join(case.dir, f'snapshot_{version}.bin')
+        if not os.path.exists(dump):
+            continue
+        with open(dump, 'rb') as f:
+            text = snapshot.decode(f.read())
+        with open(os.path.join(case.dir, f'snapshot_{version}.txt'), 'wt') as f:
+            f.write(text)
+
+def gen_test(test_cfg, index):
     t0 = time.time()
-    case = create_test(test_cfg)
+    case = create_test(test_cfg, index)
     t_sec = time.time() - t0
     log.info(f'test creation took {t_sec:.2f} seconds')
 
@@ -444,18 +750,21 @@ def gen_test(test_cfg):
     timed_out, err = run_case(case)
     t_sec = time.time() - t0
     log.info(f'test run took {t_sec:.2f} seconds')
+    t0 = time.time()
     if timed_out or err:
         matches = False
     else:
-        matches = filecmp.cmp(
-                os.path.join(case.dir, 'output_base.txt'),
-                os.path.join(case.dir, 'output_new.txt'))
+        matches = compare_outputs(case)
+    case.times['compare'] += time.time() - t0
 
     out_new_fname = os.path.join(case.dir, 'output_new.txt')
-    last_line = open(out_new_fname, 'rt').readlines()[-1] if os.path.exists(out_new_fname) else ''
+    out_new_lines = open(out_new_fname, 'rt').readlines() if os.path.exists(out_new_fname) else []
+    last_line = out_new_lines[-1] if out_new_lines else ''
 
     if matches:
         shutil.rmtree(case.dir)
+    elif case.cfg.snapshot:
+        decode_snapshots(case)
     elif 'run' in last_line:
         # We sometimes see hard to explain failures where
         # the debugger output looks as if there are breakpoints
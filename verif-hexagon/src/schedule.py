@@ -0,0 +1,161 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Coverage-guided generation. Sampling tags uniformly spends most of the
+# run on instructions that have been tested thousands of times already.
+# The scheduler weighs each tag, memory access size and addressing mode
+# by how little it has been exercised: the counts start from the stats of
+# previous runs and keep growing with what this worker generates. Tags
+# whose QEMU code was never reached according to gcov get an extra boost.
+#
+# Packets from cases that found mismatches are kept in a corpus and
+# replayed, verbatim or with fresh operands, in later runs.
+
+from collections import namedtuple, Counter
+import json
+import os.path
+import random
+import re
+import subprocess
+
+from src import log
+from src.gen_all import access_size_syntax
+
+GuideCfg = namedtuple('GuideCfg', 'inst_counts,mem_counts,uncovered,corpus,corpus_dir')
+
+CORPUS_FNAME = 'corpus.jsonl'
+# Chance of taking a packet from the corpus instead of generating one
+CORPUS_RATE = 0.1
+# Weight multiplier for tags never reached in the QEMU gcov data
+UNCOVERED_BOOST = 4.
+
+def mem_access_kind(access):
+    '''Classifies a synthesized memory access as (access size, addr mode).'''
+    m = re.search(r'\b(v?mem[a-z]*)\(([^)]*)\)', access)
+    if m is None:
+        return None
+    name = m.group(1).replace('memu', 'mem')
+    sizes = {syntax: size for size, syntax in access_size_syntax.items()}
+    size = sizes.get(name)
+    if '++' in m.group(2):
+        mode = 'reg_incr'
+    elif '<<' in m.group(2):
+        mode = 'reg_sum'
+    else:
+        mode = 'reg_offset'
+    return size, mode
+
+def mem_counts_of(packets):
+    counts = Counter()
+    for packet in packets:
+        for name, access in packet.insts.items():
+            if name.startswith('synth_'):
+                kind = mem_access_kind(access)
+                if kind is not None:
+                    counts[f'{kind[0]}:{kind[1]}'] += 1
+    return counts
+
+def read_stats(fnames):
+    inst_counts, mem_counts = Counter(), Counter()
+    for fname in fnames:
+        with open(fname, 'rt') as f:
+            entry = json.load(f)
+        inst_counts.update(entry['inst_counts'])
+        mem_counts.update(entry.get('mem_counts', {}))
+    return inst_counts, mem_counts
+
+def gcov_uncovered(build_dir, tags):
+    '''Tags whose QEMU helpers/generators gcov reports as never called.
+    Needs a QEMU build with gcov data, see 'packet_verif coverage'.'''
+    p = subprocess.run(['find', build_dir, '-name', '*.gcov'],
+        stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    fnames = p.stdout.decode('utf-8').split()
+    if not fnames:
+        log.critical(f"No .gcov files under '{build_dir}', run 'packet_verif coverage' first.")
+
+    tags = set(tags)
+    called = Counter()
+    seen = set()
+    func_pat = re.compile(r'^function (\w+) called (\d+)')
+    for fname in fnames:
+        with open(fname, 'rt', errors='replace') as f:
+            for line in f:
+                m = func_pat.match(line)
+                if m is None:
+                    continue
+                tag = re.sub(r'^(helper|gen|emit|fGEN_TCG)_', '', m.group(1))
+                if tag in tags:
+                    seen.add(tag)
+                    called[tag] += int(m.group(2))
+    return {tag for tag in seen if called[tag] == 0}
+
+def read_corpus(corpus_dir):
+    path = os.path.join(corpus_dir, CORPUS_FNAME)
+    if not os.path.exists(path):
+        return []
+    with open(path, 'rt') as f:
+        return [json.loads(line) for line in f if line.strip()]
+
+def add_to_corpus(corpus_dir, case):
+    os.makedirs(corpus_dir, exist_ok=True)
+    with open(os.path.join(corpus_dir, CORPUS_FNAME), 'at') as f:
+        for packet in case.packets:
+            entry = {
+                'pre_insts': packet.pre_insts,
+                'insts': packet.insts,
+                'tags': packet.tags,
+                'valid_attrs': sorted(packet.valid_attrs),
+                'case': os.path.basename(case.dir),
+            }
+            f.write(json.dumps(entry) + '\n')
+
+def load_guide(stats_fnames, gcov_dir, corpus_dir, tags):
+    inst_counts, mem_counts = read_stats(stats_fnames)
+    uncovered = gcov_uncovered(gcov_dir, tags) if gcov_dir else set()
+    corpus = read_corpus(corpus_dir) if corpus_dir else []
+    log.info(f'guided generation: {len(inst_counts)} tags with history,'
+             f' {len(uncovered)} uncovered, {len(corpus)} corpus packets')
+    return GuideCfg(inst_counts, mem_counts, uncovered, corpus, corpus_dir)
+
+class Scheduler:
+    def __init__(self, guide):
+        self.guide = guide
+        self.inst_counts = Counter(guide.inst_counts)
+        self.mem_counts = Counter(guide.mem_counts)
+
+    def _weight(self, count):
+        return 1. / (1. + count) ** 0.5
+
+    def tag_weights(self, tags):
+        return [self._weight(self.inst_counts[tag]) *
+                (UNCOVERED_BOOST if tag in self.guide.uncovered else 1.)
+                for tag in tags]
+
+    def size_weights(self, sizes):
+        return [self._weight(sum(n for kind, n in self.mem_counts.items()
+                                 if kind.startswith(f'{size}:')))
+                for size in sizes]
+
+    def mode_weights(self, modes):
+        return [self._weight(sum(n for kind, n in self.mem_counts.items()
+                                 if kind.endswith(f':{mode}')))
+                for mode in modes]
+
+    def corpus_entry(self):
+        if self.guide.corpus and random.random() < CORPUS_RATE:
+            return random.choice(self.guide.corpus)
+        return None
+
+    def update(self, packet):
+        self.inst_counts.update(packet.tags)
+        self.mem_counts.update(mem_counts_of([packet]))
+
+_scheduler = None
+
+def get_scheduler(guide):
+    global _scheduler
+    if _scheduler is None:
+        _scheduler = Scheduler(guide)
+    return _scheduler
@@ -0,0 +1,209 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Persistent emulators: instead of starting qemu-system-hexagon for every
+# case, each pool worker keeps one instance alive, paused on its gdbstub.
+# A new test program is run by resetting the machine, writing the
+# program's loadable segments through the gdbstub and continuing up to
+# the test_done breakpoint. Machine construction and emulator startup
+# are paid once per worker.
+
+import atexit
+import ctypes
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import time
+from tempfile import mkdtemp
+
+from src import log
+from src.elf import Elf
+
+HEX_REG_PC = 41
+# Stay well below the gdbstub's packet buffer, 'M' packets are hex-encoded.
+_MEM_CHUNK = 1024
+
+def _die_with_parent():
+    # Don't leave emulators behind when the pool terminates its workers.
+    PR_SET_PDEATHSIG = 1
+    ctypes.CDLL(None).prctl(PR_SET_PDEATHSIG, signal.SIGKILL)
+
+class GdbRemote:
+    '''A minimal GDB remote serial protocol client.'''
+    def __init__(self, path, timeout):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.settimeout(timeout)
+        self.sock.connect(path)
+        self.buf = b''
+
+    def close(self):
+        self.sock.close()
+
+    def _read_byte(self):
+        if not self.buf:
+            self.buf = self.sock.recv(4096)
+            if not self.buf:
+                raise ConnectionError('gdbstub connection closed')
+        b, self.buf = self.buf[:1], self.buf[1:]
+        return b
+
+    def send(self, payload):
+        data = payload.encode('ascii')
+        csum = sum(data) & 0xff
+        self.sock.sendall(b'$' + data + b'#' + f'{csum:02x}'.encode('ascii'))
+        while True:
+            ack = self._read_byte()
+            if ack == b'+':
+                return
+            if ack == b'-':
+                self.sock.sendall(b'$' + data + b'#' + f'{csum:02x}'.encode('ascii'))
+
+    def recv(self):
+        while self._read_byte() != b'$':
+            pass
+        payload = b''
+        while True:
+            b = self._read_byte()
+            if b == b'#':
+                break
+            payload += b
+        self._read_byte()
+        self._read_byte()
+        self.sock.sendall(b'+')
+        return payload.decode('iso-8859-1')
+
+    def command(self, payload):
+        self.send(payload)
+        reply = self.recv()
+        # Skip console output from monitor commands
+        while reply.startswith('O') and reply != 'OK':
+            reply = self.recv()
+        return reply
+
+    def check(self, payload):
+        reply = self.command(payload)
+        if reply.startswith('E'):
+            raise ConnectionError(f"gdbstub replied '{reply}' to '{payload[:32]}'")
+        return reply
+
+def qemu_cmd(qemu, machine):
+    '''The emulator options, shared with the standalone command the repros
+    run, so that a repro sees the machine the server ran the case on.'''
+    return (f'{qemu} -M {machine} -nographic'
+            f' -semihosting-config enable=on,target=native')
+
+def standalone_cmd(qemu, machine, exe):
+    return f'{qemu_cmd(qemu, machine)} -kernel {exe}'
+
+class QemuServer:
+    def __init__(self, qemu, machine, timeout):
+        self.qemu = qemu
+        self.machine = machine
+        self.timeout = timeout
+        self.workdir = mkdtemp(prefix='worker_')
+        self.sock_path = os.path.join(self.workdir, 'gdb.sock')
+        self.log_path = os.path.join(self.workdir, 'qemu.log')
+        self.proc = None
+        self.gdb = None
+        self.bkpt = None
+
+    def alive(self):
+        return self.proc is not None and self.proc.poll() is None
+
+    def cmd(self, exe):
+        return (f'{qemu_cmd(self.qemu, self.machine)}'
+                f' -gdb unix:{self.sock_path},server=on,wait=off -S'
+                f' -kernel {exe}')
+
+    def start(self, exe):
+        self.stop()
+        log.debug(f'Starting persistent "{self.cmd(exe)}"')
+        with open(self.log_path, 'wb') as log_file:
+            self.proc = subprocess.Popen(self.cmd(exe).split(), cwd=self.workdir,
+                stdin=subprocess.DEVNULL, stdout=log_file,
+                stderr=subprocess.STDOUT, preexec_fn=_die_with_parent)
+        t0 = time.time()
+        while True:
+            try:
+                self.gdb = GdbRemote(self.sock_path, self.timeout)
+                break
+            except (FileNotFoundError, ConnectionRefusedError):
+                if not self.alive() or time.time() - t0 > self.timeout:
+                    raise ConnectionError(f'could not connect to {self.qemu}')
+                time.sleep(0.05)
+        self.bkpt = None
+
+    def stop(self):
+        if self.gdb is not None:
+            self.gdb.close()
+            self.gdb = None
+        if self.proc is not None:
+            self.proc.kill()
+            self.proc.wait()
+            self.proc = None
+        if os.path.exists(self.sock_path):
+            os.remove(self.sock_path)
+
+    def load(self, elf):
+        self.gdb.check('qRcmd,' + b'system_reset'.hex())
+        for seg in elf.segments():
+            data = seg.data + bytes(seg.memsz - len(seg.data))
+            for off in range(0, len(data), _MEM_CHUNK):
+                chunk = data[off:off + _MEM_CHUNK]
+                self.gdb.check(f'M{seg.addr + off:x},{len(chunk):x}:{chunk.hex()}')
+        self.gdb.check(f'P{HEX_REG_PC:x}={elf.entry.to_bytes(4, "little").hex()}')
+
+    def run(self, exe):
+        '''Runs exe up to test_done, restarting the emulator if it is not
+        usable. Raises subprocess.TimeoutExpired for hung guests, and
+        OSError (ConnectionError mostly) when the emulator can't be started
+        or stops answering the gdbstub.'''
+        elf = Elf(exe)
+        done = elf.symbols()['test_done']
+        if not self.alive():
+            self.start(exe)
+        else:
+            try:
+                self.load(elf)
+            except OSError as e:
+                log.debug(f'reloading {exe} failed ({e}), restarting {self.qemu}')
+                self.start(exe)
+        if self.bkpt != done:
+            if self.bkpt is not None:
+                self.gdb.check(f'z0,{self.bkpt:x},4')
+            self.gdb.check(f'Z0,{done:x},4')
+            self.bkpt = done
+
+        try:
+            self.gdb.send('c')
+            reply = self.gdb.recv()
+        except socket.timeout:
+            self.stop()
+            raise subprocess.TimeoutExpired(self.cmd(exe), self.timeout)
+        except OSError as e:
+            self.stop()
+            return subprocess.CompletedProcess(self.cmd(exe), 1, b'', str(e).encode())
+
+        if reply.startswith('W') or reply.startswith('X'):
+            # The guest ended the emulation before test_done
+            self.stop()
+            return subprocess.CompletedProcess(self.cmd(exe), 1, b'', reply.encode())
+        return subprocess.CompletedProcess(self.cmd(exe), 0, b'', b'')
+
+_servers = {}
+
+@atexit.register
+def _shutdown():
+    for srv in _servers.values():
+        srv.stop()
+        shutil.rmtree(srv.workdir, ignore_errors=True)
+
+def get_server(qemu, machine, timeout):
+    key = (qemu, machine)
+    if key not in _servers:
+        _servers[key] = QemuServer(qemu, machine, timeout)
+    return _servers[key]
@@ -0,0 +1,150 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# In-guest state snapshots: instead of attaching hexagon-lldb and parsing
+# "register read" output, the test program itself stores its architectural
+# state into a buffer after every iteration and writes it, together with
+# the memory_access window, to a file through semihosting. Comparing two
+# runs is then a byte diff of the two dump files.
+
+import struct
+
+from src.regs import gprs, vecs, vec_preds4
+from src.initialization import _MEM_BYTES
+
+SNAPSHOT_FNAME = 'snapshot.bin'
+
+HEX_SYS_OPEN = 0x01
+HEX_SYS_CLOSE = 0x02
+HEX_SYS_WRITE = 0x05
+# Angel open mode for "wb": O_WRONLY | O_CREAT | O_TRUNC
+OPEN_MODE_WB = 5
+
+_HVX_BYTES = 128
+
+# User-visible control registers, by control register number. The
+# system registers dumped by the lldb flow (badva, ccr, ssr...) can't be
+# read from the test program and the packets never write them anyway.
+snapshot_ctrls = (
+    ('sa0', 0), ('lc0', 1), ('sa1', 2), ('lc1', 3),
+    ('p3_0', 4), ('m0', 6), ('m1', 7), ('usr', 8),
+    ('ugp', 10), ('gp', 11), ('cs0', 12), ('cs1', 13),
+    ('framelimit', 16), ('framekey', 17),
+)
+
+# Record layout. Every section is HVX-aligned so that the vector
+# stores can use post-incremented vmem.
+GPR_OFFSET = 0
+CTRL_OFFSET = GPR_OFFSET + _HVX_BYTES
+VEC_OFFSET = CTRL_OFFSET + _HVX_BYTES
+QREG_OFFSET = VEC_OFFSET + len(vecs) * _HVX_BYTES
+REGS_BYTES = QREG_OFFSET + len(vec_preds4) * _HVX_BYTES
+RECORD_BYTES = REGS_BYTES + _MEM_BYTES
+
+assert len(gprs) * 4 <= CTRL_OFFSET - GPR_OFFSET
+assert len(snapshot_ctrls) * 4 <= VEC_OFFSET - CTRL_OFFSET
+
+def _semihost_call(code, args, args_label='snapshot_args'):
+    insts = [f'r1 = ##{args_label}']
+    for i, arg in enumerate(args):
+        insts.append(f'r2 = {arg}')
+        insts.append(f'memw(r1+#{i * 4}) = r2')
+    insts.append(f'r0 = #0x{code:02x}')
+    insts.append('trap0(#0)')
+    return insts
+
+def gen_snapshot_routines():
+    '''Returns the data and code for snapshot_open, snapshot_save
+    and snapshot_close.'''
+    # r0 and r1 are saved with an absolute store so that r0 can
+    # become the buffer base, everything else is stored relative to it.
+    save = ['memd(##snapshot_regs) = r1:0', 'r0 = ##snapshot_regs']
+    save += [f'memd(r0+#{GPR_OFFSET + i * 4}) = r{i+1}:{i}'
+             for i in range(2, len(gprs) - 1, 2)]
+    save += [f'memw(r0+#{GPR_OFFSET + (len(gprs) - 1) * 4}) = r{len(gprs) - 1}']
+    for i, (_, creg) in enumerate(snapshot_ctrls):
+        save.append(f'r2 = c{creg}')
+        save.append(f'memw(r0+#{CTRL_OFFSET + i * 4}) = r2')
+    save.append(f'r1 = add(r0, #{VEC_OFFSET})')
+    save += [f'vmem(r1++#1) = {v}' for v in vecs]
+    # There is no direct store for predicate registers, expand each one
+    # into v0, which is restored from the buffer right after.
+    save.append('r2 = #-1')
+    for q in vec_preds4:
+        save.append(f'v0 = vand({q}, r2)')
+        save.append('vmem(r1++#1) = v0')
+    save.append(f'v0 = vmem(r0+#{VEC_OFFSET // _HVX_BYTES})')
+
+    save += _semihost_call(HEX_SYS_WRITE,
+        ('memw(##snapshot_fd)', '##snapshot_regs', f'##{REGS_BYTES}'))
+    save += _semihost_call(HEX_SYS_WRITE,
+        ('memw(##snapshot_fd)', '##memory_access', f'##{_MEM_BYTES}'))
+
+    save += ['r0 = ##snapshot_regs',
+             f'r3:2 = memd(r0+#{GPR_OFFSET + 8})',
+             'r1:0 = memd(r0+#0)']
+
+    open_ = _semihost_call(HEX_SYS_OPEN,
+        ('##snapshot_fname', f'#{OPEN_MODE_WB}', f'#{len(SNAPSHOT_FNAME)}'))
+    open_.append('memw(##snapshot_fd) = r0')
+
+    close = _semihost_call(HEX_SYS_CLOSE, ('memw(##snapshot_fd)',))
+
+    def routine(name, insts):
+        body = '\n    '.join(insts)
+        return f'''.align 0x04
+{name}:
+    {body}
+    jumpr r31
+'''
+
+    return f'''
+    .data
+.p2align 7
+snapshot_regs:
+.skip {REGS_BYTES}
+snapshot_args:
+.word 0, 0, 0, 0
+snapshot_fd:
+.word -1
+snapshot_fname:
+.string "{SNAPSHOT_FNAME}"
+    .text
+
+{routine('snapshot_open', open_)}
+{routine('snapshot_save', save)}
+{routine('snapshot_close', close)}
+'''
+
+def _words(data, count):
+    return struct.unpack(f'<{count}I', data[:count * 4])
+
+def decode(data):
+    '''Renders a snapshot dump in a "reg = value" form, one iteration
+    per block, so that mismatches can be reviewed with sdiff.'''
+    lines = []
+    for it, start in enumerate(range(0, len(data), RECORD_BYTES)):
+        rec = data[start:start + RECORD_BYTES]
+        lines.append(f'iteration {it}:')
+        if len(rec) < RECORD_BYTES:
+            lines.append(f'  truncated record ({len(rec)} bytes)')
+            break
+        for name, val in zip(gprs, _words(rec[GPR_OFFSET:], len(gprs))):
+            lines.append(f'  {name} = 0x{val:08x}')
+        ctrl_vals = _words(rec[CTRL_OFFSET:], len(snapshot_ctrls))
+        for (name, _), val in zip(snapshot_ctrls, ctrl_vals):
+            lines.append(f'  {name} = 0x{val:08x}')
+        for i, name in enumerate(vecs + vec_preds4):
+            off = VEC_OFFSET + i * _HVX_BYTES
+            lines.append(f'  {name} = {rec[off:off + _HVX_BYTES].hex()}')
+        mem = rec[REGS_BYTES:]
+        for off in range(0, len(mem), 32):
+            lines.append(f'  memory_access+0x{off:04x} = {mem[off:off + 32].hex()}')
+    return '\n'.join(lines) + '\n'
+
+if __name__ == '__main__':
+    import sys
+    with open(sys.argv[1], 'rb') as f:
+        sys.stdout.write(decode(f.read()))
@@ -0,0 +1,90 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+# Streaming run statistics. Every finished case is appended to a JSON
+# lines log as soon as its result comes back, with the time spent in each
+# phase, and an aggregated report (overall and recent throughput, per
+# phase percentiles) is printed periodically. A multi-hour run can be
+# watched, or its log inspected, while it is still going.
+
+import json
+import os.path
+import time
+
+from src.run_test import PHASES, infra_error
+
+PERCENTILES = (50, 90, 99)
+
+def percentile(sorted_vals, p):
+    if not sorted_vals:
+        return 0.
+    k = min(len(sorted_vals) - 1, int(round(p / 100. * (len(sorted_vals) - 1))))
+    return sorted_vals[k]
+
+def phase_summary(times):
+    summary = {}
+    for phase in PHASES:
+        vals = sorted(times[phase])
+        summary[phase] = {f'p{p}': percentile(vals, p) for p in PERCENTILES}
+        summary[phase]['total'] = sum(vals)
+    return summary
+
+class StatsSink:
+    def __init__(self, fname, total, interval):
+        self.f = open(fname, 'wt')
+        self.total = total
+        self.interval = interval
+        self.t0 = time.time()
+        self.cases = 0
+        self.passes = 0
+        self.packets = 0
+        self.times = {phase: [] for phase in PHASES}
+        self.last_report = (self.t0, 0)
+
+    def add(self, fails, case):
+        packets = len(case.packets) * case.cfg.test_iters
+        times = case.times or {}
+        entry = {
+            'time': round(time.time() - self.t0, 3),
+            'case': os.path.basename(case.dir) if case.dir else None,
+            'fails': bool(fails),
+            'infra_error': bool(fails) and infra_error(case),
+            'packets': packets,
+            'tries': case.tries,
+            'times': {phase: round(t, 4) for phase, t in times.items()},
+            'tags': [packet.tags for packet in case.packets],
+        }
+        if case.perf is not None:
+            from src.perf import perf_entry
+            entry['perf'] = perf_entry(case.perf)
+        self.f.write(json.dumps(entry) + '\n')
+        self.f.flush()
+
+        self.cases += 1
+        self.passes += 0 if fails else 1
+        self.packets += packets
+        for phase, t in times.items():
+            self.times[phase].append(t)
+        if time.time() - self.last_report[0] >= self.interval:
+            self.report()
+
+    def report(self):
+        now = time.time()
+        last_t, last_packets = self.last_report
+        rate = self.packets / max(now - self.t0, 1e-6)
+        recent = (self.packets - last_packets) / max(now - last_t, 1e-6)
+        self.last_report = (now, self.packets)
+        summary = phase_summary(self.times)
+        phases = ', '.join(
+            f'{phase} ' + '/'.join(f"{summary[phase][f'p{p}']:.2f}"
+                                   for p in PERCENTILES)
+            for phase in PHASES)
+        print(f'[{now - self.t0:.0f}s] {self.cases}/{self.total} cases,'
+              f' {self.cases - self.passes} failing,'
+              f' {rate:.2f} packets/sec ({recent:.2f} recently);'
+              f' p{"/p".join(map(str, PERCENTILES))} secs: {phases}')
+
+    def close(self):
+        self.f.close()
@@ -0,0 +1,70 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+import random
+import unittest
+
+from src.cycles import DATA_BASE, unusable, populate, kernel_setup
+
+ISET = {
+    'L2_loadri_io': {'syntax': 'Rd32=memw(Rs32+#s11:2)', 'attrs': 'A_LOAD'},
+    'L2_loadri_pr': {'syntax': 'Rd32=memw(Rx32++Mu2)', 'attrs': 'A_LOAD'},
+    'L2_loadw_locked': {'syntax': 'Rd32=memw_locked(Rs32)',
+                        'attrs': 'A_LOAD,A_ATOMIC'},
+    'L4_loadri_rr': {'syntax': 'Rd32=memw(Rs32+Rt32<<#u2)', 'attrs': 'A_LOAD'},
+    'L4_loadri_ap': {'syntax': 'Rd32=memw(Re32=#U6)', 'attrs': 'A_LOAD'},
+    'L2_loadri_pci': {'syntax': 'Rd32=memw(Rx32++#s4:2:circ(Mu2))',
+                      'attrs': 'A_LOAD'},
+    'S2_allocframe': {'syntax': 'allocframe(Rx32,#u11:3):raw',
+                      'attrs': 'A_STORE'},
+    'Y2_tlbw': {'syntax': 'tlbw(Rss32,Rt32)', 'attrs': 'A_PRIV'},
+}
+
+class CyclesFilterTest(unittest.TestCase):
+    def setUp(self):
+        random.seed(0)
+
+    def test_unusable(self):
+        for tag in ('L2_loadri_io', 'L2_loadri_pr', 'L2_loadw_locked',
+                    'L4_loadri_rr'):
+            self.assertIsNone(unusable(ISET, tag), tag)
+        self.assertEqual(unusable(ISET, 'Y2_tlbw'), 'privileged')
+        self.assertEqual(unusable(ISET, 'L4_loadri_ap'),
+                         'absolute or gp-relative address')
+        self.assertEqual(unusable(ISET, 'L2_loadri_pci'),
+                         'circular or bit-reversed addressing')
+        self.assertEqual(unusable(ISET, 'S2_allocframe'),
+                         'moves its base register')
+
+    def test_base_register(self):
+        for tag in ('L2_loadri_io', 'L2_loadw_locked', 'L4_loadri_rr'):
+            for _ in range(20):
+                pairs = populate(ISET, tag)
+                self.assertIsNotNone(pairs, tag)
+                setup = kernel_setup(pairs)
+                self.assertEqual(sum(DATA_BASE in i for i in setup), 1, pairs)
+
+    def test_offsets(self):
+        for _ in range(20):
+            (_, syntax), = populate(ISET, 'L2_loadri_io')
+            offset = int(syntax.split('#')[1].rstrip(')'))
+            self.assertEqual(offset % 4, 0, syntax)
+            self.assertLessEqual(abs(offset), 16, syntax)
+
+    def test_modifier(self):
+        pairs = populate(ISET, 'L2_loadri_pr')
+        setup = kernel_setup(pairs)
+        mod = pairs[0][1].split('++')[1].rstrip(')')
+        self.assertEqual(setup[:2], ['r2 = #0', f'{mod} = r2'])
+
+    def test_written_base(self):
+        self.assertIsNone(kernel_setup([('L2_loadri_io', 'r3=memw(r3+#0)')]))
+        self.assertIsNone(kernel_setup([('L2_loadri_io', 'r3=memw(r4+#0)'),
+                                        ('L2_loadri_io', 'r4=memw(r5+#0)')]))
+        self.assertEqual(kernel_setup([('L4_loadri_rr', 'r3=memw(r4+r5<<#2)')]),
+                         [f'r4 = {DATA_BASE}', 'r5 = #0'])
+
+if __name__ == '__main__':
+    unittest.main()
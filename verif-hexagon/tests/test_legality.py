@@ -0,0 +1,43 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+import unittest
+
+from src.legality import get_checker
+
+ISET = {
+    'A2_paddt': {'syntax': 'if (Pu4) Rd32=add(Rs32,Rt32)', 'attrs': ''},
+    'A2_paddf': {'syntax': 'if (!Pu4) Rd32=add(Rs32,Rt32)', 'attrs': ''},
+    'A2_add': {'syntax': 'Rd32=add(Rs32,Rt32)', 'attrs': ''},
+}
+
+class Packet:
+    def __init__(self, insts):
+        self.insts = insts
+
+def check(*insts):
+    return get_checker(ISET).check(Packet(dict(insts)))
+
+class DestinationsTest(unittest.TestCase):
+    def test_complementary_writes(self):
+        self.assertIsNone(check(('A2_paddt', 'if (p0) r1 = add(r2, r3)'),
+                                ('A2_paddf', 'if (!p0) r1 = add(r4, r5)')))
+        self.assertIsNone(check(('A2_paddt', 'if (p1.new) r1 = add(r2, r3)'),
+                                ('A2_paddf', 'if (!p1.new) r1 = add(r4, r5)'),
+                                ('A2_add', 'p1 = cmp.eq(r2, r3)')))
+
+    def test_duplicate_writes(self):
+        self.assertEqual(check(('A2_paddt', 'if (p0) r1 = add(r2, r3)'),
+                               ('A2_add', 'r1 = add(r4, r5)')),
+                         'r1 written twice')
+        self.assertEqual(check(('A2_paddt', 'if (p0) r1 = add(r2, r3)'),
+                               ('A2_paddf', 'if (!p1) r1 = add(r4, r5)')),
+                         'r1 written twice')
+        self.assertEqual(check(('A2_paddt', 'if (p0) r1 = add(r2, r3)'),
+                               ('A2_paddf', 'if (p0) r1 = add(r4, r5)')),
+                         'r1 written twice')
+
+if __name__ == '__main__':
+    unittest.main()
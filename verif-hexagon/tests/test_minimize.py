@@ -0,0 +1,94 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+import os.path
+import shutil
+import stat
+import sys
+import unittest
+from collections import namedtuple
+from tempfile import mkdtemp
+
+from src import run_test
+from src.minimize import Minimizer, parse_packets
+from src.run_test import TEMPL_FIELDS, DebugRun, TestCase, TestPacket, \
+    gen_case_src_sections, write_repro
+
+Cfg = namedtuple('Cfg', 'test_iters,snapshot,cflags')
+
+BAD_INST = 'r5 = add(r5, #7)'
+
+# Stand-ins for the toolchain: the "executable" is the assembly source,
+# and the debugger reports a difference when the new emulator runs it
+# with BAD_INST in it. Like hexagon-lldb, it needs its --source script.
+FAKE_CC = '''
+import shutil, sys
+args = sys.argv[1:]
+shutil.copy(args[-1], args[args.index('-o') + 1])
+'''
+
+FAKE_LLDB = f'''
+import sys
+args = sys.argv[1:]
+script = open(args[args.index('--source') + 1]).read()
+exe = open(args[args.index('--source') + 2]).read()
+print('r0 = 0x00000001')
+bad = args[-1] == 'new' and {BAD_INST!r} in exe
+print('r5 = 0x00000007' if bad else 'r5 = 0x00000000')
+'''
+
+def write_tool(path, text):
+    with open(path, 'wt') as f:
+        f.write(f'#!{sys.executable}\n{text}')
+    os.chmod(path, os.stat(path).st_mode | stat.S_IEXEC)
+
+class MinimizeLldbTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = mkdtemp(prefix='test_minimize_')
+        self.saved = run_test.CC, run_test.LLDB
+        run_test.CC = os.path.join(self.tmp, 'cc')
+        run_test.LLDB = os.path.join(self.tmp, 'lldb')
+        write_tool(run_test.CC, FAKE_CC)
+        write_tool(run_test.LLDB, FAKE_LLDB)
+
+        case_dir = os.path.join(self.tmp, 'pkt_case')
+        os.makedirs(case_dir)
+        packets = [TestPacket([], {'a': f'r{i} = add(r{i}, #1)'}, ['A2_addi'],
+                              set()) for i in range(6)]
+        packets[3] = TestPacket([], {'a': BAD_INST}, ['A2_addi'], set())
+        case = TestCase(Cfg(4, False, ''), packets, case_dir,
+                        os.path.join(case_dir, 'test_out'))
+        sections = gen_case_src_sections(case)
+        for field in TEMPL_FIELDS:
+            with open(os.path.join(case_dir, field), 'wt') as f:
+                f.write(sections[field])
+        # As _debug() leaves it
+        script = os.path.join(case_dir, 'test_case_script.lldb')
+        with open(script, 'wt') as f:
+            f.write(run_test.gen_lldb_script(case))
+        cmd = f'{run_test.LLDB} --batch --source {script} {case.exe} -- -M'
+        write_repro(case, DebugRun(f'{cmd} base', None),
+                    DebugRun(f'{cmd} new', None))
+        repro = os.path.join(case_dir, 'repro.sh')
+        with open(repro, 'rt') as f:
+            text = f.read().replace('__FILL_IN_DIR__', case_dir)
+        with open(repro, 'wt') as f:
+            f.write(text)
+        self.case_dir = case_dir
+
+    def tearDown(self):
+        run_test.CC, run_test.LLDB = self.saved
+        shutil.rmtree(self.tmp)
+
+    def test_minimize(self):
+        dest = Minimizer(self.case_dir, 2, 60., True).run()
+        with open(os.path.join(dest, 'test_packets'), 'rt') as f:
+            packets = parse_packets(f.read())
+        self.assertEqual([p.insts for p in packets], [[BAD_INST]])
+        self.assertTrue(os.path.exists(os.path.join(dest,
+                                                    'test_case_script.lldb')))
+
+if __name__ == '__main__':
+    unittest.main()
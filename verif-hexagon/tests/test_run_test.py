@@ -0,0 +1,71 @@
+#
+# Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+# SPDX-License-Identifier: BSD-3-Clause-Clear
+#
+
+import os.path
+import subprocess
+import unittest
+from collections import namedtuple
+from string import Template
+
+from src import objcache
+from src.run_test import TestCase, TestPacket, gen_case_src_sections, \
+    packet_shape, packet_lines_owner, update_negative_cache
+
+BASEDIR = os.path.join(os.path.dirname(__file__), '..')
+
+Cfg = namedtuple('Cfg', 'test_iters,snapshot')
+
+def packets_src(packets):
+    case = TestCase(Cfg(1, False), packets, None, None)
+    with open(os.path.join(BASEDIR, 'etc', 'test_packets.tmpl'), 'rt') as f:
+        tmpl = Template(f.read())
+    return case, tmpl.substitute(gen_case_src_sections(case))
+
+def assembler_error(filename, line):
+    return subprocess.CompletedProcess(
+        'cc', 1, b'', f'{filename}:{line + 1}:5: error: bad\n'.encode())
+
+class NegativeCacheTest(unittest.TestCase):
+    def setUp(self):
+        objcache.negative = objcache.NegativeCache()
+        self.packets = [
+            TestPacket(['r10 = ##memory_access'],
+                       {'a': 'r0 = memw(r10+#0)'}, ['L2_loadri_io'], set()),
+            TestPacket(['r11 = ##memory_access'],
+                       {'a': 'memw(r11+#0) = r1'}, ['S2_storeri_io'], set()),
+        ]
+        self.case, self.src = packets_src(self.packets)
+        self.lines = self.src.split('\n')
+
+    def line_of(self, text):
+        return next(i for i, l in enumerate(self.lines) if text in l)
+
+    def failed_shapes(self, line):
+        p = assembler_error('test_packets.S', line)
+        update_negative_cache(self.case, p, 'test_packets.S', self.src)
+        return set(objcache.negative.failures)
+
+    def test_packet_lines(self):
+        owner = packet_lines_owner(self.src)
+        self.assertEqual(owner[self.line_of('r10 = ##memory_access')], 0)
+        self.assertEqual(owner[self.line_of('r0 = memw(r10+#0)')], 0)
+        self.assertEqual(owner[self.line_of('r11 = ##memory_access')], 1)
+        self.assertEqual(owner[self.line_of('memw(r11+#0) = r1')], 1)
+        self.assertIsNone(owner[self.line_of('test_end:')])
+
+    def test_error_in_packet(self):
+        self.assertEqual(self.failed_shapes(self.line_of('memw(r11+#0) = r1')),
+                         {packet_shape(self.packets[1])})
+
+    def test_error_in_pre_insts(self):
+        # The pre_insts come after the previous packet, they must not be
+        # blamed on it.
+        self.assertEqual(self.failed_shapes(self.line_of('r11 = ##memory_access')),
+                         {packet_shape(self.packets[1])})
+        self.assertEqual(self.failed_shapes(self.line_of('r10 = ##memory_access')),
+                         {packet_shape(p) for p in self.packets})
+
+if __name__ == '__main__':
+    unittest.main()